@@ -69,6 +69,11 @@
 
 #define SO_RXQ_OVFL             40
 
+#define SO_BUSY_POLL		46
+
+/* Not an upstream option: numbered clear of upstream, same on all arches */
+#define SO_BUSY_POLL_STATS	0x7f00
+
 #ifdef __KERNEL__
 /* O_NONBLOCK clashes with the bits used for socket types.  Therefore we
  * have to define SOCK_NONBLOCK to a different value here.
@@ -57,6 +57,8 @@
 #define LOW_WATERMARK          2
 #define HIGH_WATERMARK         4
 
+#define UL_AGGR_MAX_SIZE	8192
+
 #define MODULE_NAME "[BAMDMUX] "
 
 static int ril_debug_flag = 0;
@@ -65,6 +67,24 @@ static int msm_bam_dmux_debug_enable;
 module_param_named(debug_enable, msm_bam_dmux_debug_enable,
 		   int, S_IRUGO | S_IWUSR | S_IWGRP);
 
+/*
+ * Largest uplink descriptor built from several mux frames while the tx
+ * pipe is busy, 0 to send every frame in its own descriptor.  The A2
+ * must be set up to accept aggregated uplink data.
+ */
+static int ul_aggr_size;
+module_param_named(ul_aggr_size, ul_aggr_size,
+		   int, S_IRUGO | S_IWUSR | S_IWGRP);
+
+/*
+ * Reflect uplink data frames back into the downlink path, for testing.
+ * The A2 link must be up and the channel opened by the modem as usual;
+ * only the data frames skip the hardware.
+ */
+static int bam_dmux_loopback;
+module_param_named(loopback, bam_dmux_loopback,
+		   int, S_IRUGO | S_IWUSR | S_IWGRP);
+
 #if defined(DEBUG)
 static int msm_bam_dmux_packet_cnt_enable = 0;
 module_param_named(packet_cnt_enable, msm_bam_dmux_packet_cnt_enable,
@@ -75,6 +95,8 @@ static uint32_t bam_dmux_write_cpy_cnt;
 static uint32_t bam_dmux_write_cpy_bytes;
 static uint32_t bam_dmux_tx_sps_failure_cnt;
 static uint32_t bam_dmux_tx_stall_cnt;
+static uint32_t bam_dmux_rx_aggr_cnt;
+static uint32_t bam_dmux_ul_aggr_cnt;
 static atomic_t bam_dmux_ack_out_cnt = ATOMIC_INIT(0);
 static atomic_t bam_dmux_ack_in_cnt = ATOMIC_INIT(0);
 static atomic_t bam_dmux_a2_pwr_cntl_in_cnt = ATOMIC_INIT(0);
@@ -115,6 +137,14 @@ static atomic_t bam_dmux_a2_pwr_cntl_in_cnt = ATOMIC_INIT(0);
 	bam_dmux_tx_stall_cnt++; \
 } while (0)
 
+#define DBG_INC_RX_AGGR_CNT() do { \
+	bam_dmux_rx_aggr_cnt++; \
+} while (0)
+
+#define DBG_INC_UL_AGGR_CNT() do { \
+	bam_dmux_ul_aggr_cnt++; \
+} while (0)
+
 #define DBG_INC_ACK_OUT_CNT() \
 	atomic_inc(&bam_dmux_ack_out_cnt)
 
@@ -130,6 +160,8 @@ static atomic_t bam_dmux_a2_pwr_cntl_in_cnt = ATOMIC_INIT(0);
 #define DBG_INC_WRITE_CPY(x...) do { } while (0)
 #define DBG_INC_TX_SPS_FAILURE_CNT() do { } while (0)
 #define DBG_INC_TX_STALL_CNT() do { } while (0)
+#define DBG_INC_RX_AGGR_CNT() do { } while (0)
+#define DBG_INC_UL_AGGR_CNT() do { } while (0)
 #define DBG_INC_ACK_OUT_CNT() do { } while (0)
 #define DBG_INC_A2_POWER_CONTROL_IN_CNT() \
 	do { } while (0)
@@ -151,7 +183,10 @@ struct tx_pkt_info {
 	struct sk_buff *skb;
 	dma_addr_t dma_address;
 	char is_cmd;
+	char is_aggr;
 	uint32_t len;
+	void *aggr_buf;
+	struct sk_buff_head aggr_q;	/* frames copied into aggr_buf */
 	struct work_struct work;
 	struct list_head list_node;
 	unsigned ts_sec;
@@ -161,6 +196,7 @@ struct tx_pkt_info {
 struct rx_pkt_info {
 	struct sk_buff *skb;
 	dma_addr_t dma_address;
+	uint32_t len;
 	struct work_struct work;
 	struct list_head list_node;
 };
@@ -191,8 +227,15 @@ static int polling_mode;
 static LIST_HEAD(bam_rx_pool);
 static DEFINE_MUTEX(bam_rx_pool_mutexlock);
 static int bam_rx_pool_len;
+static LIST_HEAD(bam_rx_free_pool);	/* spare rx_pkt_info */
+static struct sk_buff_head bam_rx_skb_pool;	/* recycled rx buffers */
 static LIST_HEAD(bam_tx_pool);
 static DEFINE_SPINLOCK(bam_tx_pool_spinlock);
+/* uplink aggregate being filled, protected by bam_tx_pool_spinlock */
+static struct tx_pkt_info *ul_aggr_pkt;
+static uint32_t ul_aggr_cap;
+
+static struct sk_buff_head bam_loopback_q;
 
 struct bam_mux_hdr {
 	uint16_t magic_num;
@@ -207,8 +250,10 @@ static void notify_all(int event, unsigned long data);
 static void bam_mux_write_done(struct work_struct *work);
 static void handle_bam_mux_cmd(struct work_struct *work);
 static void rx_timer_work_func(struct work_struct *work);
+static void loopback_work_func(struct work_struct *work);
 
 static DECLARE_WORK(rx_timer_work, rx_timer_work_func);
+static DECLARE_WORK(loopback_work, loopback_work_func);
 
 static struct workqueue_struct *bam_mux_rx_workqueue;
 static struct workqueue_struct *bam_mux_tx_workqueue;
@@ -405,6 +450,50 @@ static inline void verify_tx_queue_is_empty(const char *func)
 	spin_unlock_irqrestore(&bam_tx_pool_spinlock, flags);
 }
 
+static struct rx_pkt_info *bam_rx_info_get(void)
+{
+	struct rx_pkt_info *info = NULL;
+
+	mutex_lock(&bam_rx_pool_mutexlock);
+	if (!list_empty(&bam_rx_free_pool)) {
+		info = list_first_entry(&bam_rx_free_pool,
+					struct rx_pkt_info, list_node);
+		list_del(&info->list_node);
+	}
+	mutex_unlock(&bam_rx_pool_mutexlock);
+
+	if (!info)
+		info = kmalloc(sizeof(struct rx_pkt_info), GFP_KERNEL);
+	return info;
+}
+
+static void bam_rx_info_put(struct rx_pkt_info *info)
+{
+	mutex_lock(&bam_rx_pool_mutexlock);
+	list_add(&info->list_node, &bam_rx_free_pool);
+	mutex_unlock(&bam_rx_pool_mutexlock);
+}
+
+static struct sk_buff *bam_rx_skb_get(void)
+{
+	struct sk_buff *skb;
+
+	skb = skb_dequeue(&bam_rx_skb_pool);
+	if (!skb)
+		skb = __dev_alloc_skb(BUFFER_SIZE, GFP_KERNEL);
+	return skb;
+}
+
+/* Buffers that were not passed up (commands, drops) are reused as is */
+static void bam_rx_skb_put(struct sk_buff *skb)
+{
+	if (skb_queue_len(&bam_rx_skb_pool) < NUM_BUFFERS &&
+	    skb_recycle_check(skb, BUFFER_SIZE))
+		skb_queue_tail(&bam_rx_skb_pool, skb);
+	else
+		dev_kfree_skb_any(skb);
+}
+
 static void queue_rx(void)
 {
 	void *ptr;
@@ -422,7 +511,7 @@ static void queue_rx(void)
 			goto fail;
 		}
 
-		info = kmalloc(sizeof(struct rx_pkt_info), GFP_KERNEL);
+		info = bam_rx_info_get();
 		if (!info) {
 			pr_err(MODULE_NAME "%s: unable to alloc rx_pkt_info\n", __func__);
 			goto fail;
@@ -430,7 +519,7 @@ static void queue_rx(void)
 
 		INIT_WORK(&info->work, handle_bam_mux_cmd);
 
-		info->skb = __dev_alloc_skb(BUFFER_SIZE, GFP_KERNEL);
+		info->skb = bam_rx_skb_get();
 		if (info->skb == NULL) {
 			DMUX_LOG_KERR("%s: unable to alloc skb\n", __func__);
 			goto fail_info;
@@ -473,10 +562,10 @@ fail_transfer:
 				DMA_FROM_DEVICE);
 
 fail_skb:
-	dev_kfree_skb_any(info->skb);
+	bam_rx_skb_put(info->skb);
 
 fail_info:
-	kfree(info);
+	bam_rx_info_put(info);
 
 fail:
 	if (rx_len_cached == 0) {
@@ -485,14 +574,10 @@ fail:
 	}
 }
 
-static void bam_mux_process_data(struct sk_buff *rx_skb)
+static void bam_mux_deliver(struct sk_buff *rx_skb, struct bam_mux_hdr *rx_hdr)
 {
 	unsigned long flags;
-	struct bam_mux_hdr *rx_hdr;
 	unsigned long event_data;
-	DBG("%s: entry\n", __func__);
-
-	rx_hdr = (struct bam_mux_hdr *)rx_skb->data;
 
 	rx_skb->data = (unsigned char *)(rx_hdr + 1);
 	rx_skb->tail = rx_skb->data + rx_hdr->pkt_len;
@@ -509,8 +594,62 @@ static void bam_mux_process_data(struct sk_buff *rx_skb)
 	else
 		dev_kfree_skb_any(rx_skb);
 	spin_unlock_irqrestore(&bam_ch[rx_hdr->ch_id].lock, flags);
+}
 
-	queue_rx();
+/*
+ * A receive buffer holds @len bytes of one or more back to back data
+ * frames.  Every frame but the last goes up as a clone sharing the
+ * buffer, so an aggregated buffer costs one allocation and one mapping.
+ */
+static void bam_mux_process_data(struct sk_buff *rx_skb, uint32_t len)
+{
+	struct bam_mux_hdr *rx_hdr;
+	struct sk_buff *skb;
+	unsigned char *buf = rx_skb->data;
+	uint32_t offset = 0;
+	uint32_t frame_len;
+
+	DBG("%s: entry\n", __func__);
+
+	rx_hdr = (struct bam_mux_hdr *)buf;
+	frame_len = sizeof(struct bam_mux_hdr) + rx_hdr->pkt_len +
+			rx_hdr->pad_len;
+	/* the transfer size is not always reported, assume one frame */
+	if (!len || len > BUFFER_SIZE)
+		len = min_t(uint32_t, frame_len, BUFFER_SIZE);
+
+	while (rx_skb && offset + sizeof(struct bam_mux_hdr) <= len) {
+		rx_hdr = (struct bam_mux_hdr *)(buf + offset);
+		frame_len = sizeof(struct bam_mux_hdr) + rx_hdr->pkt_len +
+				rx_hdr->pad_len;
+		if (rx_hdr->magic_num != BAM_MUX_HDR_MAGIC_NO ||
+		    rx_hdr->cmd != BAM_MUX_HDR_CMD_DATA ||
+		    rx_hdr->ch_id >= BAM_DMUX_NUM_CHANNELS ||
+		    offset + frame_len > len) {
+			bam_dmux_log("%s: dropping %u bytes at offset %u\n",
+				__func__, len - offset, offset);
+			break;
+		}
+		offset += frame_len;
+		DBG_INC_READ_CNT(rx_hdr->pkt_len);
+
+		if (offset + sizeof(struct bam_mux_hdr) <= len) {
+			skb = skb_clone(rx_skb, GFP_KERNEL);
+			if (!skb) {
+				DMUX_LOG_KERR("%s: skb_clone failed\n",
+					__func__);
+				continue;
+			}
+			DBG_INC_RX_AGGR_CNT();
+		} else {
+			skb = rx_skb;
+			rx_skb = NULL;
+		}
+		bam_mux_deliver(skb, rx_hdr);
+	}
+
+	if (rx_skb)
+		bam_rx_skb_put(rx_skb);
 	DBG("%s: exit\n", __func__);
 }
 
@@ -545,11 +684,13 @@ static void handle_bam_mux_cmd(struct work_struct *work)
 	struct bam_mux_hdr *rx_hdr;
 	struct rx_pkt_info *info;
 	struct sk_buff *rx_skb;
+	uint32_t len;
 
 	info = container_of(work, struct rx_pkt_info, work);
 	rx_skb = info->skb;
+	len = info->len;
 	dma_unmap_single(NULL, info->dma_address, BUFFER_SIZE, DMA_FROM_DEVICE);
-	kfree(info);
+	bam_rx_info_put(info);
 
 	rx_hdr = (struct bam_mux_hdr *)rx_skb->data;
 
@@ -563,7 +704,7 @@ static void handle_bam_mux_cmd(struct work_struct *work)
 			" pad %d ch %d len %d\n", __func__,
 			rx_hdr->magic_num, rx_hdr->reserved, rx_hdr->cmd,
 			rx_hdr->pad_len, rx_hdr->ch_id, rx_hdr->pkt_len);
-		dev_kfree_skb_any(rx_skb);
+		bam_rx_skb_put(rx_skb);
 		queue_rx();
 		return;
 	}
@@ -574,15 +715,15 @@ static void handle_bam_mux_cmd(struct work_struct *work)
 			" pad %d ch %d len %d\n", __func__,
 			rx_hdr->ch_id, rx_hdr->reserved, rx_hdr->cmd,
 			rx_hdr->pad_len, rx_hdr->ch_id, rx_hdr->pkt_len);
-		dev_kfree_skb_any(rx_skb);
+		bam_rx_skb_put(rx_skb);
 		queue_rx();
 		return;
 	}
 
 	switch (rx_hdr->cmd) {
 	case BAM_MUX_HDR_CMD_DATA:
-		DBG_INC_READ_CNT(rx_hdr->pkt_len);
-		bam_mux_process_data(rx_skb);
+		bam_mux_process_data(rx_skb, len);
+		queue_rx();
 		break;
 	case BAM_MUX_HDR_CMD_OPEN:
 		bam_dmux_log("%s: opening cid %d PC enabled\n", __func__,
@@ -592,7 +733,7 @@ static void handle_bam_mux_cmd(struct work_struct *work)
 			bam_dmux_log("%s: activating disconnect ack\n");
 			disconnect_ack = 1;
 		}
-		dev_kfree_skb_any(rx_skb);
+		bam_rx_skb_put(rx_skb);
 		break;
 	case BAM_MUX_HDR_CMD_OPEN_NO_A2_PC:
 		bam_dmux_log("%s: opening cid %d PC disabled\n", __func__,
@@ -604,7 +745,7 @@ static void handle_bam_mux_cmd(struct work_struct *work)
 		}
 
 		handle_bam_mux_cmd_open(rx_hdr);
-		dev_kfree_skb_any(rx_skb);
+		bam_rx_skb_put(rx_skb);
 		break;
 	case BAM_MUX_HDR_CMD_CLOSE:
 		/* probably should drop pending write */
@@ -619,7 +760,7 @@ static void handle_bam_mux_cmd(struct work_struct *work)
 			platform_device_alloc(bam_ch[rx_hdr->ch_id].name, 2);
 		if (!bam_ch[rx_hdr->ch_id].pdev)
 			pr_err(MODULE_NAME "%s: platform_device_alloc failed\n", __func__);
-		dev_kfree_skb_any(rx_skb);
+		bam_rx_skb_put(rx_skb);
 		break;
 	default:
 		DMUX_LOG_KERR("%s: dropping invalid hdr. magic %x"
@@ -627,7 +768,7 @@ static void handle_bam_mux_cmd(struct work_struct *work)
 			__func__, rx_hdr->magic_num, rx_hdr->reserved,
 			rx_hdr->cmd, rx_hdr->pad_len, rx_hdr->ch_id,
 			rx_hdr->pkt_len);
-		dev_kfree_skb_any(rx_skb);
+		bam_rx_skb_put(rx_skb);
 		queue_rx();
 		return;
 	}
@@ -660,6 +801,7 @@ static int bam_mux_write_cmd(void *data, uint32_t len)
 	pkt->len = len;
 	pkt->dma_address = dma_address;
 	pkt->is_cmd = 1;
+	pkt->is_aggr = 0;
 	set_tx_timestamp(pkt);
 	INIT_WORK(&pkt->work, bam_mux_write_done);
 	spin_lock_irqsave(&bam_tx_pool_spinlock, flags);
@@ -685,13 +827,151 @@ static int bam_mux_write_cmd(void *data, uint32_t len)
 	return rc;
 }
 
+static void bam_mux_write_done_skb(struct sk_buff *skb)
+{
+	struct bam_mux_hdr *hdr;
+	unsigned long event_data;
+	unsigned long flags;
+
+	hdr = (struct bam_mux_hdr *)skb->data;
+	DBG_INC_WRITE_CNT(skb->len);
+	event_data = (unsigned long)(skb);
+	spin_lock_irqsave(&bam_ch[hdr->ch_id].lock, flags);
+	bam_ch[hdr->ch_id].num_tx_pkts--;
+	spin_unlock_irqrestore(&bam_ch[hdr->ch_id].lock, flags);
+	if (bam_ch[hdr->ch_id].notify)
+		bam_ch[hdr->ch_id].notify(
+			bam_ch[hdr->ch_id].priv, BAM_DMUX_WRITE_DONE,
+							event_data);
+	else
+		dev_kfree_skb_any(skb);
+}
+
+static void bam_mux_ul_aggr_free(struct tx_pkt_info *pkt)
+{
+	struct sk_buff *skb;
+
+	while ((skb = __skb_dequeue(&pkt->aggr_q)) != NULL)
+		bam_mux_write_done_skb(skb);
+	kfree(pkt->aggr_buf);
+	kfree(pkt);
+}
+
+/* drop the frames of an aggregate without completing them, for SSR */
+static void bam_mux_ul_aggr_purge(struct tx_pkt_info *pkt)
+{
+	struct sk_buff *skb;
+
+	while ((skb = __skb_dequeue(&pkt->aggr_q)) != NULL)
+		dev_kfree_skb_any(skb);
+	kfree(pkt->aggr_buf);
+}
+
+static void bam_mux_ul_aggr_drop(struct work_struct *work)
+{
+	bam_mux_ul_aggr_free(container_of(work, struct tx_pkt_info, work));
+}
+
+/*
+ * Queue the pending uplink aggregate to the tx pipe.  Called with
+ * bam_tx_pool_spinlock held.  An aggregate only exists while the pipe
+ * has descriptors in flight, so the UL is awake and the next
+ * completion is guaranteed to come around and submit it.
+ */
+static void bam_mux_ul_aggr_submit(void)
+{
+	struct tx_pkt_info *pkt = ul_aggr_pkt;
+	int rc;
+
+	if (!pkt)
+		return;
+	ul_aggr_pkt = NULL;
+
+	pkt->dma_address = dma_map_single(NULL, pkt->aggr_buf, pkt->len,
+					DMA_TO_DEVICE);
+	if (!pkt->dma_address) {
+		pr_err(MODULE_NAME "%s: dma_map_single() failed\n", __func__);
+		goto fail;
+	}
+	set_tx_timestamp(pkt);
+	list_add_tail(&pkt->list_node, &bam_tx_pool);
+	rc = sps_transfer_one(bam_tx_pipe, pkt->dma_address, pkt->len,
+				pkt, SPS_IOVEC_FLAG_INT | SPS_IOVEC_FLAG_EOT);
+	if (rc) {
+		DMUX_LOG_KERR("%s sps_transfer_one failed rc=%d\n",
+			__func__, rc);
+		list_del(&pkt->list_node);
+		DBG_INC_TX_SPS_FAILURE_CNT();
+		dma_unmap_single(NULL, pkt->dma_address, pkt->len,
+					DMA_TO_DEVICE);
+		goto fail;
+	}
+	ul_packet_written = 1;
+	return;
+
+fail:
+	/* complete the frames outside of the tx pool lock */
+	INIT_WORK(&pkt->work, bam_mux_ul_aggr_drop);
+	queue_work(bam_mux_tx_workqueue, &pkt->work);
+}
+
+/*
+ * Copy a framed skb into the pending uplink aggregate.  Called with
+ * bam_tx_pool_spinlock held.  Returns 0 if the caller has to send the
+ * skb in a descriptor of its own, which keeps an idle pipe at the
+ * latency of a single frame.
+ */
+static int bam_mux_ul_aggregate(struct sk_buff *skb)
+{
+	struct tx_pkt_info *pkt = ul_aggr_pkt;
+	int size = ACCESS_ONCE(ul_aggr_size);
+
+	if (size > UL_AGGR_MAX_SIZE)
+		size = UL_AGGR_MAX_SIZE;
+	if (size <= 0 || skb->len > size) {
+		/* keep the frame ordered after anything already copied */
+		bam_mux_ul_aggr_submit();
+		return 0;
+	}
+
+	if (pkt && pkt->len + skb->len > ul_aggr_cap) {
+		bam_mux_ul_aggr_submit();
+		pkt = NULL;
+	}
+
+	if (!pkt) {
+		if (list_empty(&bam_tx_pool))
+			return 0;
+		pkt = kmalloc(sizeof(struct tx_pkt_info), GFP_ATOMIC);
+		if (!pkt)
+			return 0;
+		pkt->aggr_buf = kmalloc(size, GFP_ATOMIC);
+		if (!pkt->aggr_buf) {
+			kfree(pkt);
+			return 0;
+		}
+		pkt->skb = NULL;
+		pkt->len = 0;
+		pkt->is_cmd = 0;
+		pkt->is_aggr = 1;
+		skb_queue_head_init(&pkt->aggr_q);
+		INIT_WORK(&pkt->work, bam_mux_write_done);
+		ul_aggr_pkt = pkt;
+		ul_aggr_cap = size;
+	}
+
+	memcpy(pkt->aggr_buf + pkt->len, skb->data, skb->len);
+	pkt->len += skb->len;
+	__skb_queue_tail(&pkt->aggr_q, skb);
+	DBG_INC_UL_AGGR_CNT();
+	return 1;
+}
+
 static void bam_mux_write_done(struct work_struct *work)
 {
 	struct sk_buff *skb;
-	struct bam_mux_hdr *hdr;
 	struct tx_pkt_info *info;
 	struct tx_pkt_info *info_expected;
-	unsigned long event_data;
 	unsigned long flags;
 
 	DBG("%s: entry\n", __func__);
@@ -724,6 +1004,8 @@ static void bam_mux_write_done(struct work_struct *work)
 		BUG();
 	}
 	list_del(&info->list_node);
+	/* frames gathered while this one was in flight */
+	bam_mux_ul_aggr_submit();
 	spin_unlock_irqrestore(&bam_tx_pool_spinlock, flags);
 
 	if (info->is_cmd) {
@@ -731,20 +1013,13 @@ static void bam_mux_write_done(struct work_struct *work)
 		kfree(info);
 		return;
 	}
+	if (info->is_aggr) {
+		bam_mux_ul_aggr_free(info);
+		return;
+	}
 	skb = info->skb;
 	kfree(info);
-	hdr = (struct bam_mux_hdr *)skb->data;
-	DBG_INC_WRITE_CNT(skb->len);
-	event_data = (unsigned long)(skb);
-	spin_lock_irqsave(&bam_ch[hdr->ch_id].lock, flags);
-	bam_ch[hdr->ch_id].num_tx_pkts--;
-	spin_unlock_irqrestore(&bam_ch[hdr->ch_id].lock, flags);
-	if (bam_ch[hdr->ch_id].notify)
-		bam_ch[hdr->ch_id].notify(
-			bam_ch[hdr->ch_id].priv, BAM_DMUX_WRITE_DONE,
-							event_data);
-	else
-		dev_kfree_skb_any(skb);
+	bam_mux_write_done_skb(skb);
 	DBG("%s: exit\n", __func__);
 }
 
@@ -823,6 +1098,24 @@ int msm_bam_dmux_write(uint32_t id, struct sk_buff *skb)
 	    __func__, skb->data, skb->tail, skb->len,
 	    hdr->pkt_len, hdr->pad_len);
 
+	/* count the frame before its completion can run */
+	spin_lock_irqsave(&bam_ch[id].lock, flags);
+	bam_ch[id].num_tx_pkts++;
+	spin_unlock_irqrestore(&bam_ch[id].lock, flags);
+
+	if (bam_dmux_loopback) {
+		skb_queue_tail(&bam_loopback_q, skb);
+		queue_work(bam_mux_rx_workqueue, &loopback_work);
+		goto write_queued;
+	}
+
+	spin_lock_irqsave(&bam_tx_pool_spinlock, flags);
+	if (bam_mux_ul_aggregate(skb)) {
+		spin_unlock_irqrestore(&bam_tx_pool_spinlock, flags);
+		goto write_queued;
+	}
+	spin_unlock_irqrestore(&bam_tx_pool_spinlock, flags);
+
 	pkt = kmalloc(sizeof(struct tx_pkt_info), GFP_ATOMIC);
 	if (pkt == NULL) {
 		pr_err(MODULE_NAME "%s: mem alloc for tx_pkt_info failed\n", __func__);
@@ -838,6 +1131,7 @@ int msm_bam_dmux_write(uint32_t id, struct sk_buff *skb)
 	pkt->skb = skb;
 	pkt->dma_address = dma_address;
 	pkt->is_cmd = 0;
+	pkt->is_aggr = 0;
 	set_tx_timestamp(pkt);
 	INIT_WORK(&pkt->work, bam_mux_write_done);
 	spin_lock_irqsave(&bam_tx_pool_spinlock, flags);
@@ -856,20 +1150,28 @@ int msm_bam_dmux_write(uint32_t id, struct sk_buff *skb)
 		kfree(pkt);
 		if (new_skb)
 			dev_kfree_skb_any(new_skb);
+		spin_lock_irqsave(&bam_ch[id].lock, flags);
+		bam_ch[id].num_tx_pkts--;
+		spin_unlock_irqrestore(&bam_ch[id].lock, flags);
 	} else {
 		DBG("%s: sps_transfer_one successful\n", __func__);
 		spin_unlock_irqrestore(&bam_tx_pool_spinlock, flags);
-		spin_lock_irqsave(&bam_ch[id].lock, flags);
-		bam_ch[id].num_tx_pkts++;
-		spin_unlock_irqrestore(&bam_ch[id].lock, flags);
 	}
 	ul_packet_written = 1;
 	read_unlock(&ul_wakeup_lock);
 	return rc;
 
+write_queued:
+	ul_packet_written = 1;
+	read_unlock(&ul_wakeup_lock);
+	return 0;
+
 write_fail3:
 	kfree(pkt);
 write_fail2:
+	spin_lock_irqsave(&bam_ch[id].lock, flags);
+	bam_ch[id].num_tx_pkts--;
+	spin_unlock_irqrestore(&bam_ch[id].lock, flags);
 	if (new_skb)
 		dev_kfree_skb_any(new_skb);
 write_fail:
@@ -1107,6 +1409,7 @@ static void rx_switch_to_interrupt_mode(void)
 			DMUX_LOG_KERR("%s: iovec %p != dma %p\n",
 				__func__,
 				(void *)info->dma_address, (void *)iov.addr);
+		info->len = iov.size;
 		handle_bam_mux_cmd(&info->work);
 	}
 	DBG("%s: exit\n", __func__);
@@ -1151,6 +1454,7 @@ static void rx_timer_work_func(struct work_struct *work)
 			--bam_rx_pool_len;
 			list_del(&info->list_node);
 			mutex_unlock(&bam_rx_pool_mutexlock);
+			info->len = iov.size;
 			handle_bam_mux_cmd(&info->work);
 		}
 
@@ -1164,6 +1468,44 @@ static void rx_timer_work_func(struct work_struct *work)
 	DBG("%s: exit\n", __func__);
 }
 
+/*
+ * Software loopback: uplink frames are completed right away and handed
+ * to the downlink parser, packed into receive sized buffers the way the
+ * A2 aggregates them.
+ */
+static void loopback_work_func(struct work_struct *work)
+{
+	struct sk_buff_head done;
+	struct sk_buff *skb;
+	struct sk_buff *rx_skb;
+	uint32_t len;
+
+	__skb_queue_head_init(&done);
+	while ((skb = skb_dequeue(&bam_loopback_q)) != NULL) {
+		rx_skb = __dev_alloc_skb(max_t(uint32_t, skb->len,
+						BUFFER_SIZE), GFP_KERNEL);
+		if (!rx_skb) {
+			bam_mux_write_done_skb(skb);
+			continue;
+		}
+
+		len = 0;
+		do {
+			if (len && len + skb->len > BUFFER_SIZE) {
+				skb_queue_head(&bam_loopback_q, skb);
+				break;
+			}
+			memcpy(skb_put(rx_skb, skb->len), skb->data, skb->len);
+			len += skb->len;
+			__skb_queue_tail(&done, skb);
+		} while ((skb = skb_dequeue(&bam_loopback_q)) != NULL);
+
+		while ((skb = __skb_dequeue(&done)) != NULL)
+			bam_mux_write_done_skb(skb);
+		bam_mux_process_data(rx_skb, len);
+	}
+}
+
 static void bam_mux_tx_notify(struct sps_event_notify *notify)
 {
 	struct tx_pkt_info *pkt;
@@ -1177,7 +1519,7 @@ static void bam_mux_tx_notify(struct sps_event_notify *notify)
 	case SPS_EVENT_EOT:
 		pkt = notify->data.transfer.user;
 		ipc_log_string(log_context, "<DMUX2> %s info: %p skb: %p node: %p\n", __func__, pkt, pkt->skb, &pkt->list_node);
-		if (!pkt->is_cmd)
+		if (!pkt->is_cmd && !pkt->is_aggr)
 			dma_unmap_single(NULL, pkt->dma_address,
 						pkt->skb->len,
 						DMA_TO_DEVICE);
@@ -1276,6 +1618,8 @@ static int debug_stats(char *buf, int max)
 			"skb copy bytes:  %u\n"
 			"sps tx failures: %u\n"
 			"sps tx stalls:   %u\n"
+			"rx aggr frames:  %u\n"
+			"ul aggr frames:  %u\n"
 			"rx queue len:    %d\n"
 			"a2 ack out cnt:  %d\n"
 			"a2 ack in cnt:   %d\n"
@@ -1286,6 +1630,8 @@ static int debug_stats(char *buf, int max)
 			bam_dmux_write_cpy_bytes,
 			bam_dmux_tx_sps_failure_cnt,
 			bam_dmux_tx_stall_cnt,
+			bam_dmux_rx_aggr_cnt,
+			bam_dmux_ul_aggr_cnt,
 			bam_rx_pool_len,
 			atomic_read(&bam_dmux_ack_out_cnt),
 			atomic_read(&bam_dmux_ack_in_cnt),
@@ -1963,7 +2309,12 @@ static int restart_notifier_cb(struct notifier_block *this,
 		list_del(node);
 		info = container_of(node, struct tx_pkt_info,
 							list_node);
-		if (!info->is_cmd) {
+		if (info->is_aggr) {
+			dma_unmap_single(NULL, info->dma_address,
+						info->len,
+						DMA_TO_DEVICE);
+			bam_mux_ul_aggr_purge(info);
+		} else if (!info->is_cmd) {
 			dma_unmap_single(NULL, info->dma_address,
 						info->skb->len,
 						DMA_TO_DEVICE);
@@ -1976,6 +2327,11 @@ static int restart_notifier_cb(struct notifier_block *this,
 		}
 		kfree(info);
 	}
+	if (ul_aggr_pkt) {
+		bam_mux_ul_aggr_purge(ul_aggr_pkt);
+		kfree(ul_aggr_pkt);
+		ul_aggr_pkt = NULL;
+	}
 	spin_unlock_irqrestore(&bam_tx_pool_spinlock, flags);
 
 	bam_dmux_log("%s: complete\n", __func__);
@@ -2398,6 +2754,9 @@ static int __init bam_dmux_init(void)
 		debug_create_multiple("log", 0444, dent, debug_log);
 	}
 #endif
+	skb_queue_head_init(&bam_rx_skb_pool);
+	skb_queue_head_init(&bam_loopback_q);
+
 	ret = kfifo_alloc(&bam_dmux_state_log, PAGE_SIZE, GFP_KERNEL);
 	if (ret) {
 		pr_err("%s: failed to allocate log %d\n", __func__, ret);
@@ -27,6 +27,7 @@
 #include <linux/platform_device.h>
 #include <linux/uaccess.h>
 #include <linux/debugfs.h>
+#include <linux/rculist.h>
 
 #include <asm/uaccess.h>
 #include <asm/byteorder.h>
@@ -92,6 +93,11 @@ if (msm_ipc_router_debug_mask & R2R_RAW_HDR) \
 static LIST_HEAD(control_ports);
 static DEFINE_MUTEX(control_ports_lock);
 
+/*
+ * The local port, server and routing tables are looked up under RCU on
+ * the data path.  The mutexes below only serialize updates, which use
+ * the _rcu list primitives and free entries after a grace period.
+ */
 #define LP_HASH_SIZE 32
 static struct list_head local_ports[LP_HASH_SIZE];
 static DEFINE_MUTEX(local_ports_lock);
@@ -105,12 +111,14 @@ struct msm_ipc_server {
 	struct list_head list;
 	struct msm_ipc_port_name name;
 	struct list_head server_port_list;
+	struct rcu_head rcu;
 };
 
 struct msm_ipc_server_port {
 	struct list_head list;
 	struct msm_ipc_port_addr server_addr;
 	struct msm_ipc_router_xprt_info *xprt_info;
+	struct rcu_head rcu;
 };
 
 #define RP_HASH_SIZE 32
@@ -122,6 +130,7 @@ struct msm_ipc_router_remote_port {
 	wait_queue_head_t quota_wait;
 	uint32_t tx_quota_cnt;
 	struct mutex quota_lock;
+	struct rcu_head rcu;
 };
 
 struct msm_ipc_router_xprt_info {
@@ -140,6 +149,7 @@ struct msm_ipc_router_xprt_info {
 	struct workqueue_struct *workqueue;
 };
 
+/* Routing table entries are never freed once added. */
 #define RT_HASH_SIZE 4
 struct msm_ipc_routing_table_entry {
 	struct list_head list;
@@ -236,18 +246,18 @@ static int add_routing_table_entry(
 		return -EINVAL;
 
 	key = (rt_entry->node_id % RT_HASH_SIZE);
-	list_add_tail(&rt_entry->list, &routing_table[key]);
+	list_add_tail_rcu(&rt_entry->list, &routing_table[key]);
 	return 0;
 }
 
-/*Please take routing_table_lock before calling this function*/
+/*Please take routing_table_lock or rcu_read_lock before calling this*/
 static struct msm_ipc_routing_table_entry *lookup_routing_table(
 	uint32_t node_id)
 {
 	uint32_t key = (node_id % RT_HASH_SIZE);
 	struct msm_ipc_routing_table_entry *rt_entry;
 
-	list_for_each_entry(rt_entry, &routing_table[key], list) {
+	list_for_each_entry_rcu(rt_entry, &routing_table[key], list) {
 		if (rt_entry->node_id == node_id)
 			return rt_entry;
 	}
@@ -372,12 +382,14 @@ static int post_control_ports(struct rr_packet *pkt)
 
 	mutex_lock(&control_ports_lock);
 	list_for_each_entry(port_ptr, &control_ports, list) {
-		mutex_lock(&port_ptr->port_rx_q_lock);
 		cloned_pkt = clone_pkt(pkt);
+		if (!cloned_pkt)
+			continue;
+		spin_lock(&port_ptr->port_rx_q_lock);
 		wake_lock(&port_ptr->port_rx_wake_lock);
 		list_add_tail(&cloned_pkt->list, &port_ptr->port_rx_q);
 		wake_up(&port_ptr->port_rx_wait_q);
-		mutex_unlock(&port_ptr->port_rx_q_lock);
+		spin_unlock(&port_ptr->port_rx_q_lock);
 	}
 	mutex_unlock(&control_ports_lock);
 	return 0;
@@ -428,7 +440,7 @@ void msm_ipc_router_add_local_port(struct msm_ipc_port *port_ptr)
 
 	key = (port_ptr->this_port.port_id & (LP_HASH_SIZE - 1));
 	mutex_lock(&local_ports_lock);
-	list_add_tail(&port_ptr->list, &local_ports[key]);
+	list_add_tail_rcu(&port_ptr->list, &local_ports[key]);
 	mutex_unlock(&local_ports_lock);
 }
 
@@ -455,7 +467,7 @@ struct msm_ipc_port *msm_ipc_router_create_raw_port(void *endpoint,
 	INIT_LIST_HEAD(&port_ptr->incomplete);
 	mutex_init(&port_ptr->incomplete_lock);
 	INIT_LIST_HEAD(&port_ptr->port_rx_q);
-	mutex_init(&port_ptr->port_rx_q_lock);
+	spin_lock_init(&port_ptr->port_rx_q_lock);
 	init_waitqueue_head(&port_ptr->port_rx_wait_q);
 	wake_lock_init(&port_ptr->port_rx_wake_lock,
 			WAKE_LOCK_SUSPEND, "msm_ipc_read");
@@ -468,19 +480,20 @@ struct msm_ipc_port *msm_ipc_router_create_raw_port(void *endpoint,
 	return port_ptr;
 }
 
+/*
+ * Call with rcu_read_lock() held; the port may not be used after
+ * rcu_read_unlock() as msm_ipc_router_close_port() frees it once all
+ * readers are done.
+ */
 static struct msm_ipc_port *msm_ipc_router_lookup_local_port(uint32_t port_id)
 {
 	int key = (port_id & (LP_HASH_SIZE - 1));
 	struct msm_ipc_port *port_ptr;
 
-	mutex_lock(&local_ports_lock);
-	list_for_each_entry(port_ptr, &local_ports[key], list) {
-		if (port_ptr->this_port.port_id == port_id) {
-			mutex_unlock(&local_ports_lock);
+	list_for_each_entry_rcu(port_ptr, &local_ports[key], list) {
+		if (port_ptr->this_port.port_id == port_id)
 			return port_ptr;
-		}
 	}
-	mutex_unlock(&local_ports_lock);
 	return NULL;
 }
 
@@ -492,27 +505,24 @@ static struct msm_ipc_router_remote_port *msm_ipc_router_lookup_remote_port(
 	struct msm_ipc_routing_table_entry *rt_entry;
 	int key = (port_id & (RP_HASH_SIZE - 1));
 
-	mutex_lock(&routing_table_lock);
+	rcu_read_lock();
 	rt_entry = lookup_routing_table(node_id);
 	if (!rt_entry) {
-		mutex_unlock(&routing_table_lock);
+		rcu_read_unlock();
 		pr_err("%s: Node is not up\n", __func__);
 		return NULL;
 	}
 
-	mutex_lock(&rt_entry->lock);
-	list_for_each_entry(rport_ptr,
-			    &rt_entry->remote_port_list[key], list) {
+	list_for_each_entry_rcu(rport_ptr,
+				&rt_entry->remote_port_list[key], list) {
 		if (rport_ptr->port_id == port_id) {
 			if (rport_ptr->restart_state != RESTART_NORMAL)
 				rport_ptr = NULL;
-			mutex_unlock(&rt_entry->lock);
-			mutex_unlock(&routing_table_lock);
+			rcu_read_unlock();
 			return rport_ptr;
 		}
 	}
-	mutex_unlock(&rt_entry->lock);
-	mutex_unlock(&routing_table_lock);
+	rcu_read_unlock();
 	return NULL;
 }
 
@@ -524,10 +534,10 @@ static struct msm_ipc_router_remote_port *msm_ipc_router_create_remote_port(
 	struct msm_ipc_routing_table_entry *rt_entry;
 	int key = (port_id & (RP_HASH_SIZE - 1));
 
-	mutex_lock(&routing_table_lock);
+	rcu_read_lock();
 	rt_entry = lookup_routing_table(node_id);
+	rcu_read_unlock();
 	if (!rt_entry) {
-		mutex_unlock(&routing_table_lock);
 		pr_err("%s: Node is not up\n", __func__);
 		return NULL;
 	}
@@ -537,7 +547,6 @@ static struct msm_ipc_router_remote_port *msm_ipc_router_create_remote_port(
 			    GFP_KERNEL);
 	if (!rport_ptr) {
 		mutex_unlock(&rt_entry->lock);
-		mutex_unlock(&routing_table_lock);
 		pr_err("%s: Remote port alloc failed\n", __func__);
 		return NULL;
 	}
@@ -547,10 +556,9 @@ static struct msm_ipc_router_remote_port *msm_ipc_router_create_remote_port(
 	rport_ptr->tx_quota_cnt = 0;
 	init_waitqueue_head(&rport_ptr->quota_wait);
 	mutex_init(&rport_ptr->quota_lock);
-	list_add_tail(&rport_ptr->list,
-		      &rt_entry->remote_port_list[key]);
+	list_add_tail_rcu(&rport_ptr->list,
+			  &rt_entry->remote_port_list[key]);
 	mutex_unlock(&rt_entry->lock);
-	mutex_unlock(&routing_table_lock);
 	return rport_ptr;
 }
 
@@ -564,19 +572,18 @@ static void msm_ipc_router_destroy_remote_port(
 		return;
 
 	node_id = rport_ptr->node_id;
-	mutex_lock(&routing_table_lock);
+	rcu_read_lock();
 	rt_entry = lookup_routing_table(node_id);
+	rcu_read_unlock();
 	if (!rt_entry) {
-		mutex_unlock(&routing_table_lock);
 		pr_err("%s: Node %d is not up\n", __func__, node_id);
 		return;
 	}
 
 	mutex_lock(&rt_entry->lock);
-	list_del(&rport_ptr->list);
-	kfree(rport_ptr);
+	list_del_rcu(&rport_ptr->list);
+	kfree_rcu(rport_ptr, rcu);
 	mutex_unlock(&rt_entry->lock);
-	mutex_unlock(&routing_table_lock);
 	return;
 }
 
@@ -590,25 +597,25 @@ static struct msm_ipc_server *msm_ipc_router_lookup_server(
 	struct msm_ipc_server_port *server_port;
 	int key = (instance & (SRV_HASH_SIZE - 1));
 
-	mutex_lock(&server_list_lock);
-	list_for_each_entry(server, &server_list[key], list) {
+	rcu_read_lock();
+	list_for_each_entry_rcu(server, &server_list[key], list) {
 		if ((server->name.service != service) ||
 		    (server->name.instance != instance))
 			continue;
 		if ((node_id == 0) && (port_id == 0)) {
-			mutex_unlock(&server_list_lock);
+			rcu_read_unlock();
 			return server;
 		}
-		list_for_each_entry(server_port, &server->server_port_list,
-				    list) {
+		list_for_each_entry_rcu(server_port,
+					&server->server_port_list, list) {
 			if ((server_port->server_addr.node_id == node_id) &&
 			    (server_port->server_addr.port_id == port_id)) {
-				mutex_unlock(&server_list_lock);
+				rcu_read_unlock();
 				return server;
 			}
 		}
 	}
-	mutex_unlock(&server_list_lock);
+	rcu_read_unlock();
 	return NULL;
 }
 
@@ -639,14 +646,14 @@ static struct msm_ipc_server *msm_ipc_router_create_server(
 	server->name.service = service;
 	server->name.instance = instance;
 	INIT_LIST_HEAD(&server->server_port_list);
-	list_add_tail(&server->list, &server_list[key]);
+	list_add_tail_rcu(&server->list, &server_list[key]);
 
 create_srv_port:
 	server_port = kmalloc(sizeof(struct msm_ipc_server_port), GFP_KERNEL);
 	if (!server_port) {
 		if (list_empty(&server->server_port_list)) {
-			list_del(&server->list);
-			kfree(server);
+			list_del_rcu(&server->list);
+			kfree_rcu(server, rcu);
 		}
 		mutex_unlock(&server_list_lock);
 		pr_err("%s: Server Port allocation failed\n", __func__);
@@ -655,36 +662,46 @@ create_srv_port:
 	server_port->server_addr.node_id = node_id;
 	server_port->server_addr.port_id = port_id;
 	server_port->xprt_info = xprt_info;
-	list_add_tail(&server_port->list, &server->server_port_list);
+	list_add_tail_rcu(&server_port->list, &server->server_port_list);
 	mutex_unlock(&server_list_lock);
 
 	return server;
 }
 
-static void msm_ipc_router_destroy_server(struct msm_ipc_server *server,
-					  uint32_t node_id, uint32_t port_id)
+/*
+ * Looks the server port up again under server_list_lock, so concurrent
+ * removals of the same server cannot free it twice.  Returns -ENODEV if
+ * there was nothing to remove.
+ */
+static int msm_ipc_router_destroy_server(uint32_t service, uint32_t instance,
+					 uint32_t node_id, uint32_t port_id)
 {
+	struct msm_ipc_server *server;
 	struct msm_ipc_server_port *server_port;
-
-	if (!server)
-		return;
+	int key = (instance & (SRV_HASH_SIZE - 1));
 
 	mutex_lock(&server_list_lock);
-	list_for_each_entry(server_port, &server->server_port_list, list) {
-		if ((server_port->server_addr.node_id == node_id) &&
-		    (server_port->server_addr.port_id == port_id))
-			break;
-	}
-	if (server_port) {
-		list_del(&server_port->list);
-		kfree(server_port);
-	}
-	if (list_empty(&server->server_port_list)) {
-		list_del(&server->list);
-		kfree(server);
+	list_for_each_entry(server, &server_list[key], list) {
+		if ((server->name.service != service) ||
+		    (server->name.instance != instance))
+			continue;
+		list_for_each_entry(server_port, &server->server_port_list,
+				    list) {
+			if ((server_port->server_addr.node_id != node_id) ||
+			    (server_port->server_addr.port_id != port_id))
+				continue;
+			list_del_rcu(&server_port->list);
+			kfree_rcu(server_port, rcu);
+			if (list_empty(&server->server_port_list)) {
+				list_del_rcu(&server->list);
+				kfree_rcu(server, rcu);
+			}
+			mutex_unlock(&server_list_lock);
+			return 0;
+		}
 	}
 	mutex_unlock(&server_list_lock);
-	return;
+	return -ENODEV;
 }
 
 static int msm_ipc_router_send_control_msg(
@@ -958,21 +975,25 @@ static int forward_msg(struct msm_ipc_router_xprt_info *xprt_info,
 
 	hdr = (struct rr_header *)head_pkt->data;
 	dst_node_id = hdr->dst_node_id;
-	mutex_lock(&routing_table_lock);
+	rcu_read_lock();
 	rt_entry = lookup_routing_table(dst_node_id);
-	if (!(rt_entry) || !(rt_entry->xprt_info)) {
-		mutex_unlock(&routing_table_lock);
+	rcu_read_unlock();
+	if (!rt_entry) {
 		pr_err("%s: Routing table not initialized\n", __func__);
 		return -ENODEV;
 	}
 
 	mutex_lock(&rt_entry->lock);
 	fwd_xprt_info = rt_entry->xprt_info;
+	if (!fwd_xprt_info) {
+		mutex_unlock(&rt_entry->lock);
+		pr_err("%s: Routing table not initialized\n", __func__);
+		return -ENODEV;
+	}
 	mutex_lock(&fwd_xprt_info->tx_lock);
 	if (xprt_info->remote_node_id == fwd_xprt_info->remote_node_id) {
 		mutex_unlock(&fwd_xprt_info->tx_lock);
 		mutex_unlock(&rt_entry->lock);
-		mutex_unlock(&routing_table_lock);
 		pr_err("%s: Discarding Command to route back\n", __func__);
 		return -EINVAL;
 	}
@@ -980,14 +1001,12 @@ static int forward_msg(struct msm_ipc_router_xprt_info *xprt_info,
 	if (xprt_info->xprt->link_id == fwd_xprt_info->xprt->link_id) {
 		mutex_unlock(&fwd_xprt_info->tx_lock);
 		mutex_unlock(&rt_entry->lock);
-		mutex_unlock(&routing_table_lock);
 		pr_err("%s: DST in the same cluster\n", __func__);
 		return 0;
 	}
 	fwd_xprt_info->xprt->write(pkt, pkt->length, 0);
 	mutex_unlock(&fwd_xprt_info->tx_lock);
 	mutex_unlock(&rt_entry->lock);
-	mutex_unlock(&routing_table_lock);
 
 	return 0;
 }
@@ -1043,12 +1062,12 @@ static void msm_ipc_cleanup_remote_server_info(
 				ctl.srv.port_id = svr_port->server_addr.port_id;
 				relay_ctl_msg(xprt_info, &ctl);
 				broadcast_ctl_msg_locally(&ctl);
-				list_del(&svr_port->list);
-				kfree(svr_port);
+				list_del_rcu(&svr_port->list);
+				kfree_rcu(svr_port, rcu);
 			}
 			if (list_empty(&svr->server_port_list)) {
-				list_del(&svr->list);
-				kfree(svr);
+				list_del_rcu(&svr->list);
+				kfree_rcu(svr, rcu);
 			}
 		}
 	}
@@ -1117,8 +1136,8 @@ static void msm_ipc_cleanup_remote_port_info(uint32_t node_id)
 				list_for_each_entry_safe(rport_ptr,
 					tmp_rport_ptr,
 					&rt_entry->remote_port_list[j], list) {
-					list_del(&rport_ptr->list);
-					kfree(rport_ptr);
+					list_del_rcu(&rport_ptr->list);
+					kfree_rcu(rport_ptr, rcu);
 				}
 			}
 			mutex_unlock(&rt_entry->lock);
@@ -1309,14 +1328,10 @@ static int process_control_msg(struct msm_ipc_router_xprt_info *xprt_info,
 	case IPC_ROUTER_CTRL_CMD_REMOVE_SERVER:
 		RR("o REMOVE_SERVER service=%08x:%d\n",
 		   msg->srv.service, msg->srv.instance);
-		server = msm_ipc_router_lookup_server(msg->srv.service,
-						      msg->srv.instance,
-						      msg->srv.node_id,
-						      msg->srv.port_id);
-		if (server) {
-			msm_ipc_router_destroy_server(server,
-						      msg->srv.node_id,
-						      msg->srv.port_id);
+		if (!msm_ipc_router_destroy_server(msg->srv.service,
+						   msg->srv.instance,
+						   msg->srv.node_id,
+						   msg->srv.port_id)) {
 			relay_msg(xprt_info, pkt);
 			post_control_ports(pkt);
 		}
@@ -1353,6 +1368,8 @@ static void do_read_data(struct work_struct *work)
 	struct msm_ipc_port_addr *src_addr;
 	struct msm_ipc_router_remote_port *rport_ptr;
 	uint32_t resume_tx, resume_tx_node_id, resume_tx_port_id;
+	void (*notify)(unsigned event, void *data, void *addr, void *priv);
+	void *priv;
 
 	struct msm_ipc_router_xprt_info *xprt_info =
 		container_of(work,
@@ -1427,14 +1444,6 @@ static void do_read_data(struct work_struct *work)
 	resume_tx_node_id = hdr->dst_node_id;
 	resume_tx_port_id = hdr->dst_port_id;
 
-	port_ptr = msm_ipc_router_lookup_local_port(hdr->dst_port_id);
-	if (!port_ptr) {
-		pr_err("%s: No local port id %08x\n", __func__,
-			hdr->dst_port_id);
-		release_pkt(pkt);
-		goto process_done;
-	}
-
 	rport_ptr = msm_ipc_router_lookup_remote_port(hdr->src_node_id,
 						      hdr->src_port_id);
 	if (!rport_ptr) {
@@ -1444,17 +1453,33 @@ static void do_read_data(struct work_struct *work)
 		if (!rport_ptr) {
 			pr_err("%s: Remote port %08x:%08x creation failed\n",
 				__func__, hdr->src_node_id, hdr->src_port_id);
+			release_pkt(pkt);
 			goto process_done;
 		}
 	}
 
+	rcu_read_lock();
+	port_ptr = msm_ipc_router_lookup_local_port(hdr->dst_port_id);
+	if (!port_ptr) {
+		rcu_read_unlock();
+		pr_err("%s: No local port id %08x\n", __func__,
+			hdr->dst_port_id);
+		release_pkt(pkt);
+		goto process_done;
+	}
+
 	if (!port_ptr->notify) {
-		mutex_lock(&port_ptr->port_rx_q_lock);
+		spin_lock(&port_ptr->port_rx_q_lock);
 		wake_lock(&port_ptr->port_rx_wake_lock);
 		list_add_tail(&pkt->list, &port_ptr->port_rx_q);
 		wake_up(&port_ptr->port_rx_wait_q);
-		mutex_unlock(&port_ptr->port_rx_q_lock);
+		spin_unlock(&port_ptr->port_rx_q_lock);
+		rcu_read_unlock();
 	} else {
+		notify = port_ptr->notify;
+		priv = port_ptr->priv;
+		rcu_read_unlock();
+
 		src_addr = kmalloc(sizeof(struct msm_ipc_port_addr),
 				   GFP_KERNEL);
 		if (src_addr) {
@@ -1462,8 +1487,8 @@ static void do_read_data(struct work_struct *work)
 			src_addr->port_id = hdr->src_port_id;
 		}
 		skb_pull(head_skb, IPC_ROUTER_HDR_SIZE);
-		port_ptr->notify(MSM_IPC_ROUTER_READ_CB, pkt->pkt_fragment_q,
-				 src_addr, port_ptr->priv);
+		notify(MSM_IPC_ROUTER_READ_CB, pkt->pkt_fragment_q,
+		       src_addr, priv);
 		pkt->pkt_fragment_q = NULL;
 		src_addr = NULL;
 		release_pkt(pkt);
@@ -1540,7 +1565,6 @@ int msm_ipc_router_register_server(struct msm_ipc_port *port_ptr,
 
 int msm_ipc_router_unregister_server(struct msm_ipc_port *port_ptr)
 {
-	struct msm_ipc_server *server;
 	unsigned long flags;
 	union rr_control_msg ctl;
 
@@ -1559,23 +1583,20 @@ int msm_ipc_router_unregister_server(struct msm_ipc_port *port_ptr)
 		return -EINVAL;
 	}
 
-	server = msm_ipc_router_lookup_server(port_ptr->port_name.service,
-					      port_ptr->port_name.instance,
-					      port_ptr->this_port.node_id,
-					      port_ptr->this_port.port_id);
-	if (!server) {
+	if (msm_ipc_router_destroy_server(port_ptr->port_name.service,
+					  port_ptr->port_name.instance,
+					  port_ptr->this_port.node_id,
+					  port_ptr->this_port.port_id)) {
 		pr_err("%s: Server lookup failed\n", __func__);
 		return -ENODEV;
 	}
 
 	ctl.cmd = IPC_ROUTER_CTRL_CMD_REMOVE_SERVER;
-	ctl.srv.service = server->name.service;
-	ctl.srv.instance = server->name.instance;
+	ctl.srv.service = port_ptr->port_name.service;
+	ctl.srv.instance = port_ptr->port_name.instance;
 	ctl.srv.node_id = IPC_ROUTER_NID_LOCAL;
 	ctl.srv.port_id = port_ptr->this_port.port_id;
 	broadcast_ctl_msg(&ctl);
-	msm_ipc_router_destroy_server(server, port_ptr->this_port.node_id,
-				      port_ptr->this_port.port_id);
 	spin_lock_irqsave(&port_ptr->port_lock, flags);
 	port_ptr->type = CLIENT_PORT;
 	spin_unlock_irqrestore(&port_ptr->port_lock, flags);
@@ -1590,6 +1611,7 @@ static int loopback_data(struct msm_ipc_port *src,
 	struct rr_header *hdr;
 	struct msm_ipc_port *port_ptr;
 	struct rr_packet *pkt;
+	int ret;
 
 	if (!data) {
 		pr_err("%s: Invalid pkt pointer\n", __func__);
@@ -1623,20 +1645,24 @@ static int loopback_data(struct msm_ipc_port *src,
 	hdr->dst_port_id = port_id;
 	pkt->length += IPC_ROUTER_HDR_SIZE;
 
+	ret = pkt->length;
+	rcu_read_lock();
 	port_ptr = msm_ipc_router_lookup_local_port(port_id);
 	if (!port_ptr) {
+		rcu_read_unlock();
 		pr_err("%s: Local port %d not present\n", __func__, port_id);
 		release_pkt(pkt);
 		return -ENODEV;
 	}
 
-	mutex_lock(&port_ptr->port_rx_q_lock);
+	spin_lock(&port_ptr->port_rx_q_lock);
 	wake_lock(&port_ptr->port_rx_wake_lock);
 	list_add_tail(&pkt->list, &port_ptr->port_rx_q);
 	wake_up(&port_ptr->port_rx_wait_q);
-	mutex_unlock(&port_ptr->port_rx_q_lock);
+	spin_unlock(&port_ptr->port_rx_q_lock);
+	rcu_read_unlock();
 
-	return pkt->length;
+	return ret;
 }
 
 static int msm_ipc_router_write_pkt(struct msm_ipc_port *src,
@@ -1702,21 +1728,26 @@ static int msm_ipc_router_write_pkt(struct msm_ipc_port *src,
 		hdr->confirm_rx = 1;
 	mutex_unlock(&rport_ptr->quota_lock);
 
-	mutex_lock(&routing_table_lock);
+	rcu_read_lock();
 	rt_entry = lookup_routing_table(hdr->dst_node_id);
-	if (!rt_entry || !rt_entry->xprt_info) {
-		mutex_unlock(&routing_table_lock);
+	rcu_read_unlock();
+	if (!rt_entry) {
 		pr_err("%s: Remote node %d not up\n",
 			__func__, hdr->dst_node_id);
 		return -ENODEV;
 	}
 	mutex_lock(&rt_entry->lock);
 	xprt_info = rt_entry->xprt_info;
+	if (!xprt_info) {
+		mutex_unlock(&rt_entry->lock);
+		pr_err("%s: Remote node %d not up\n",
+			__func__, hdr->dst_node_id);
+		return -ENODEV;
+	}
 	mutex_lock(&xprt_info->tx_lock);
 	ret = xprt_info->xprt->write(pkt, pkt->length, 0);
 	mutex_unlock(&xprt_info->tx_lock);
 	mutex_unlock(&rt_entry->lock);
-	mutex_unlock(&routing_table_lock);
 
 	if (ret < 0) {
 		pr_err("%s: Write on XPRT failed\n", __func__);
@@ -1759,7 +1790,7 @@ int msm_ipc_router_send_to(struct msm_ipc_port *src,
 	struct msm_ipc_server_port *server_port;
 	struct msm_ipc_router_remote_port *rport_ptr = NULL;
 	struct rr_packet *pkt;
-	int ret;
+	int ret, found = 0;
 
 	if (!src || !data || !dest) {
 		pr_err("%s: Invalid Parameters\n", __func__);
@@ -1771,21 +1802,25 @@ int msm_ipc_router_send_to(struct msm_ipc_port *src,
 		dst_node_id = dest->addr.port_addr.node_id;
 		dst_port_id = dest->addr.port_addr.port_id;
 	} else if (dest->addrtype == MSM_IPC_ADDR_NAME) {
+		rcu_read_lock();
 		server = msm_ipc_router_lookup_server(
 					dest->addr.port_name.service,
 					dest->addr.port_name.instance,
 					0, 0);
-		if (!server) {
+		if (server) {
+			list_for_each_entry_rcu(server_port,
+					&server->server_port_list, list) {
+				dst_node_id = server_port->server_addr.node_id;
+				dst_port_id = server_port->server_addr.port_id;
+				found = 1;
+				break;
+			}
+		}
+		rcu_read_unlock();
+		if (!found) {
 			pr_err("%s: Destination not reachable\n", __func__);
 			return -ENODEV;
 		}
-		mutex_lock(&server_list_lock);
-		server_port = list_first_entry(&server->server_port_list,
-					       struct msm_ipc_server_port,
-					       list);
-		dst_node_id = server_port->server_addr.node_id;
-		dst_port_id = server_port->server_addr.port_id;
-		mutex_unlock(&server_list_lock);
 	}
 	if (dst_node_id == IPC_ROUTER_NID_LOCAL) {
 		ret = loopback_data(src, dst_port_id, data);
@@ -1822,24 +1857,25 @@ int msm_ipc_router_read(struct msm_ipc_port *port_ptr,
 	if (!port_ptr || !data)
 		return -EINVAL;
 
-	mutex_lock(&port_ptr->port_rx_q_lock);
+	spin_lock(&port_ptr->port_rx_q_lock);
 	if (list_empty(&port_ptr->port_rx_q)) {
-		mutex_unlock(&port_ptr->port_rx_q_lock);
+		spin_unlock(&port_ptr->port_rx_q_lock);
 		return -EAGAIN;
 	}
 
 	pkt = list_first_entry(&port_ptr->port_rx_q, struct rr_packet, list);
 	if ((buf_len) && ((pkt->length - IPC_ROUTER_HDR_SIZE) > buf_len)) {
-		mutex_unlock(&port_ptr->port_rx_q_lock);
+		spin_unlock(&port_ptr->port_rx_q_lock);
 		return -ETOOSMALL;
 	}
 	list_del(&pkt->list);
 	if (list_empty(&port_ptr->port_rx_q))
 		wake_unlock(&port_ptr->port_rx_wake_lock);
+	spin_unlock(&port_ptr->port_rx_q_lock);
+
 	*data = pkt->pkt_fragment_q;
 	ret = pkt->length;
 	kfree(pkt);
-	mutex_unlock(&port_ptr->port_rx_q_lock);
 
 	return ret;
 }
@@ -1859,9 +1895,9 @@ int msm_ipc_router_recv_from(struct msm_ipc_port *port_ptr,
 	}
 
 	*data = NULL;
-	mutex_lock(&port_ptr->port_rx_q_lock);
+	spin_lock(&port_ptr->port_rx_q_lock);
 	while (list_empty(&port_ptr->port_rx_q)) {
-		mutex_unlock(&port_ptr->port_rx_q_lock);
+		spin_unlock(&port_ptr->port_rx_q_lock);
 		if (timeout < 0) {
 			ret = wait_event_interruptible(
 					port_ptr->port_rx_wait_q,
@@ -1878,9 +1914,9 @@ int msm_ipc_router_recv_from(struct msm_ipc_port *port_ptr,
 		}
 		if (timeout == 0)
 			return -ETIMEDOUT;
-		mutex_lock(&port_ptr->port_rx_q_lock);
+		spin_lock(&port_ptr->port_rx_q_lock);
 	}
-	mutex_unlock(&port_ptr->port_rx_q_lock);
+	spin_unlock(&port_ptr->port_rx_q_lock);
 
 	ret = msm_ipc_router_read(port_ptr, data, 0);
 	if (ret <= 0 || !(*data))
@@ -1921,7 +1957,7 @@ int msm_ipc_router_close_port(struct msm_ipc_port *port_ptr)
 {
 	union rr_control_msg msg;
 	struct rr_packet *pkt, *temp_pkt;
-	struct msm_ipc_server *server;
+	LIST_HEAD(rx_q);
 
 	if (!port_ptr)
 		return -EINVAL;
@@ -1947,29 +1983,17 @@ int msm_ipc_router_close_port(struct msm_ipc_port *port_ptr)
 		broadcast_ctl_msg_locally(&msg);
 	}
 
-	mutex_lock(&port_ptr->port_rx_q_lock);
-	list_for_each_entry_safe(pkt, temp_pkt, &port_ptr->port_rx_q, list) {
-		list_del(&pkt->list);
-		release_pkt(pkt);
-	}
-	mutex_unlock(&port_ptr->port_rx_q_lock);
-
 	if (port_ptr->type == SERVER_PORT) {
-		server = msm_ipc_router_lookup_server(
-				port_ptr->port_name.service,
-				port_ptr->port_name.instance,
-				port_ptr->this_port.node_id,
-				port_ptr->this_port.port_id);
-		if (server)
-			msm_ipc_router_destroy_server(server,
-				port_ptr->this_port.node_id,
-				port_ptr->this_port.port_id);
+		msm_ipc_router_destroy_server(port_ptr->port_name.service,
+					      port_ptr->port_name.instance,
+					      port_ptr->this_port.node_id,
+					      port_ptr->this_port.port_id);
 		mutex_lock(&local_ports_lock);
-		list_del(&port_ptr->list);
+		list_del_rcu(&port_ptr->list);
 		mutex_unlock(&local_ports_lock);
 	} else if (port_ptr->type == CLIENT_PORT) {
 		mutex_lock(&local_ports_lock);
-		list_del(&port_ptr->list);
+		list_del_rcu(&port_ptr->list);
 		mutex_unlock(&local_ports_lock);
 	} else if (port_ptr->type == CONTROL_PORT) {
 		mutex_lock(&control_ports_lock);
@@ -1977,6 +2001,17 @@ int msm_ipc_router_close_port(struct msm_ipc_port *port_ptr)
 		mutex_unlock(&control_ports_lock);
 	}
 
+	/* Wait for receivers that found the port before it was unhashed */
+	synchronize_rcu();
+
+	spin_lock(&port_ptr->port_rx_q_lock);
+	list_splice_init(&port_ptr->port_rx_q, &rx_q);
+	spin_unlock(&port_ptr->port_rx_q_lock);
+	list_for_each_entry_safe(pkt, temp_pkt, &rx_q, list) {
+		list_del(&pkt->list);
+		release_pkt(pkt);
+	}
+
 	wake_lock_destroy(&port_ptr->port_rx_wake_lock);
 	kfree(port_ptr);
 	return 0;
@@ -1990,13 +2025,13 @@ int msm_ipc_router_get_curr_pkt_size(struct msm_ipc_port *port_ptr)
 	if (!port_ptr)
 		return -EINVAL;
 
-	mutex_lock(&port_ptr->port_rx_q_lock);
+	spin_lock(&port_ptr->port_rx_q_lock);
 	if (!list_empty(&port_ptr->port_rx_q)) {
 		pkt = list_first_entry(&port_ptr->port_rx_q,
 					struct rr_packet, list);
 		rc = pkt->length;
 	}
-	mutex_unlock(&port_ptr->port_rx_q_lock);
+	spin_unlock(&port_ptr->port_rx_q_lock);
 
 	return rc;
 }
@@ -2007,8 +2042,9 @@ int msm_ipc_router_bind_control_port(struct msm_ipc_port *port_ptr)
 		return -EINVAL;
 
 	mutex_lock(&local_ports_lock);
-	list_del(&port_ptr->list);
+	list_del_rcu(&port_ptr->list);
 	mutex_unlock(&local_ports_lock);
+	synchronize_rcu();
 	port_ptr->type = CONTROL_PORT;
 	mutex_lock(&control_ports_lock);
 	list_add_tail(&port_ptr->list, &control_ports);
@@ -2036,17 +2072,17 @@ int msm_ipc_router_lookup_server_name(struct msm_ipc_port_name *srv_name,
 		return -EINVAL;
 	}
 
-	mutex_lock(&server_list_lock);
+	rcu_read_lock();
 	if (!lookup_mask)
 		lookup_mask = 0xFFFFFFFF;
 	for (key = 0; key < SRV_HASH_SIZE; key++) {
-		list_for_each_entry(server, &server_list[key], list) {
+		list_for_each_entry_rcu(server, &server_list[key], list) {
 			if ((server->name.service != srv_name->service) ||
 			    ((server->name.instance & lookup_mask) !=
 				srv_name->instance))
 				continue;
 
-			list_for_each_entry(server_port,
+			list_for_each_entry_rcu(server_port,
 				&server->server_port_list, list) {
 				if (i < num_entries_in_array) {
 					srv_addr[i].node_id =
@@ -2058,7 +2094,7 @@ int msm_ipc_router_lookup_server_name(struct msm_ipc_port_name *srv_name,
 			}
 		}
 	}
-	mutex_unlock(&server_list_lock);
+	rcu_read_unlock();
 
 	return i;
 }
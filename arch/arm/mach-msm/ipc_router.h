@@ -115,7 +115,7 @@ struct msm_ipc_port {
 	struct mutex incomplete_lock;
 
 	struct list_head port_rx_q;
-	struct mutex port_rx_q_lock;
+	spinlock_t port_rx_q_lock;
 	struct wake_lock port_rx_wake_lock;
 	wait_queue_head_t port_rx_wait_q;
 
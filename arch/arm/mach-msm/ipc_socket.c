@@ -25,6 +25,7 @@
 #include <asm/atomic.h>
 
 #include <net/sock.h>
+#include <net/busy_poll.h>
 
 #include <mach/peripheral-loader.h>
 
@@ -333,10 +334,16 @@ static int msm_ipc_router_recvmsg(struct kiocb *iocb, struct socket *sock,
 
 	lock_sock(sk);
 	timeout = sk->sk_rcvtimeo;
-	mutex_lock(&port_ptr->port_rx_q_lock);
+	spin_lock(&port_ptr->port_rx_q_lock);
 	while (list_empty(&port_ptr->port_rx_q)) {
-		mutex_unlock(&port_ptr->port_rx_q_lock);
+		spin_unlock(&port_ptr->port_rx_q_lock);
 		release_sock(sk);
+		if (timeout && sk_can_busy_loop(sk) &&
+		    sk_busy_loop_cond(sk, !list_empty(&port_ptr->port_rx_q))) {
+			lock_sock(sk);
+			spin_lock(&port_ptr->port_rx_q_lock);
+			continue;
+		}
 		if (timeout < 0) {
 			ret = wait_event_interruptible(
 					port_ptr->port_rx_wait_q,
@@ -355,9 +362,9 @@ static int msm_ipc_router_recvmsg(struct kiocb *iocb, struct socket *sock,
 		if (timeout == 0)
 			return -ETIMEDOUT;
 		lock_sock(sk);
-		mutex_lock(&port_ptr->port_rx_q_lock);
+		spin_lock(&port_ptr->port_rx_q_lock);
 	}
-	mutex_unlock(&port_ptr->port_rx_q_lock);
+	spin_unlock(&port_ptr->port_rx_q_lock);
 
 	ret = msm_ipc_router_read(port_ptr, &msg, buf_len);
 	if (ret <= 0 || !msg) {
@@ -26,6 +26,7 @@
 #include <linux/list.h>
 #include <linux/slab.h>
 #include <linux/delay.h>
+#include <linux/hrtimer.h>
 #include <linux/io.h>
 #include <linux/termios.h>
 #include <linux/ctype.h>
@@ -534,6 +535,11 @@ struct smd_channel {
 	unsigned last_state;
 	void (*notify_other_cpu)(void);
 
+	/* deferred data notification, see smd_notify_other_cpu() */
+	spinlock_t notify_lock;
+	struct hrtimer notify_timer;
+	unsigned notify_pending;
+
 	char name[20];
 	struct platform_device pdev;
 	unsigned type;
@@ -966,6 +972,98 @@ static void ch_write_done(struct smd_channel *ch, unsigned count)
 	ch->send->fHEAD = 1;
 }
 
+/*
+ * Write interrupts to the remote processor can be deferred by up to
+ * notify_delay_us so that back-to-back writes share a single interrupt.
+ * A channel whose transmit fifo is half full signals at once so that a
+ * filling fifo is drained without added delay; read acknowledgements and
+ * state changes are always signalled immediately.  0 disables deferral.
+ *
+ * notify_pending and the timer are only changed under notify_lock so a
+ * cancel can never leave the flag set with no timer armed.
+ */
+static int smd_notify_delay_us;
+module_param_named(notify_delay_us, smd_notify_delay_us,
+		   int, S_IRUGO | S_IWUSR | S_IWGRP);
+
+static enum hrtimer_restart smd_notify_timer_fn(struct hrtimer *timer)
+{
+	struct smd_channel *ch = container_of(timer, struct smd_channel,
+					      notify_timer);
+	unsigned long flags;
+	unsigned pending;
+
+	spin_lock_irqsave(&ch->notify_lock, flags);
+	pending = ch->notify_pending;
+	ch->notify_pending = 0;
+	spin_unlock_irqrestore(&ch->notify_lock, flags);
+
+	if (pending)
+		ch->notify_other_cpu();
+	return HRTIMER_NORESTART;
+}
+
+static void smd_notify_init(struct smd_channel *ch)
+{
+	spin_lock_init(&ch->notify_lock);
+	hrtimer_init(&ch->notify_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	ch->notify_timer.function = smd_notify_timer_fn;
+}
+
+/* interrupt the remote now, superseding any deferred notification */
+static void smd_notify_now(struct smd_channel *ch)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ch->notify_lock, flags);
+	if (ch->notify_pending) {
+		hrtimer_try_to_cancel(&ch->notify_timer);
+		ch->notify_pending = 0;
+	}
+	spin_unlock_irqrestore(&ch->notify_lock, flags);
+
+	ch->notify_other_cpu();
+}
+
+/* deliver a deferred notification, if there is one, right away */
+static void smd_notify_flush(struct smd_channel *ch)
+{
+	unsigned long flags;
+	unsigned pending;
+
+	spin_lock_irqsave(&ch->notify_lock, flags);
+	pending = ch->notify_pending;
+	if (pending) {
+		hrtimer_try_to_cancel(&ch->notify_timer);
+		ch->notify_pending = 0;
+	}
+	spin_unlock_irqrestore(&ch->notify_lock, flags);
+
+	if (pending)
+		ch->notify_other_cpu();
+}
+
+static void smd_notify_other_cpu(struct smd_channel *ch)
+{
+	int delay = ACCESS_ONCE(smd_notify_delay_us);
+	unsigned long flags;
+
+	if (delay <= 0 ||
+	    smd_stream_write_avail(ch) < (int)(ch->fifo_size / 2)) {
+		smd_notify_now(ch);
+		return;
+	}
+
+	spin_lock_irqsave(&ch->notify_lock, flags);
+	if (!ch->notify_pending) {
+		ch->notify_pending = 1;
+		hrtimer_start(&ch->notify_timer,
+			      ns_to_ktime((u64)delay * NSEC_PER_USEC),
+			      HRTIMER_MODE_REL);
+	}
+	spin_unlock_irqrestore(&ch->notify_lock, flags);
+}
+
 static void ch_set_state(struct smd_channel *ch, unsigned n)
 {
 	if (n == SMD_SS_OPENED) {
@@ -979,7 +1077,7 @@ static void ch_set_state(struct smd_channel *ch, unsigned n)
 	}
 	ch->send->state = n;
 	ch->send->fSTATE = 1;
-	ch->notify_other_cpu();
+	smd_notify_now(ch);
 }
 
 static void do_smd_probe(void)
@@ -1055,6 +1153,24 @@ static void handle_smd_irq_closing_list(void)
 	spin_unlock_irqrestore(&smd_lock, flags);
 }
 
+/*
+ * Number of times a channel's client is handed data per interrupt.  If
+ * the remote writes more while the client runs, the client is called
+ * again straight away instead of on the interrupt that follows, which
+ * then finds nothing left to do.
+ */
+static int smd_rx_poll_budget = 4;
+module_param_named(rx_poll_budget, smd_rx_poll_budget,
+		   int, S_IRUGO | S_IWUSR | S_IWGRP);
+
+static int smd_rx_pending(struct smd_channel *ch)
+{
+	if (!ch_is_open(ch) || !ch->recv->fHEAD)
+		return 0;
+	ch->recv->fHEAD = 0;
+	return 1;
+}
+
 static void handle_smd_irq(struct list_head *list, void (*notify)(void))
 {
 	unsigned long flags;
@@ -1062,6 +1178,7 @@ static void handle_smd_irq(struct list_head *list, void (*notify)(void))
 	unsigned ch_flags;
 	unsigned tmp;
 	unsigned char state_change;
+	int budget;
 
 	spin_lock_irqsave(&smd_lock, flags);
 	list_for_each_entry(ch, list, ch_list) {
@@ -1089,8 +1206,11 @@ static void handle_smd_irq(struct list_head *list, void (*notify)(void))
 			state_change = 1;
 		}
 		if (ch_flags) {
-			ch->update_state(ch);
-			ch->notify(ch->priv, SMD_EVENT_DATA);
+			budget = smd_rx_poll_budget;
+			do {
+				ch->update_state(ch);
+				ch->notify(ch->priv, SMD_EVENT_DATA);
+			} while (--budget > 0 && smd_rx_pending(ch));
 		}
 		if (ch_flags & 0x4 && !state_change)
 			ch->notify(ch->priv, SMD_EVENT_STATUS);
@@ -1219,7 +1339,8 @@ static int smd_is_packet(struct smd_alloc_elm *alloc_elm)
 		return 0;
 }
 
-static int smd_stream_write(smd_channel_t *ch, const void *_data, int len,
+/* copy into the fifo without signalling the remote */
+static int __smd_stream_write(smd_channel_t *ch, const void *_data, int len,
 				int user_buf)
 {
 	void *ptr;
@@ -1228,7 +1349,6 @@ static int smd_stream_write(smd_channel_t *ch, const void *_data, int len,
 	int orig_len = len;
 	int r = 0;
 
-	SMD_DBG("smd_stream_write() %d -> ch%d\n", len, ch->n);
 	if (len < 0)
 		return -EINVAL;
 	else if (len == 0)
@@ -1257,12 +1377,22 @@ static int smd_stream_write(smd_channel_t *ch, const void *_data, int len,
 			break;
 	}
 
-	if (orig_len - len)
-		ch->notify_other_cpu();
-
 	return orig_len - len;
 }
 
+static int smd_stream_write(smd_channel_t *ch, const void *_data, int len,
+				int user_buf)
+{
+	int ret;
+
+	SMD_DBG("smd_stream_write() %d -> ch%d\n", len, ch->n);
+	ret = __smd_stream_write(ch, _data, len, user_buf);
+	if (ret > 0)
+		smd_notify_other_cpu(ch);
+
+	return ret;
+}
+
 static int smd_packet_write(smd_channel_t *ch, const void *_data, int len,
 				int user_buf)
 {
@@ -1282,7 +1412,8 @@ static int smd_packet_write(smd_channel_t *ch, const void *_data, int len,
 	hdr[1] = hdr[2] = hdr[3] = hdr[4] = 0;
 
 
-	ret = smd_stream_write(ch, hdr, sizeof(hdr), 0);
+	/* header and payload go out on a single interrupt */
+	ret = __smd_stream_write(ch, hdr, sizeof(hdr), 0);
 	if (ret < 0 || ret != sizeof(hdr)) {
 		SMD_DBG("%s failed to write pkt header: "
 			"%d returned\n", __func__, ret);
@@ -1290,7 +1421,8 @@ static int smd_packet_write(smd_channel_t *ch, const void *_data, int len,
 	}
 
 
-	ret = smd_stream_write(ch, _data, len, user_buf);
+	ret = __smd_stream_write(ch, _data, len, user_buf);
+	smd_notify_other_cpu(ch);
 	if (ret < 0 || ret != len) {
 		SMD_DBG("%s failed to write pkt data: "
 			"%d returned\n", __func__, ret);
@@ -1310,7 +1442,7 @@ static int smd_stream_read(smd_channel_t *ch, void *data, int len, int user_buf)
 	r = ch_read(ch, data, len, user_buf);
 	if (r > 0)
 		if (!read_intr_blocked(ch))
-			ch->notify_other_cpu();
+			smd_notify_now(ch);
 
 	return r;
 }
@@ -1329,7 +1461,7 @@ static int smd_packet_read(smd_channel_t *ch, void *data, int len, int user_buf)
 	r = ch_read(ch, data, len, user_buf);
 	if (r > 0)
 		if (!read_intr_blocked(ch))
-			ch->notify_other_cpu();
+			smd_notify_now(ch);
 
 	spin_lock_irqsave(&smd_lock, flags);
 	ch->current_packet -= r;
@@ -1353,7 +1485,7 @@ static int smd_packet_read_from_cb(smd_channel_t *ch, void *data, int len,
 	r = ch_read(ch, data, len, user_buf);
 	if (r > 0)
 		if (!read_intr_blocked(ch))
-			ch->notify_other_cpu();
+			smd_notify_now(ch);
 
 	ch->current_packet -= r;
 	update_packet_state(ch);
@@ -1440,6 +1572,7 @@ static int smd_alloc_channel(struct smd_alloc_elm *alloc_elm)
 
 	ch->fifo_mask = ch->fifo_size - 1;
 	ch->type = SMD_CHANNEL_TYPE(alloc_elm->type);
+	smd_notify_init(ch);
 
 	if (ch->type == SMD_APPS_MODEM)
 		ch->notify_other_cpu = notify_modem_smd;
@@ -1526,6 +1659,7 @@ static int smd_alloc_loopback_channel(void)
 	ch->fifo_mask = ch->fifo_size - 1;
 	ch->type = SMD_LOOPBACK_TYPE;
 	ch->notify_other_cpu = notify_loopback_smd;
+	smd_notify_init(ch);
 
 	ch->read = smd_stream_read;
 	ch->write = smd_stream_write;
@@ -1728,6 +1862,11 @@ int smd_close(smd_channel_t *ch)
 		mutex_unlock(&smd_creation_mutex);
 	}
 
+	spin_lock_irqsave(&ch->notify_lock, flags);
+	ch->notify_pending = 0;
+	spin_unlock_irqrestore(&ch->notify_lock, flags);
+	hrtimer_cancel(&ch->notify_timer);
+
 	SMD_INFO("smd_close(%s)-\n", ch->name);
 	return 0;
 }
@@ -1768,7 +1907,8 @@ int smd_write_start(smd_channel_t *ch, int len)
 	hdr[1] = hdr[2] = hdr[3] = hdr[4] = 0;
 
 
-	ret = smd_stream_write(ch, hdr, sizeof(hdr), 0);
+	/* signalled along with the first segment */
+	ret = __smd_stream_write(ch, hdr, sizeof(hdr), 0);
 	if (ret < 0 || ret != sizeof(hdr)) {
 		ch->pending_pkt_sz = 0;
 		pr_err("[SMD] %s: packet header failed to write\n", __func__);
@@ -1821,6 +1961,7 @@ int smd_write_end(smd_channel_t *ch)
 		return -E2BIG;
 	}
 
+	smd_notify_flush(ch);
 	return 0;
 }
 EXPORT_SYMBOL(smd_write_end);
@@ -1926,7 +2067,7 @@ smd_tiocmset_from_cb(smd_channel_t *ch, unsigned int set, unsigned int clear)
 
 	ch->send->fSTATE = 1;
 	barrier();
-	ch->notify_other_cpu();
+	smd_notify_now(ch);
 
 	return 0;
 }
@@ -62,4 +62,9 @@
 
 #define SO_RXQ_OVFL             40
 
+#define SO_BUSY_POLL		46
+
+/* Not an upstream option: numbered clear of upstream, same on all arches */
+#define SO_BUSY_POLL_STATS	0x7f00
+
 #endif /* __ASM_AVR32_SOCKET_H */
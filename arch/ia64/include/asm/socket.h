@@ -71,4 +71,9 @@
 
 #define SO_RXQ_OVFL             40
 
+#define SO_BUSY_POLL		46
+
+/* Not an upstream option: numbered clear of upstream, same on all arches */
+#define SO_BUSY_POLL_STATS	0x7f00
+
 #endif /* _ASM_IA64_SOCKET_H */
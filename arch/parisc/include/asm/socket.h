@@ -61,6 +61,11 @@
 
 #define SO_RXQ_OVFL             0x4021
 
+#define SO_BUSY_POLL		0x4027
+
+/* Not an upstream option: numbered clear of upstream, same on all arches */
+#define SO_BUSY_POLL_STATS	0x7f00
+
 /* O_NONBLOCK clashes with the bits used for socket types.  Therefore we
  * have to define SOCK_NONBLOCK to a different value here.
  */
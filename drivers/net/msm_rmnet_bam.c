@@ -69,6 +69,8 @@ module_param_named(debug_enable, msm_rmnet_bam_debug_mask,
 #define DEVICE_INACTIVE      0
 #define DEVICE_ACTIVE        1
 
+#define RMNET_NAPI_WEIGHT  64
+
 #define HEADROOM_FOR_BAM   8 /* for mux header */
 #define HEADROOM_FOR_QOS    8
 #define TAILROOM            8 /* for padding by mux layer */
@@ -85,12 +87,24 @@ struct rmnet_private {
 	struct sk_buff *waiting_for_ul_skb;
 	spinlock_t lock;
 	spinlock_t tx_queue_lock;
+	struct sk_buff_head rx_queue;
+	struct napi_struct napi;
 	struct tasklet_struct tsklt;
 	u32 operation_mode; /* IOCTL specified mode (protocol, QoS header) */
 	uint8_t device_up;
 	uint8_t in_reset;
 };
 
+/*
+ * Length accounted to byte queue limits, kept in the skb because the
+ * mux layer prepends its header and pads the packet before completion.
+ */
+struct rmnet_skb_cb {
+	unsigned int bql_len;
+};
+
+#define RMNET_SKB_CB(skb)	((struct rmnet_skb_cb *)(skb)->cb)
+
 #ifdef CONFIG_MSM_RMNET_DEBUG
 static unsigned long timeout_us;
 
@@ -255,6 +269,7 @@ static void bam_recv_notify(void *dev, struct sk_buff *skb)
 	struct rmnet_private *p = netdev_priv(dev);
 	unsigned long flags;
 	u32 opmode;
+	int queued;
 
 	if (skb) {
 		skb->dev = dev;
@@ -265,6 +280,7 @@ static void bam_recv_notify(void *dev, struct sk_buff *skb)
 
 		if (RMNET_IS_MODE_IP(opmode)) {
 			/* Driver in IP mode */
+			skb_reset_mac_header(skb);
 			skb->protocol = rmnet_ip_type_trans(skb, dev);
 		} else {
 			/* Driver in Ethernet mode */
@@ -282,13 +298,56 @@ static void bam_recv_notify(void *dev, struct sk_buff *skb)
 			((struct net_device *)dev)->name,
 			p->stats.rx_packets, skb->len);
 
-		/* Deliver to network stack */
-		netif_rx(skb);
+		/*
+		 * Deliver to network stack from rmnet_poll(), which feeds
+		 * GRO.  rmnet_stop() purges the queue under its lock once
+		 * the device is no longer running.
+		 */
+		spin_lock_irqsave(&p->rx_queue.lock, flags);
+		queued = netif_running(dev) &&
+			 skb_queue_len(&p->rx_queue) < netdev_max_backlog;
+		if (queued)
+			__skb_queue_tail(&p->rx_queue, skb);
+		spin_unlock_irqrestore(&p->rx_queue.lock, flags);
+
+		if (!queued) {
+			p->stats.rx_dropped++;
+			dev_kfree_skb_any(skb);
+			return;
+		}
+		/* run the softirq on bh enable rather than at the next irq */
+		local_bh_disable();
+		napi_schedule(&p->napi);
+		local_bh_enable();
 	} else
 		pr_err(MODULE_NAME "[%s] %s: No skb received",
 			((struct net_device *)dev)->name, __func__);
 }
 
+static int rmnet_poll(struct napi_struct *napi, int budget)
+{
+	struct rmnet_private *p = container_of(napi, struct rmnet_private,
+					       napi);
+	struct sk_buff *skb;
+	int work_done = 0;
+
+	while (work_done < budget) {
+		skb = skb_dequeue(&p->rx_queue);
+		if (!skb)
+			break;
+		work_done++;
+		napi_gro_receive_csum(napi, skb);
+	}
+
+	if (work_done < budget) {
+		napi_complete(napi);
+		/* bam_recv_notify() may have queued more after the last dequeue */
+		if (!skb_queue_empty(&p->rx_queue))
+			napi_schedule(napi);
+	}
+	return work_done;
+}
+
 static int _rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct rmnet_private *p = netdev_priv(dev);
@@ -296,6 +355,7 @@ static int _rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
 	struct QMI_QOS_HDR_S *qmih;
 	u32 opmode;
 	unsigned long flags;
+	unsigned int len;
 
 	/* For QoS mode, prepend QMI header and assign flow ID from skb->mark */
 	spin_lock_irqsave(&p->lock, flags);
@@ -311,9 +371,24 @@ static int _rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
 	}
 
 	dev->trans_start = jiffies;
+
+	/*
+	 * Account the bytes before handing the skb over: the write done
+	 * callback may run before msm_bam_dmux_write() returns.
+	 */
+	len = skb->len;
+	RMNET_SKB_CB(skb)->bql_len = len;
+	netdev_sent_queue(dev, len);
+
 	/* if write() succeeds, skb access is unsafe in this process */
 	bam_ret = msm_bam_dmux_write(p->ch_id, skb);
 
+	if (bam_ret != 0) {
+		spin_lock_irqsave(&p->tx_queue_lock, flags);
+		netdev_completed_queue(dev, 1, len);
+		spin_unlock_irqrestore(&p->tx_queue_lock, flags);
+	}
+
 	if (bam_ret != 0 && bam_ret != -EAGAIN && bam_ret != -EFAULT) {
 		pr_err(MODULE_NAME "[%s] %s: write returned error %d",
 			dev->name, __func__, bam_ret);
@@ -328,6 +403,7 @@ static void bam_write_done(void *dev, struct sk_buff *skb)
 	struct rmnet_private *p = netdev_priv(dev);
 	u32 opmode = p->operation_mode;
 	unsigned long flags;
+	unsigned int bql_len;
 
 	DBG1("%s: write complete\n", __func__);
 	if (RMNET_IS_MODE_IP(opmode) ||
@@ -341,9 +417,12 @@ static void bam_write_done(void *dev, struct sk_buff *skb)
 	DBG1("[%s] Tx packet #%lu len=%d mark=0x%x\n",
 	    ((struct net_device *)(dev))->name, p->stats.tx_packets,
 	    skb->len, skb->mark);
+	bql_len = RMNET_SKB_CB(skb)->bql_len;
 	dev_kfree_skb_any(skb);
 
 	spin_lock_irqsave(&p->tx_queue_lock, flags);
+	/* dql_completed() callers are serialized by tx_queue_lock */
+	netdev_completed_queue(dev, 1, bql_len);
 	if (netif_queue_stopped(dev) &&
 	    msm_bam_dmux_is_ch_low(p->ch_id)) {
 		DBG0("%s: Low WM hit, waking queue=%p\n",
@@ -413,14 +492,17 @@ static int __rmnet_open(struct net_device *dev)
 
 static int rmnet_open(struct net_device *dev)
 {
+	struct rmnet_private *p = netdev_priv(dev);
 	int rc = 0;
 
 	DBG0("[%s] rmnet_open()\n", dev->name);
 
 	rc = __rmnet_open(dev);
 
-	if (rc == 0)
+	if (rc == 0) {
+		napi_enable(&p->napi);
 		netif_start_queue(dev);
+	}
 
 	return rc;
 }
@@ -445,10 +527,14 @@ static int __rmnet_close(struct net_device *dev)
 
 static int rmnet_stop(struct net_device *dev)
 {
+	struct rmnet_private *p = netdev_priv(dev);
+
 	DBG0("[%s] rmnet_stop()\n", dev->name);
 
 	__rmnet_close(dev);
 	netif_stop_queue(dev);
+	napi_disable(&p->napi);
+	skb_queue_purge(&p->rx_queue);
 
 	return 0;
 }
@@ -726,6 +812,8 @@ static int bam_rmnet_probe(struct platform_device *pdev)
 		DBG0("[%s] is reset\n", pdev->name);
 		p->in_reset = 0;
 		msm_bam_dmux_open(p->ch_id, netdevs[i], bam_notify);
+		/* writes pending at the time of the reset never complete */
+		netdev_reset_queue(netdevs[i]);
 		netif_carrier_on(netdevs[i]);
 		netif_start_queue(netdevs[i]);
 	}
@@ -804,6 +892,8 @@ static int __init rmnet_init(void)
 		p->in_reset = 0;
 		spin_lock_init(&p->lock);
 		spin_lock_init(&p->tx_queue_lock);
+		skb_queue_head_init(&p->rx_queue);
+		netif_napi_add(dev, &p->napi, rmnet_poll, RMNET_NAPI_WEIGHT);
 #ifdef CONFIG_MSM_RMNET_DEBUG
 		p->timeout_us = timeout_us;
 		p->wakeups_xmit = p->wakeups_rcv = 0;
@@ -29,8 +29,34 @@
 
 #define ADB_BULK_BUFFER_SIZE           4096
 
-/* number of tx requests to allocate */
-#define TX_REQ_MAX 4
+/* number of tx and rx requests to allocate when the larger buffers
+ * asked for by the module parameters below cannot be had
+ */
+#define TX_REQ_MIN 4
+#define RX_REQ_MIN 1
+/* upper bounds for adb_tx_reqs and adb_rx_reqs */
+#define TX_REQ_MAX 16
+#define RX_REQ_MAX 16
+
+/* Bulk request sizing, picked up at the next bind.  A read is spread
+ * over up to adb_rx_reqs requests queued together, so the largest
+ * read accepted is adb_rx_reqs * adb_rx_req_len bytes.
+ */
+static unsigned int adb_tx_req_len = 16384;
+module_param(adb_tx_req_len, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(adb_tx_req_len, "Size of each bulk IN request buffer");
+
+static unsigned int adb_tx_reqs = 4;
+module_param(adb_tx_reqs, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(adb_tx_reqs, "Number of bulk IN requests");
+
+static unsigned int adb_rx_req_len = 16384;
+module_param(adb_rx_req_len, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(adb_rx_req_len, "Size of each bulk OUT request buffer");
+
+static unsigned int adb_rx_reqs = 4;
+module_param(adb_rx_reqs, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(adb_rx_reqs, "Number of bulk OUT requests");
 
 static const char adb_shortname[] = "android_adb";
 
@@ -53,8 +79,15 @@ struct adb_dev {
 
 	wait_queue_head_t read_wq;
 	wait_queue_head_t write_wq;
-	struct usb_request *rx_req;
-	int rx_done;
+	struct usb_request *rx_req[RX_REQ_MAX];
+	/* bulk OUT completions since the last read was queued */
+	unsigned rx_done;
+
+	/* bulk request sizing in use since bind */
+	unsigned tx_req_len;
+	unsigned tx_reqs;
+	unsigned rx_req_len;
+	unsigned rx_reqs;
 };
 
 static struct usb_interface_descriptor adb_interface_desc = {
@@ -204,8 +237,9 @@ static void adb_complete_out(struct usb_ep *ep, struct usb_request *req)
 {
 	struct adb_dev *dev = _adb_dev;
 
-	dev->rx_done = 1;
-	if (req->status != 0)
+	dev->rx_done++;
+	/* -ECONNRESET is a request adb_read() dequeued itself */
+	if (req->status != 0 && req->status != -ECONNRESET)
 		atomic_set(&dev->error, 1);
 
 	wake_up(&dev->read_wq);
@@ -241,14 +275,21 @@ static int adb_create_bulk_endpoints(struct adb_dev *dev,
 	dev->ep_out = ep;
 
 	/* now allocate requests for our endpoints */
-	req = adb_request_new(dev->ep_out, ADB_BULK_BUFFER_SIZE);
-	if (!req)
-		goto fail;
-	req->complete = adb_complete_out;
-	dev->rx_req = req;
+	dev->tx_req_len = max_t(unsigned, adb_tx_req_len, ADB_BULK_BUFFER_SIZE);
+	dev->tx_reqs = clamp_t(unsigned, adb_tx_reqs, 1, TX_REQ_MAX);
+	dev->rx_req_len = max_t(unsigned, adb_rx_req_len, ADB_BULK_BUFFER_SIZE);
+	dev->rx_reqs = clamp_t(unsigned, adb_rx_reqs, 1, RX_REQ_MAX);
+retry_alloc:
+	for (i = 0; i < dev->rx_reqs; i++) {
+		req = adb_request_new(dev->ep_out, dev->rx_req_len);
+		if (!req)
+			goto fail;
+		req->complete = adb_complete_out;
+		dev->rx_req[i] = req;
+	}
 
-	for (i = 0; i < TX_REQ_MAX; i++) {
-		req = adb_request_new(dev->ep_in, ADB_BULK_BUFFER_SIZE);
+	for (i = 0; i < dev->tx_reqs; i++) {
+		req = adb_request_new(dev->ep_in, dev->tx_req_len);
 		if (!req)
 			goto fail;
 		req->complete = adb_complete_in;
@@ -258,25 +299,52 @@ static int adb_create_bulk_endpoints(struct adb_dev *dev,
 	return 0;
 
 fail:
+	while ((req = adb_req_get(dev, &dev->tx_idle)))
+		adb_request_free(req, dev->ep_in);
+	for (i = 0; i < RX_REQ_MAX; i++) {
+		adb_request_free(dev->rx_req[i], dev->ep_out);
+		dev->rx_req[i] = NULL;
+	}
+	if (dev->tx_req_len > ADB_BULK_BUFFER_SIZE ||
+	    dev->rx_req_len > ADB_BULK_BUFFER_SIZE) {
+		/* large buffers are higher order allocations, fall back */
+		printk(KERN_WARNING "adb_bind() falling back to %d byte requests\n",
+			ADB_BULK_BUFFER_SIZE);
+		dev->tx_req_len = dev->rx_req_len = ADB_BULK_BUFFER_SIZE;
+		dev->tx_reqs = TX_REQ_MIN;
+		dev->rx_reqs = RX_REQ_MIN;
+		goto retry_alloc;
+	}
 	printk(KERN_ERR "adb_bind() could not allocate requests\n");
 	return -1;
 }
 
+/* dequeue rx_req[from..to-1] and wait for them to be given back */
+static void adb_rx_flush(struct adb_dev *dev, unsigned from, unsigned to)
+{
+	unsigned i;
+
+	if (from >= to)
+		return;
+	for (i = from; i < to; i++)
+		usb_ep_dequeue(dev->ep_out, dev->rx_req[i]);
+	wait_event_timeout(dev->read_wq, dev->rx_done >= to, HZ);
+}
+
 static ssize_t adb_read(struct file *fp, char __user *buf,
 				size_t count, loff_t *pos)
 {
 	struct adb_dev *dev = fp->private_data;
 	struct usb_request *req;
-	int r = count, xfer;
+	size_t left;
+	unsigned i, n;
+	int r = count;
 	int ret;
 
 	pr_debug("adb_read(%d)\n", count);
 	if (!_adb_dev)
 		return -ENODEV;
 
-	if (count > ADB_BULK_BUFFER_SIZE)
-		return -EINVAL;
-
 	if (adb_lock(&dev->read_excl))
 		return -EBUSY;
 
@@ -295,42 +363,71 @@ static ssize_t adb_read(struct file *fp, char __user *buf,
 		r = -EIO;
 		goto done;
 	}
-
-requeue_req:
-	/* queue a request */
-	req = dev->rx_req;
-	req->length = count;
-	dev->rx_done = 0;
-	ret = usb_ep_queue(dev->ep_out, req, GFP_ATOMIC);
-	if (ret < 0) {
-		pr_debug("adb_read: failed to queue req %p (%d)\n", req, ret);
-		r = -EIO;
-		atomic_set(&dev->error, 1);
+	/* the request sizes are only known once we are bound */
+	if (count > dev->rx_req_len * dev->rx_reqs) {
+		r = -EINVAL;
 		goto done;
-	} else {
-		pr_debug("rx %p queue\n", req);
 	}
 
-	/* wait for a request to complete */
-	ret = wait_event_interruptible(dev->read_wq, dev->rx_done);
-	if (ret < 0) {
-		atomic_set(&dev->error, 1);
-		r = ret;
-		usb_ep_dequeue(dev->ep_out, req);
-		goto done;
-	}
-	if (!atomic_read(&dev->error)) {
-		/* If we got a 0-len packet, throw it back and try again. */
-		if (req->actual == 0)
-			goto requeue_req;
+requeue_req:
+	/* Queue all the requests the read needs at once, so the controller
+	 * moves from one buffer to the next without waiting for us.  They
+	 * add up to exactly count bytes, as a single request used to.
+	 */
+	dev->rx_done = 0;
+	left = count;
+	n = 0;
+	do {
+		req = dev->rx_req[n];
+		req->length = min_t(size_t, left, dev->rx_req_len);
+		ret = usb_ep_queue(dev->ep_out, req, GFP_ATOMIC);
+		if (ret < 0) {
+			pr_debug("adb_read: failed to queue req %p (%d)\n",
+				req, ret);
+			adb_rx_flush(dev, 0, n);
+			r = -EIO;
+			atomic_set(&dev->error, 1);
+			goto done;
+		} else {
+			pr_debug("rx %p queue\n", req);
+		}
+		left -= req->length;
+		n++;
+	} while (left > 0);
+
+	/* requests complete in order, a short one ends the transfer */
+	r = 0;
+	for (i = 0; i < n; i++) {
+		req = dev->rx_req[i];
+		ret = wait_event_interruptible(dev->read_wq, dev->rx_done > i);
+		if (ret < 0) {
+			atomic_set(&dev->error, 1);
+			adb_rx_flush(dev, i, n);
+			r = ret;
+			goto done;
+		}
+		if (atomic_read(&dev->error)) {
+			adb_rx_flush(dev, i + 1, n);
+			r = -EIO;
+			goto done;
+		}
 
 		pr_debug("rx %p %d\n", req, req->actual);
-		xfer = (req->actual < count) ? req->actual : count;
-		if (copy_to_user(buf, req->buf, xfer))
+		if (copy_to_user(buf + r, req->buf, req->actual)) {
+			adb_rx_flush(dev, i + 1, n);
 			r = -EFAULT;
+			goto done;
+		}
+		r += req->actual;
+		if (req->actual < req->length) {
+			adb_rx_flush(dev, i + 1, n);
+			break;
+		}
+	}
 
-	} else
-		r = -EIO;
+	/* If we got a 0-len packet, throw it back and try again. */
+	if (r == 0 && count)
+		goto requeue_req;
 
 done:
 	adb_unlock(&dev->read_excl);
@@ -372,8 +469,8 @@ static ssize_t adb_write(struct file *fp, const char __user *buf,
 		}
 
 		if (req != 0) {
-			if (count > ADB_BULK_BUFFER_SIZE)
-				xfer = ADB_BULK_BUFFER_SIZE;
+			if (count > dev->tx_req_len)
+				xfer = dev->tx_req_len;
 			else
 				xfer = count;
 			if (copy_from_user(req->buf, buf, xfer)) {
@@ -490,14 +587,17 @@ adb_function_unbind(struct usb_configuration *c, struct usb_function *f)
 {
 	struct adb_dev	*dev = func_to_adb(f);
 	struct usb_request *req;
-
+	int i;
 
 	atomic_set(&dev->online, 0);
 	atomic_set(&dev->error, 1);
 
 	wake_up(&dev->read_wq);
 
-	adb_request_free(dev->rx_req, dev->ep_out);
+	for (i = 0; i < RX_REQ_MAX; i++) {
+		adb_request_free(dev->rx_req[i], dev->ep_out);
+		dev->rx_req[i] = NULL;
+	}
 	while ((req = adb_req_get(dev, &dev->tx_idle)))
 		adb_request_free(req, dev->ep_in);
 }
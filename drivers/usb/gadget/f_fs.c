@@ -27,8 +27,11 @@
 /* #define DEBUG */
 /* #define VERBOSE_DEBUG */
 
+#include <linux/aio.h>
 #include <linux/blkdev.h>
+#include <linux/mm.h>
 #include <linux/pagemap.h>
+#include <linux/kref.h>
 #include <asm/unaligned.h>
 
 #include <linux/usb/composite.h>
@@ -37,6 +40,9 @@
 
 #define FUNCTIONFS_MAGIC	0xa647361 /* Chosen by a honest dice roll ;) */
 
+/* Upper bound of the buffer an endpoint file can be mmap()ed with. */
+#define FFS_MMAP_MAX		(1 << 20)
+
 
 /* Debugging ****************************************************************/
 
@@ -312,6 +318,12 @@ struct ffs_ep {
 	int				status;	/* P: epfile->mutex */
 };
 
+struct ffs_mmap_buf {
+	struct kref			ref;
+	size_t				len;
+	void				*data;
+};
+
 struct ffs_epfile {
 	/* Protects ep->ep and ep->req. */
 	struct mutex			mutex;
@@ -324,6 +336,13 @@ struct ffs_epfile {
 
 	char				name[5];
 
+	/*
+	 * Buffer shared with user space by mmap(); transfers to or from
+	 * it skip the bounce buffer.  Set once, on first mmap(); the
+	 * endpoint file and every mapping hold a reference to it.
+	 */
+	struct ffs_mmap_buf		*mmap_buf;
+
 	unsigned char			in;	/* P: ffs->eps_lock */
 	unsigned char			isoc;	/* P: ffs->eps_lock */
 
@@ -753,6 +772,36 @@ static void ffs_epfile_io_complete(struct usb_ep *_ep, struct usb_request *req)
 	}
 }
 
+static const struct vm_operations_struct ffs_epfile_vm_ops;
+
+/*
+ * If [buf, buf + len) lies within a mapping of this endpoint's mmap()
+ * buffer, returns the matching kernel address so the request can use
+ * the user's memory directly.  Otherwise returns NULL.
+ */
+static void *ffs_epfile_mmap_addr(struct ffs_epfile *epfile,
+				  const void __user *buf, size_t len)
+{
+	struct ffs_mmap_buf *mbuf = ACCESS_ONCE(epfile->mmap_buf);
+	unsigned long addr = (unsigned long)buf;
+	struct vm_area_struct *vma;
+	void *ret = NULL;
+
+	if (!mbuf || !len || addr + len < addr)
+		return NULL;
+
+	down_read(&current->mm->mmap_sem);
+	vma = find_vma(current->mm, addr);
+	if (vma && vma->vm_start <= addr && addr + len <= vma->vm_end &&
+	    vma->vm_ops == &ffs_epfile_vm_ops &&
+	    vma->vm_private_data == mbuf)
+		ret = mbuf->data + (vma->vm_pgoff << PAGE_SHIFT) +
+			(addr - vma->vm_start);
+	up_read(&current->mm->mmap_sem);
+
+	return ret;
+}
+
 static ssize_t ffs_epfile_io(struct file *file,
 			     char __user *buf, size_t len, int read)
 {
@@ -760,7 +809,7 @@ static ssize_t ffs_epfile_io(struct file *file,
 	struct ffs_ep *ep;
 	char *data = NULL;
 	ssize_t ret;
-	int halt;
+	int halt, zc = 0;
 
 	goto first_try;
 	do {
@@ -796,7 +845,11 @@ first_try:
 			goto error;
 		}
 
-		/* Allocate & copy */
+		/* Allocate & copy, unless the buffer is mmap()ed */
+		if (!halt && !data) {
+			data = ffs_epfile_mmap_addr(epfile, buf, len);
+			zc = !!data;
+		}
 		if (!halt && !data) {
 			data = kzalloc(len, GFP_KERNEL);
 			if (unlikely(!data))
@@ -854,7 +907,7 @@ first_try:
 			usb_ep_dequeue(ep->ep, req);
 		} else {
 			ret = ep->status;
-			if (read && ret > 0 &&
+			if (read && ret > 0 && !zc &&
 			    unlikely(copy_to_user(buf, data, ret)))
 				ret = -EFAULT;
 		}
@@ -862,7 +915,8 @@ first_try:
 
 	mutex_unlock(&epfile->mutex);
 error:
-	kfree(data);
+	if (!zc)
+		kfree(data);
 	return ret;
 }
 
@@ -883,6 +937,327 @@ ffs_epfile_read(struct file *file, char __user *buf, size_t len, loff_t *ptr)
 	return ffs_epfile_io(file, buf, len, 1);
 }
 
+/*
+ * Asynchronous I/O.  Each kiocb gets a usb_request of its own, so user
+ * space can keep several transfers queued on an endpoint and the UDC
+ * never idles between them.  The request and the bounce buffer belong
+ * to the kiocb and are freed by its destructor, which the AIO core
+ * runs only after both the completion and any cancel are done with it.
+ */
+struct ffs_io_data {
+	struct kiocb			*kiocb;
+	struct usb_ep			*ep;
+	struct usb_request		*req;
+
+	const struct iovec		*iov;
+	unsigned long			nr_segs;
+
+	char				*buf;	/* NULL if mmap()ed */
+	size_t				actual;
+	int				read;
+};
+
+static void ffs_epfile_async_io_complete(struct usb_ep *_ep,
+					 struct usb_request *req)
+{
+	struct ffs_io_data *io = req->context;
+
+	ENTER();
+
+	/*
+	 * Data read into the bounce buffer has to be copied out in the
+	 * submitter's context, which is what the retry callback is for.
+	 */
+	if (io->read && io->buf && req->actual && !req->status) {
+		io->actual = req->actual;
+		kick_iocb(io->kiocb);
+		return;
+	}
+
+	aio_complete(io->kiocb, req->status ? req->status : req->actual,
+		     req->status);
+}
+
+static ssize_t ffs_epfile_aio_read_retry(struct kiocb *kiocb)
+{
+	struct ffs_io_data *io = kiocb->private;
+	const struct iovec *iov = io->iov;
+	const char *from = io->buf;
+	size_t left = io->actual;
+	unsigned long i;
+
+	ENTER();
+
+	for (i = 0; left && i < io->nr_segs; ++i, ++iov) {
+		size_t n = min(left, iov->iov_len);
+
+		if (unlikely(copy_to_user(iov->iov_base, from, n)))
+			return io->actual == left ? -EFAULT
+						  : io->actual - left;
+		from += n;
+		left -= n;
+	}
+
+	return io->actual - left;
+}
+
+static int ffs_epfile_aio_cancel(struct kiocb *kiocb, struct io_event *e)
+{
+	struct ffs_io_data *io = kiocb->private;
+	int ret;
+
+	ENTER();
+
+	/* The kiocb holds a reference, so io->req is still ours. */
+	ret = usb_ep_dequeue(io->ep, io->req);
+	if (!ret)
+		e->res = -ECANCELED;
+
+	aio_put_req(kiocb);
+	return ret;
+}
+
+static void ffs_epfile_aio_dtor(struct kiocb *kiocb)
+{
+	struct ffs_io_data *io = kiocb->private;
+
+	usb_ep_free_request(io->ep, io->req);
+	kfree(io->buf);
+	kfree(io);
+}
+
+/* readv()/writev(): one transfer per segment, stopping at a short one. */
+static ssize_t ffs_epfile_sync_rw(struct file *file, const struct iovec *iov,
+				  unsigned long nr_segs, int read)
+{
+	ssize_t ret, total = 0;
+
+	for (; nr_segs; --nr_segs, ++iov) {
+		ret = ffs_epfile_io(file, iov->iov_base, iov->iov_len, read);
+		if (ret < 0)
+			return total ? total : ret;
+		total += ret;
+		if ((size_t)ret < iov->iov_len)
+			break;
+	}
+
+	return total;
+}
+
+static ssize_t ffs_epfile_aio_rw(struct kiocb *kiocb, const struct iovec *iov,
+				 unsigned long nr_segs, int read)
+{
+	struct ffs_epfile *epfile = kiocb->ki_filp->private_data;
+	size_t len = kiocb->ki_left;
+	struct usb_request *req;
+	struct ffs_io_data *io;
+	ssize_t ret;
+	char *data;
+
+	if (is_sync_kiocb(kiocb))
+		return ffs_epfile_sync_rw(kiocb->ki_filp, iov, nr_segs, read);
+
+	if (WARN_ON(epfile->ffs->state != FFS_ACTIVE))
+		return -ENODEV;
+
+	io = kzalloc(sizeof *io, GFP_KERNEL);
+	if (unlikely(!io))
+		return -ENOMEM;
+	io->kiocb   = kiocb;
+	io->iov     = iov;
+	io->nr_segs = nr_segs;
+	io->read    = read;
+
+	data = nr_segs == 1
+		? ffs_epfile_mmap_addr(epfile, iov->iov_base, len) : NULL;
+	if (!data) {
+		data = io->buf = kmalloc(len, GFP_KERNEL);
+		if (unlikely(!data)) {
+			ret = -ENOMEM;
+			goto error;
+		}
+
+		for (; !read && nr_segs; --nr_segs, ++iov) {
+			if (unlikely(copy_from_user(data, iov->iov_base,
+						    iov->iov_len))) {
+				ret = -EFAULT;
+				goto error;
+			}
+			data += iov->iov_len;
+		}
+		data = io->buf;
+	}
+
+	spin_lock_irq(&epfile->ffs->eps_lock);
+
+	/*
+	 * There is nobody to wait for the endpoint to come up and halting
+	 * only makes sense for the synchronous calls.
+	 */
+	if (unlikely(!epfile->ep)) {
+		ret = -ENODEV;
+	} else if (unlikely(!read == !epfile->in)) {
+		ret = -EINVAL;
+	} else {
+		io->ep = epfile->ep->ep;
+		io->req = usb_ep_alloc_request(io->ep, GFP_ATOMIC);
+		ret = io->req ? 0 : -ENOMEM;
+	}
+	if (unlikely(ret)) {
+		spin_unlock_irq(&epfile->ffs->eps_lock);
+		goto error;
+	}
+
+	req = io->req;
+	req->buf      = data;
+	req->length   = len;
+	req->context  = io;
+	req->complete = ffs_epfile_async_io_complete;
+
+	kiocb->private   = io;
+	kiocb->ki_cancel = ffs_epfile_aio_cancel;
+	kiocb->ki_dtor   = ffs_epfile_aio_dtor;
+	if (read && io->buf)
+		kiocb->ki_retry = ffs_epfile_aio_read_retry;
+
+	ret = usb_ep_queue(io->ep, req, GFP_ATOMIC);
+	if (unlikely(ret)) {
+		kiocb->private   = NULL;
+		kiocb->ki_cancel = NULL;
+		kiocb->ki_dtor   = NULL;
+		usb_ep_free_request(io->ep, req);
+	}
+
+	spin_unlock_irq(&epfile->ffs->eps_lock);
+
+	if (likely(!ret))
+		return read && io->buf ? -EIOCBRETRY : -EIOCBQUEUED;
+
+error:
+	kfree(io->buf);
+	kfree(io);
+	return ret;
+}
+
+static ssize_t ffs_epfile_aio_write(struct kiocb *kiocb,
+				    const struct iovec *iov,
+				    unsigned long nr_segs, loff_t pos)
+{
+	ENTER();
+
+	return ffs_epfile_aio_rw(kiocb, iov, nr_segs, 0);
+}
+
+static ssize_t ffs_epfile_aio_read(struct kiocb *kiocb,
+				   const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos)
+{
+	ENTER();
+
+	return ffs_epfile_aio_rw(kiocb, iov, nr_segs, 1);
+}
+
+static void ffs_mmap_buf_release(struct kref *ref)
+{
+	struct ffs_mmap_buf *mbuf = container_of(ref, struct ffs_mmap_buf, ref);
+
+	free_pages_exact(mbuf->data, mbuf->len);
+	kfree(mbuf);
+}
+
+static void ffs_mmap_buf_put(struct ffs_mmap_buf *mbuf)
+{
+	kref_put(&mbuf->ref, ffs_mmap_buf_release);
+}
+
+static struct ffs_mmap_buf *ffs_mmap_buf_alloc(size_t len)
+{
+	struct ffs_mmap_buf *mbuf = kmalloc(sizeof *mbuf, GFP_KERNEL);
+
+	if (unlikely(!mbuf))
+		return NULL;
+	mbuf->data = alloc_pages_exact(len, GFP_KERNEL | __GFP_ZERO);
+	if (unlikely(!mbuf->data)) {
+		kfree(mbuf);
+		return NULL;
+	}
+	mbuf->len = len;
+	kref_init(&mbuf->ref);
+	return mbuf;
+}
+
+/*
+ * The buffer is allocated on the first mmap() and referenced by the
+ * endpoint file and by each mapping.  Pages stay valid after munmap(),
+ * so a transfer still in flight cannot scribble over memory that has
+ * been reused, and mappings that outlive the function keep theirs.
+ */
+static void ffs_epfile_vm_open(struct vm_area_struct *vma)
+{
+	struct ffs_mmap_buf *mbuf = vma->vm_private_data;
+
+	kref_get(&mbuf->ref);
+}
+
+static void ffs_epfile_vm_close(struct vm_area_struct *vma)
+{
+	ffs_mmap_buf_put(vma->vm_private_data);
+}
+
+static const struct vm_operations_struct ffs_epfile_vm_ops = {
+	.open =		ffs_epfile_vm_open,
+	.close =	ffs_epfile_vm_close,
+};
+
+static int ffs_epfile_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct ffs_epfile *epfile = file->private_data;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	struct ffs_mmap_buf *mbuf, *old;
+	unsigned long off;
+	int ret;
+
+	ENTER();
+
+	if (!(vma->vm_flags & VM_SHARED) ||
+	    vma->vm_pgoff >= FFS_MMAP_MAX >> PAGE_SHIFT)
+		return -EINVAL;
+	off = vma->vm_pgoff << PAGE_SHIFT;
+	if (size > FFS_MMAP_MAX - off)
+		return -EINVAL;
+
+	/*
+	 * epfile->mutex is held across copy_{to,from}_user(), which may
+	 * take mmap_sem; we are called with mmap_sem held, so the buffer
+	 * is installed with cmpxchg() instead.
+	 */
+	mbuf = ACCESS_ONCE(epfile->mmap_buf);
+	if (!mbuf) {
+		mbuf = ffs_mmap_buf_alloc(PAGE_ALIGN(off + size));
+		if (unlikely(!mbuf))
+			return -ENOMEM;
+		old = cmpxchg(&epfile->mmap_buf, NULL, mbuf);
+		if (old) {
+			ffs_mmap_buf_put(mbuf);
+			mbuf = old;
+		}
+	}
+	if (off + size > mbuf->len)
+		return -EINVAL;
+
+	vma->vm_flags |= VM_DONTEXPAND | VM_RESERVED;
+	ret = remap_pfn_range(vma, vma->vm_start,
+			      virt_to_phys(mbuf->data + off) >> PAGE_SHIFT,
+			      size, vma->vm_page_prot);
+	if (unlikely(ret))
+		return ret;
+
+	vma->vm_ops = &ffs_epfile_vm_ops;
+	vma->vm_private_data = mbuf;
+	kref_get(&mbuf->ref);
+	return 0;
+}
+
 static int
 ffs_epfile_open(struct inode *inode, struct file *file)
 {
@@ -956,6 +1331,9 @@ static const struct file_operations ffs_epfile_operations = {
 	.open =		ffs_epfile_open,
 	.write =	ffs_epfile_write,
 	.read =		ffs_epfile_read,
+	.aio_write =	ffs_epfile_aio_write,
+	.aio_read =	ffs_epfile_aio_read,
+	.mmap =		ffs_epfile_mmap,
 	.release =	ffs_epfile_release,
 	.unlocked_ioctl =	ffs_epfile_ioctl,
 };
@@ -1452,6 +1830,8 @@ static void ffs_epfiles_destroy(struct ffs_epfile *epfiles, unsigned count)
 			dput(epfile->dentry);
 			epfile->dentry = NULL;
 		}
+		if (epfile->mmap_buf)
+			ffs_mmap_buf_put(epfile->mmap_buf);
 	}
 
 	kfree(epfiles);
@@ -312,6 +312,14 @@ static const char fsg_string_interface[] = "Mass Storage";
 
 #include "storage_common.c"
 
+/*
+ * Number of pipeline buffers.  FSG_NUM_BUFFERS is the least the state
+ * machine works with.
+ */
+static unsigned int fsg_num_buffers = CONFIG_USB_GADGET_STORAGE_NUM_BUFFERS;
+module_param_named(num_buffers, fsg_num_buffers, uint, S_IRUGO);
+MODULE_PARM_DESC(num_buffers, "Number of pipeline buffers");
+
 #ifdef CONFIG_USB_CSW_HACK
 static int write_error_after_csw_sent;
 static int csw_hack_sent;
@@ -366,7 +374,8 @@ struct fsg_common {
 
 	struct fsg_buffhd	*next_buffhd_to_fill;
 	struct fsg_buffhd	*next_buffhd_to_drain;
-	struct fsg_buffhd	buffhds[FSG_NUM_BUFFERS];
+	struct fsg_buffhd	*buffhds;
+	unsigned int		num_buffers;
 
 	int			cmnd_size;
 	u8			cmnd[MAX_COMMAND_SIZE];
@@ -740,6 +749,58 @@ static int sleep_thread(struct fsg_common *common)
 
 /*-------------------------------------------------------------------------*/
 
+/*
+ * The host caches the medium itself, so a second copy in our page cache
+ * only costs memory, and dirty pages piling up there end in long
+ * writeback stalls.  Sequential streams are therefore dropped from the
+ * page cache every FSG_CACHE_WINDOW bytes; writes additionally get their
+ * writeback started early, one window ahead of the drop.  Only clean,
+ * unlocked pages are ever dropped.
+ */
+#define FSG_CACHE_WINDOW	(1024 * 1024)
+
+static void fsg_lun_drop_cache(struct fsg_lun *curlun, loff_t start,
+			       loff_t end)
+{
+	pgoff_t first = (start + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
+	pgoff_t last = end >> PAGE_CACHE_SHIFT;
+
+	/* only whole pages, the neighbours may still be in use */
+	if (last > first)
+		invalidate_mapping_pages(curlun->filp->f_mapping,
+					 first, last - 1);
+}
+
+static void fsg_lun_read_behind(struct fsg_lun *curlun, loff_t offset,
+				unsigned int amount)
+{
+	if (offset != curlun->rb_end)
+		curlun->rb_start = offset;
+	curlun->rb_end = offset + amount;
+
+	if (curlun->rb_end - curlun->rb_start >= FSG_CACHE_WINDOW) {
+		fsg_lun_drop_cache(curlun, curlun->rb_start, curlun->rb_end);
+		curlun->rb_start = curlun->rb_end;
+	}
+}
+
+static void fsg_lun_write_behind(struct fsg_lun *curlun, loff_t offset,
+				 unsigned int amount)
+{
+	if (offset != curlun->wb_end)
+		curlun->wb_prev = curlun->wb_start = offset;
+	curlun->wb_end = offset + amount;
+
+	if (curlun->wb_end - curlun->wb_start >= FSG_CACHE_WINDOW) {
+		/* writeback of the previous window should be done by now */
+		fsg_lun_drop_cache(curlun, curlun->wb_prev, curlun->wb_start);
+		filemap_fdatawrite_range(curlun->filp->f_mapping,
+					 curlun->wb_start, curlun->wb_end - 1);
+		curlun->wb_prev = curlun->wb_start;
+		curlun->wb_start = curlun->wb_end;
+	}
+}
+
 static int do_read(struct fsg_common *common)
 {
 	struct fsg_lun		*curlun = common->curlun;
@@ -853,6 +914,7 @@ static int do_read(struct fsg_common *common)
 			     (int)nread, amount);
 			nread -= (nread & 511);	/* Round down to a block */
 		}
+		fsg_lun_read_behind(curlun, file_offset, nread);
 		file_offset  += nread;
 		amount_left  -= nread;
 		common->residue -= nread;
@@ -1078,6 +1140,7 @@ static int do_write(struct fsg_common *common)
 				nwritten -= (nwritten & 511);
 				/* Round down to a block */
 			}
+			fsg_lun_write_behind(curlun, file_offset, nwritten);
 			file_offset += nwritten;
 			amount_left_to_write -= nwritten;
 			common->residue -= nwritten;
@@ -1106,12 +1169,13 @@ write_error:
 				 * yet from the host. So there is no point in
 				 * csw right away without the complete data.
 				 */
-				for (i = 0; i < FSG_NUM_BUFFERS; i++) {
+				for (i = 0; i < common->num_buffers; i++) {
 					if (common->buffhds[i].state ==
 							BUF_STATE_BUSY)
 						break;
 				}
-				if (!amount_left_to_req && i == FSG_NUM_BUFFERS) {
+				if (!amount_left_to_req &&
+				    i == common->num_buffers) {
 					csw_hack_sent = 1;
 					send_status(common);
 				}
@@ -2441,7 +2505,7 @@ reset:
 	if (common->fsg) {
 		fsg = common->fsg;
 
-		for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+		for (i = 0; i < common->num_buffers; ++i) {
 			struct fsg_buffhd *bh = &common->buffhds[i];
 
 			if (bh->inreq) {
@@ -2468,7 +2532,7 @@ reset:
 
 
 	/* Allocate the requests */
-	for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+	for (i = 0; i < common->num_buffers; ++i) {
 		struct fsg_buffhd	*bh = &common->buffhds[i];
 
 		rc = alloc_request(common, fsg->bulk_in, &bh->inreq);
@@ -2572,7 +2636,7 @@ static void handle_exception(struct fsg_common *common)
 
 	/* Cancel all the pending transfers */
 	if (likely(common->fsg)) {
-		for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+		for (i = 0; i < common->num_buffers; ++i) {
 			bh = &common->buffhds[i];
 			if (bh->inreq_busy)
 				usb_ep_dequeue(common->fsg->bulk_in, bh->inreq);
@@ -2584,7 +2648,7 @@ static void handle_exception(struct fsg_common *common)
 		/* Wait until everything is idle */
 		for (;;) {
 			int num_active = 0;
-			for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+			for (i = 0; i < common->num_buffers; ++i) {
 				bh = &common->buffhds[i];
 				num_active += bh->inreq_busy + bh->outreq_busy;
 			}
@@ -2607,7 +2671,7 @@ static void handle_exception(struct fsg_common *common)
 	 */
 	spin_lock_irq(&common->lock);
 
-	for (i = 0; i < FSG_NUM_BUFFERS; ++i) {
+	for (i = 0; i < common->num_buffers; ++i) {
 		bh = &common->buffhds[i];
 		bh->state = BUF_STATE_EMPTY;
 	}
@@ -2928,8 +2992,16 @@ static struct fsg_common *fsg_common_init(struct fsg_common *common,
 	common->nluns = nluns;
 
 	/* Data buffers cyclic list */
+	common->num_buffers = clamp_t(unsigned int, fsg_num_buffers,
+				      FSG_NUM_BUFFERS, 32);
+	common->buffhds = kcalloc(common->num_buffers,
+				  sizeof *common->buffhds, GFP_KERNEL);
+	if (unlikely(!common->buffhds)) {
+		rc = -ENOMEM;
+		goto error_release;
+	}
 	bh = common->buffhds;
-	i = FSG_NUM_BUFFERS;
+	i = common->num_buffers;
 	goto buffhds_first_it;
 	do {
 		bh->next = bh + 1;
@@ -3056,12 +3128,13 @@ static void fsg_common_release(struct kref *ref)
 		kfree(common->luns);
 	}
 
-	{
+	if (likely(common->buffhds)) {
 		struct fsg_buffhd *bh = common->buffhds;
-		unsigned i = FSG_NUM_BUFFERS;
+		unsigned i = common->num_buffers;
 		do {
 			kfree(bh->buf);
 		} while (++bh, --i);
+		kfree(common->buffhds);
 	}
 
 	if (common->free_storage_on_release)
@@ -49,11 +49,36 @@
 #define STATE_CANCELED              3   /* transaction canceled by host */
 #define STATE_ERROR                 4   /* error from completion routine */
 
-/* number of tx and rx requests to allocate */
-#define TX_REQ_MAX 4
-#define RX_REQ_MAX 2
+/* number of tx and rx requests to allocate when the large buffers
+ * asked for by the module parameters below cannot be had
+ */
+#define TX_REQ_MIN 4
+#define RX_REQ_MIN 2
+/* upper bounds for mtp_tx_reqs and mtp_rx_reqs */
+#define TX_REQ_MAX 32
+#define RX_REQ_MAX 8
 #define INTR_REQ_MAX 5
 
+/* Bulk request sizing, picked up at the next bind.  Deeper queues of
+ * larger buffers keep the bus busy while the file I/O for the next
+ * buffer runs.
+ */
+static unsigned int mtp_tx_req_len = 65536;
+module_param(mtp_tx_req_len, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mtp_tx_req_len, "Size of each bulk IN request buffer");
+
+static unsigned int mtp_tx_reqs = 8;
+module_param(mtp_tx_reqs, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mtp_tx_reqs, "Number of bulk IN requests");
+
+static unsigned int mtp_rx_req_len = 65536;
+module_param(mtp_rx_req_len, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mtp_rx_req_len, "Size of each bulk OUT request buffer");
+
+static unsigned int mtp_rx_reqs = 4;
+module_param(mtp_rx_reqs, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mtp_rx_reqs, "Number of bulk OUT requests");
+
 /* ID for Microsoft MTP OS String */
 #define MTP_OS_STRING_ID   0xEE
 
@@ -92,7 +117,14 @@ struct mtp_dev {
 	wait_queue_head_t write_wq;
 	wait_queue_head_t intr_wq;
 	struct usb_request *rx_req[RX_REQ_MAX];
-	int rx_done;
+	/* bulk OUT completions since the last reset */
+	unsigned rx_done;
+
+	/* bulk request sizing in use since bind */
+	unsigned tx_req_len;
+	unsigned tx_reqs;
+	unsigned rx_req_len;
+	unsigned rx_reqs;
 
 	/* for processing MTP_SEND_FILE, MTP_RECEIVE_FILE and
 	 * MTP_SEND_FILE_WITH_HEADER ioctls on a work queue
@@ -361,7 +393,7 @@ static void mtp_complete_out(struct usb_ep *ep, struct usb_request *req)
 {
 	struct mtp_dev *dev = _mtp_dev;
 
-	dev->rx_done = 1;
+	dev->rx_done++;
 	if (req->status != 0)
 		dev->state = STATE_ERROR;
 
@@ -429,17 +461,22 @@ static int mtp_create_bulk_endpoints(struct mtp_dev *dev,
 	dev->ep_intr = ep;
 
 	/* now allocate requests for our endpoints */
-	for (i = 0; i < TX_REQ_MAX; i++) {
-		req = mtp_request_new(dev->ep_in, MTP_BULK_BUFFER_SIZE);
+	dev->tx_req_len = max_t(unsigned, mtp_tx_req_len, MTP_BULK_BUFFER_SIZE);
+	dev->tx_reqs = clamp_t(unsigned, mtp_tx_reqs, 1, TX_REQ_MAX);
+	dev->rx_req_len = max_t(unsigned, mtp_rx_req_len, MTP_BULK_BUFFER_SIZE);
+	dev->rx_reqs = clamp_t(unsigned, mtp_rx_reqs, 1, RX_REQ_MAX);
+retry_alloc:
+	for (i = 0; i < dev->tx_reqs; i++) {
+		req = mtp_request_new(dev->ep_in, dev->tx_req_len);
 		if (!req)
-			goto fail;
+			goto fail_bulk;
 		req->complete = mtp_complete_in;
 		mtp_req_put(dev, &dev->tx_idle, req);
 	}
-	for (i = 0; i < RX_REQ_MAX; i++) {
-		req = mtp_request_new(dev->ep_out, MTP_BULK_BUFFER_SIZE);
+	for (i = 0; i < dev->rx_reqs; i++) {
+		req = mtp_request_new(dev->ep_out, dev->rx_req_len);
 		if (!req)
-			goto fail;
+			goto fail_bulk;
 		req->complete = mtp_complete_out;
 		dev->rx_req[i] = req;
 	}
@@ -453,6 +490,23 @@ static int mtp_create_bulk_endpoints(struct mtp_dev *dev,
 
 	return 0;
 
+fail_bulk:
+	while ((req = mtp_req_get(dev, &dev->tx_idle)))
+		mtp_request_free(req, dev->ep_in);
+	for (i = 0; i < RX_REQ_MAX; i++) {
+		mtp_request_free(dev->rx_req[i], dev->ep_out);
+		dev->rx_req[i] = NULL;
+	}
+	if (dev->tx_req_len > MTP_BULK_BUFFER_SIZE ||
+	    dev->rx_req_len > MTP_BULK_BUFFER_SIZE) {
+		/* large buffers are higher order allocations, fall back */
+		printk(KERN_WARNING "mtp_bind() falling back to %d byte requests\n",
+			MTP_BULK_BUFFER_SIZE);
+		dev->tx_req_len = dev->rx_req_len = MTP_BULK_BUFFER_SIZE;
+		dev->tx_reqs = TX_REQ_MIN;
+		dev->rx_reqs = RX_REQ_MIN;
+		goto retry_alloc;
+	}
 fail:
 	printk(KERN_ERR "mtp_bind() could not allocate requests\n");
 	return -1;
@@ -469,7 +523,7 @@ static ssize_t mtp_read(struct file *fp, char __user *buf,
 
 	DBG(cdev, "mtp_read(%d)\n", count);
 
-	if (count > MTP_BULK_BUFFER_SIZE)
+	if (count > dev->rx_req_len)
 		return -EINVAL;
 
 	/* we will block until we're online */
@@ -589,8 +643,8 @@ static ssize_t mtp_write(struct file *fp, const char __user *buf,
 			break;
 		}
 
-		if (count > MTP_BULK_BUFFER_SIZE)
-			xfer = MTP_BULK_BUFFER_SIZE;
+		if (count > dev->tx_req_len)
+			xfer = dev->tx_req_len;
 		else
 			xfer = count;
 		if (xfer && copy_from_user(req->buf, buf, xfer)) {
@@ -681,8 +735,8 @@ static void send_file_work(struct work_struct *data) {
 			break;
 		}
 
-		if (count > MTP_BULK_BUFFER_SIZE)
-			xfer = MTP_BULK_BUFFER_SIZE;
+		if (count > dev->tx_req_len)
+			xfer = dev->tx_req_len;
 		else
 			xfer = count;
 
@@ -727,16 +781,31 @@ static void send_file_work(struct work_struct *data) {
 	smp_wmb();
 }
 
+/* dequeue the bulk OUT requests queued as [tail, head) and wait for them
+ * to be given back, so their buffers can be reused
+ */
+static void mtp_rx_flush(struct mtp_dev *dev, unsigned tail, unsigned head)
+{
+	unsigned i;
+
+	if (tail == head)
+		return;
+	for (i = tail; i != head; i++)
+		usb_ep_dequeue(dev->ep_out, dev->rx_req[i % dev->rx_reqs]);
+	wait_event_timeout(dev->read_wq, (int)(dev->rx_done - head) >= 0, HZ);
+}
+
 /* read from USB and write to a local file */
 static void receive_file_work(struct work_struct *data)
 {
 	struct mtp_dev	*dev = container_of(data, struct mtp_dev, receive_file_work);
 	struct usb_composite_dev *cdev = dev->cdev;
-	struct usb_request *read_req = NULL, *write_req = NULL;
+	struct usb_request *req;
 	struct file *filp;
 	loff_t offset;
-	int64_t count;
-	int ret, cur_buf = 0;
+	int64_t count, unqueued;
+	unsigned head = 0, tail = 0, depth;
+	int ret;
 	int r = 0;
 
 	/* read our parameters */
@@ -747,62 +816,66 @@ static void receive_file_work(struct work_struct *data)
 
 	DBG(cdev, "receive_file_work(%lld)\n", count);
 
-	while (count > 0 || write_req) {
-		if (count > 0) {
-			/* queue a request */
-			read_req = dev->rx_req[cur_buf];
-			cur_buf = (cur_buf + 1) % RX_REQ_MAX;
+	/* Keep up to rx_reqs reads queued and write out the oldest while
+	 * the others fill.  If xfer_file_length is 0xFFFFFFFF we read until
+	 * we get a short packet, and a read queued behind that packet would
+	 * swallow the next container, so only one read is queued then.
+	 */
+	depth = count == 0xFFFFFFFF ? 1 : dev->rx_reqs;
+	unqueued = count;
+	dev->rx_done = 0;
 
-			read_req->length = (count > MTP_BULK_BUFFER_SIZE
-					? MTP_BULK_BUFFER_SIZE : count);
-			dev->rx_done = 0;
-			ret = usb_ep_queue(dev->ep_out, read_req, GFP_KERNEL);
+	for (;;) {
+		while (unqueued > 0 && head - tail < depth) {
+			req = dev->rx_req[head % dev->rx_reqs];
+			req->length = min_t(int64_t, unqueued, dev->rx_req_len);
+			ret = usb_ep_queue(dev->ep_out, req, GFP_KERNEL);
 			if (ret < 0) {
 				r = -EIO;
 				dev->state = STATE_ERROR;
-				break;
+				goto flush;
 			}
+			if (count != 0xFFFFFFFF)
+				unqueued -= req->length;
+			head++;
 		}
+		if (tail == head)
+			break;
 
-		if (write_req) {
-			DBG(cdev, "rx %p %d\n", write_req, write_req->actual);
-			ret = vfs_write(filp, write_req->buf, write_req->actual,
-				&offset);
-			DBG(cdev, "vfs_write %d\n", ret);
-			if (ret != write_req->actual) {
-				r = -EIO;
-				dev->state = STATE_ERROR;
-				break;
-			}
-			write_req = NULL;
+		/* wait for the oldest read to complete */
+		req = dev->rx_req[tail % dev->rx_reqs];
+		ret = wait_event_interruptible(dev->read_wq,
+			(int)(dev->rx_done - tail) > 0 ||
+			dev->state != STATE_BUSY);
+		if (dev->state == STATE_CANCELED) {
+			r = -ECANCELED;
+			goto flush;
+		}
+		if ((int)(dev->rx_done - tail) <= 0 || req->status) {
+			r = ret ? ret : -EIO;
+			goto flush;
 		}
+		tail++;
 
-		if (read_req) {
-			/* wait for our last read to complete */
-			ret = wait_event_interruptible(dev->read_wq,
-				dev->rx_done || dev->state != STATE_BUSY);
-			if (dev->state == STATE_CANCELED) {
-				r = -ECANCELED;
-				if (!dev->rx_done)
-					usb_ep_dequeue(dev->ep_out, read_req);
-				break;
-			}
-			/* if xfer_file_length is 0xFFFFFFFF, then we read until
-			 * we get a zero length packet
-			 */
-			if (count != 0xFFFFFFFF)
-				count -= read_req->actual;
-			if (read_req->actual < read_req->length) {
-				/* short packet is used to signal EOF for sizes > 4 gig */
-				DBG(cdev, "got short packet\n");
-				count = 0;
-			}
+		DBG(cdev, "rx %p %d\n", req, req->actual);
+		ret = vfs_write(filp, req->buf, req->actual, &offset);
+		DBG(cdev, "vfs_write %d\n", ret);
+		if (ret != req->actual) {
+			r = -EIO;
+			dev->state = STATE_ERROR;
+			goto flush;
+		}
 
-			write_req = read_req;
-			read_req = NULL;
+		if (req->actual < req->length) {
+			/* short packet is used to signal EOF for sizes > 4 gig */
+			DBG(cdev, "got short packet\n");
+			break;
 		}
 	}
 
+flush:
+	mtp_rx_flush(dev, tail, head);
+
 	DBG(cdev, "receive_file_work returning %d\n", r);
 	/* write the result */
 	dev->xfer_result = r;
@@ -1117,8 +1190,10 @@ mtp_function_unbind(struct usb_configuration *c, struct usb_function *f)
 
 	while ((req = mtp_req_get(dev, &dev->tx_idle)))
 		mtp_request_free(req, dev->ep_in);
-	for (i = 0; i < RX_REQ_MAX; i++)
+	for (i = 0; i < RX_REQ_MAX; i++) {
 		mtp_request_free(dev->rx_req[i], dev->ep_out);
+		dev->rx_req[i] = NULL;
+	}
 	while ((req = mtp_req_get(dev, &dev->intr_idle)))
 		mtp_request_free(req, dev->ep_intr);
 	dev->state = STATE_OFFLINE;
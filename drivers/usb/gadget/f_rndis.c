@@ -100,6 +100,12 @@ struct f_rndis {
 	atomic_t			notify_count;
 };
 
+/* Frames packed into one IN transfer when the host is busy; 1 disables */
+static unsigned int rndis_dl_max_pkt_per_xfer = 3;
+module_param(rndis_dl_max_pkt_per_xfer, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(rndis_dl_max_pkt_per_xfer,
+	"Maximum packets per transfer for DL aggregation");
+
 static inline struct f_rndis *func_to_rndis(struct usb_function *f)
 {
 	return container_of(f, struct f_rndis, port.func);
@@ -398,6 +404,8 @@ static void rndis_command_complete(struct usb_ep *ep, struct usb_request *req)
 	if (status < 0)
 		ERROR(cdev, "RNDIS command error %d, %d/%d\n",
 			status, req->actual, req->length);
+	rndis->port.dl_max_xfer_size =
+		rndis_get_dl_max_xfer_size(rndis->config);
 //	spin_unlock(&dev->lock);
 }
 
@@ -514,6 +522,10 @@ static int rndis_set_alt(struct usb_function *f, unsigned intf, unsigned alt)
 		/* Avoid ZLPs; they can be troublesome. */
 		rndis->port.is_zlp_ok = false;
 
+		/* the host reports its limit in REMOTE_NDIS_INITIALIZE_MSG */
+		rndis->port.dl_max_pkts_per_xfer = rndis_dl_max_pkt_per_xfer;
+		rndis->port.dl_max_xfer_size = 0;
+
 		/* RNDIS should be in the "RNDIS uninitialized" state,
 		 * either never activated or after rndis_uninit().
 		 *
@@ -605,6 +605,9 @@ static int rndis_init_response(int configNr, rndis_init_msg_type *buf)
 	resp->MinorVersion = cpu_to_le32(RNDIS_MINOR_VERSION);
 	resp->DeviceFlags = cpu_to_le32(RNDIS_DF_CONNECTIONLESS);
 	resp->Medium = cpu_to_le32(RNDIS_MEDIUM_802_3);
+	/* bounds the size of the device's multi-packet IN transfers */
+	params->dl_max_xfer_size = le32_to_cpu(buf->MaxTransferSize);
+
 	resp->MaxPacketsPerTransfer = cpu_to_le32(1);
 	resp->MaxTransferSize = cpu_to_le32(
 		  params->dev->mtu
@@ -799,6 +802,7 @@ void rndis_uninit(int configNr)
 	if (configNr >= RNDIS_MAX_CONFIGS)
 		return;
 	rndis_per_dev_params[configNr].state = RNDIS_UNINITIALIZED;
+	rndis_per_dev_params[configNr].dl_max_xfer_size = 0;
 
 	/* drain the response queue */
 	while ((buf = rndis_get_next_response(configNr, &length)))
@@ -810,6 +814,14 @@ void rndis_set_host_mac(int configNr, const u8 *addr)
 	rndis_per_dev_params[configNr].host_mac = addr;
 }
 
+/* MaxTransferSize of the host, zero until it sent REMOTE_NDIS_INITIALIZE_MSG */
+u32 rndis_get_dl_max_xfer_size(u8 configNr)
+{
+	if (configNr >= RNDIS_MAX_CONFIGS)
+		return 0;
+	return rndis_per_dev_params[configNr].dl_max_xfer_size;
+}
+
 /*
  * Message Parser
  */
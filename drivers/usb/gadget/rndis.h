@@ -229,6 +229,7 @@ typedef struct rndis_params
 	u32			medium;
 	u32			speed;
 	u32			media_state;
+	u32			dl_max_xfer_size;
 
 	const u8		*host_mac;
 	u16			*filter;
@@ -261,6 +262,7 @@ int  rndis_signal_connect (int configNr);
 int  rndis_signal_disconnect (int configNr);
 int  rndis_state (int configNr);
 extern void rndis_set_host_mac (int configNr, const u8 *addr);
+u32  rndis_get_dl_max_xfer_size(u8 configNr);
 
 int rndis_init(void);
 void rndis_exit (void);
@@ -247,6 +247,10 @@ struct fsg_lun {
 	u32		sense_data_info;
 	u32		unit_attention_data;
 
+	/* sequential streams whose page cache is dropped behind */
+	loff_t		rb_start, rb_end;
+	loff_t		wb_prev, wb_start, wb_end;
+
 	struct device	dev;
 #ifdef CONFIG_USB_MSC_PROFILING
 	spinlock_t	lock;
@@ -24,6 +24,7 @@
 
 #include <linux/kernel.h>
 #include <linux/gfp.h>
+#include <linux/slab.h>
 #include <linux/device.h>
 #include <linux/ctype.h>
 #include <linux/etherdevice.h>
@@ -70,6 +71,13 @@ struct eth_dev {
 	atomic_t		tx_qlen;
 
 	struct sk_buff_head	rx_frames;
+	struct napi_struct	napi;
+
+	/* multi-packet IN transfers, see eth_start_xmit_agg() */
+	unsigned		tx_agg_bufsize;	/* zero when not aggregating */
+	unsigned		tx_agg_frame;	/* largest wrapped frame */
+	unsigned		tx_agg_pkts;
+	struct usb_request	*tx_agg_req;	/* being filled, or NULL */
 
 	unsigned		header_len;
 	struct sk_buff		*(*wrap)(struct gether *, struct sk_buff *skb);
@@ -92,6 +100,8 @@ struct eth_dev {
 
 #define DEFAULT_QLEN	2	/* double buffering by default */
 
+#define ETH_NAPI_WEIGHT	64
+
 
 #ifdef CONFIG_USB_GADGET_DUALSPEED
 
@@ -280,53 +290,46 @@ static void rx_complete(struct usb_ep *ep, struct usb_request *req)
 	struct sk_buff	*skb = req->context, *skb2;
 	struct eth_dev	*dev = ep->driver_data;
 	int		status = req->status;
+	struct sk_buff_head	frames;
+	unsigned long	flags;
 
 	switch (status) {
 
 	/* normal completion */
 	case 0:
 		skb_put(skb, req->actual);
+		skb_queue_head_init(&frames);
 
 		if (dev->unwrap) {
-			unsigned long	flags;
-
 			spin_lock_irqsave(&dev->lock, flags);
 			if (dev->port_usb) {
 				status = dev->unwrap(dev->port_usb,
 							skb,
-							&dev->rx_frames);
+							&frames);
 			} else {
 				dev_kfree_skb_any(skb);
 				status = -ENOTCONN;
 			}
 			spin_unlock_irqrestore(&dev->lock, flags);
 		} else {
-			skb_queue_tail(&dev->rx_frames, skb);
+			__skb_queue_tail(&frames, skb);
 		}
 		skb = NULL;
 
-		skb2 = skb_dequeue(&dev->rx_frames);
-		while (skb2) {
-			if (status < 0
-					|| ETH_HLEN > skb2->len
-					|| skb2->len > ETH_FRAME_LEN) {
-				dev->net->stats.rx_errors++;
-				dev->net->stats.rx_length_errors++;
-				DBG(dev, "rx length %d\n", skb2->len);
+		if (status < 0) {
+			while ((skb2 = __skb_dequeue(&frames)) != NULL)
 				dev_kfree_skb_any(skb2);
-				goto next_frame;
-			}
-			skb2->protocol = eth_type_trans(skb2, dev->net);
-			dev->net->stats.rx_packets++;
-			dev->net->stats.rx_bytes += skb2->len;
-
-			/* no buffer copies needed, unless hardware can't
-			 * use skb buffers.
-			 */
-			status = netif_rx(skb2);
-next_frame:
-			skb2 = skb_dequeue(&dev->rx_frames);
+			dev->net->stats.rx_errors++;
+			dev->net->stats.rx_length_errors++;
+			DBG(dev, "rx unwrap %d\n", status);
+			break;
 		}
+
+		/* hand the frames to gether_poll(), which feeds them to GRO */
+		spin_lock_irqsave(&dev->rx_frames.lock, flags);
+		skb_queue_splice_tail_init(&frames, &dev->rx_frames);
+		spin_unlock_irqrestore(&dev->rx_frames.lock, flags);
+		napi_schedule(&dev->napi);
 		break;
 
 	/* software-driven interface shutdown */
@@ -367,6 +370,44 @@ clean:
 		rx_submit(dev, req, GFP_ATOMIC);
 }
 
+static int gether_poll(struct napi_struct *napi, int budget)
+{
+	struct eth_dev	*dev = container_of(napi, struct eth_dev, napi);
+	struct sk_buff	*skb;
+	int		work_done = 0;
+
+	while (work_done < budget) {
+		skb = skb_dequeue(&dev->rx_frames);
+		if (!skb)
+			break;
+		work_done++;
+
+		if (ETH_HLEN > skb->len || skb->len > ETH_FRAME_LEN) {
+			dev->net->stats.rx_errors++;
+			dev->net->stats.rx_length_errors++;
+			DBG(dev, "rx length %d\n", skb->len);
+			dev_kfree_skb(skb);
+			continue;
+		}
+		skb->protocol = eth_type_trans(skb, dev->net);
+		dev->net->stats.rx_packets++;
+		dev->net->stats.rx_bytes += skb->len;
+
+		/* no buffer copies needed, unless hardware can't
+		 * use skb buffers.
+		 */
+		napi_gro_receive_csum(napi, skb);
+	}
+
+	if (work_done < budget) {
+		napi_complete(napi);
+		/* rx_complete() may have queued more after the last dequeue */
+		if (!skb_queue_empty(&dev->rx_frames))
+			napi_schedule(napi);
+	}
+	return work_done;
+}
+
 static int prealloc(struct list_head *list, struct usb_ep *ep, unsigned n)
 {
 	unsigned		i;
@@ -425,6 +466,46 @@ done:
 	return status;
 }
 
+static void tx_complete(struct usb_ep *ep, struct usb_request *req);
+
+/* Give each IN request a buffer that several frames can be copied into;
+ * without them, every frame goes out in its own transfer.
+ */
+static void alloc_tx_agg(struct eth_dev *dev, struct gether *link)
+{
+	struct usb_request	*req;
+	unsigned		frame, size;
+	void			*buf;
+
+	frame = dev->net->mtu + ETH_HLEN + link->header_len;
+	size = link->dl_max_pkts_per_xfer * frame + 1;	/* + zlp pad */
+
+	spin_lock(&dev->req_lock);
+	list_for_each_entry(req, &dev->tx_reqs, list) {
+		buf = kmalloc(size, GFP_ATOMIC);
+		if (!buf)
+			goto fail;
+		req->buf = buf;
+		req->length = 0;
+		req->context = NULL;
+		req->complete = tx_complete;
+	}
+	dev->tx_agg_req = NULL;
+	dev->tx_agg_frame = frame;
+	dev->tx_agg_bufsize = size;
+	spin_unlock(&dev->req_lock);
+	DBG(dev, "tx aggregation, %u bytes per transfer\n", size - 1);
+	return;
+
+fail:
+	list_for_each_entry_continue_reverse(req, &dev->tx_reqs, list) {
+		kfree(req->buf);
+		req->buf = NULL;
+	}
+	spin_unlock(&dev->req_lock);
+	DBG(dev, "no tx aggregation buffers\n");
+}
+
 static void rx_fill(struct eth_dev *dev, gfp_t gfp_flags)
 {
 	struct usb_request	*req;
@@ -461,11 +542,16 @@ static void eth_work(struct work_struct *work)
 		DBG(dev, "work done, flags = 0x%lx\n", dev->todo);
 }
 
+static void eth_queue_agg(struct eth_dev *dev, struct usb_ep *in,
+		struct usb_request *req);
+
 static void tx_complete(struct usb_ep *ep, struct usb_request *req)
 {
-	struct sk_buff	*skb = req->context;
-	struct eth_dev	*dev = ep->driver_data;
+	struct sk_buff		*skb = req->context;
+	struct eth_dev		*dev = ep->driver_data;
+	struct usb_request	*held = NULL;
 
+	/* aggregated transfers (no skb) were counted as they were filled */
 	switch (req->status) {
 	default:
 		dev->net->stats.tx_errors++;
@@ -475,16 +561,29 @@ static void tx_complete(struct usb_ep *ep, struct usb_request *req)
 	case -ESHUTDOWN:		/* disconnect etc */
 		break;
 	case 0:
-		dev->net->stats.tx_bytes += skb->len;
+		if (skb)
+			dev->net->stats.tx_bytes += skb->len;
 	}
-	dev->net->stats.tx_packets++;
+	if (skb)
+		dev->net->stats.tx_packets++;
 
 	spin_lock(&dev->req_lock);
+	req->length = 0;
 	list_add(&req->list, &dev->tx_reqs);
+	atomic_dec(&dev->tx_qlen);
+
+	/* frames copied in while this transfer was queued go out now */
+	if (dev->tx_agg_req && req->status != -ESHUTDOWN) {
+		held = dev->tx_agg_req;
+		dev->tx_agg_req = NULL;
+	}
 	spin_unlock(&dev->req_lock);
-	dev_kfree_skb_any(skb);
+	if (skb)
+		dev_kfree_skb_any(skb);
+
+	if (held)
+		eth_queue_agg(dev, ep, held);
 
-	atomic_dec(&dev->tx_qlen);
 	if (netif_carrier_ok(dev->net))
 		netif_wake_queue(dev->net);
 }
@@ -494,6 +593,121 @@ static inline int is_promisc(u16 cdc_filter)
 	return cdc_filter & USB_CDC_PACKET_TYPE_PROMISCUOUS;
 }
 
+/* Queue an IN request filled by eth_start_xmit_agg() */
+static void eth_queue_agg(struct eth_dev *dev, struct usb_ep *in,
+		struct usb_request *req)
+{
+	unsigned long	flags;
+	int		retval;
+
+	/* same zlp framing as eth_start_xmit(); the buffer has room for
+	 * the pad byte.  Completions drive the flushing of held frames,
+	 * so don't let the controller batch their interrupts.
+	 */
+	req->zero = 1;
+	if (!dev->zlp && (req->length % in->maxpacket) == 0)
+		req->length++;
+	req->no_interrupt = 0;
+
+	retval = usb_ep_queue(in, req, GFP_ATOMIC);
+	if (retval) {
+		DBG(dev, "tx queue err %d\n", retval);
+		dev->net->stats.tx_dropped++;
+		spin_lock_irqsave(&dev->req_lock, flags);
+		if (list_empty(&dev->tx_reqs))
+			netif_start_queue(dev->net);
+		req->length = 0;
+		list_add(&req->list, &dev->tx_reqs);
+		spin_unlock_irqrestore(&dev->req_lock, flags);
+		return;
+	}
+	dev->net->trans_start = jiffies;
+	atomic_inc(&dev->tx_qlen);
+}
+
+/*
+ * Copy frames into a shared IN transfer, for functions (RNDIS) whose host
+ * accepts several frames per transfer.  The request being filled is sent
+ * once it can't take another frame or when no transfer is queued ahead of
+ * it; otherwise tx_complete() sends it.  So frames only wait while the
+ * host is still reading earlier ones, and an idle link adds no latency.
+ */
+static netdev_tx_t eth_start_xmit_agg(struct eth_dev *dev,
+		struct sk_buff *skb, struct usb_ep *in,
+		u32 max_pkts, u32 max_size)
+{
+	struct net_device	*net = dev->net;
+	struct usb_request	*req;
+	unsigned long		flags;
+	bool			send;
+
+	/* until the host reports its transfer size, one frame per transfer */
+	if (!max_size)
+		max_pkts = 1;
+	max_size = min_t(u32, max_size, dev->tx_agg_bufsize - 1);
+
+	spin_lock_irqsave(&dev->req_lock, flags);
+	if (!dev->tx_agg_req && list_empty(&dev->tx_reqs)) {
+		spin_unlock_irqrestore(&dev->req_lock, flags);
+		return NETDEV_TX_BUSY;
+	}
+	spin_unlock_irqrestore(&dev->req_lock, flags);
+
+	if (dev->wrap) {
+		spin_lock_irqsave(&dev->lock, flags);
+		if (dev->port_usb)
+			skb = dev->wrap(dev->port_usb, skb);
+		spin_unlock_irqrestore(&dev->lock, flags);
+		if (!skb)
+			goto drop;
+	}
+	if (skb->len > dev->tx_agg_frame)
+		goto drop_skb;
+
+	spin_lock_irqsave(&dev->req_lock, flags);
+	req = dev->tx_agg_req;
+	if (!req) {
+		/* emptied by a disconnect since the check above */
+		if (list_empty(&dev->tx_reqs)) {
+			spin_unlock_irqrestore(&dev->req_lock, flags);
+			goto drop_skb;
+		}
+		req = container_of(dev->tx_reqs.next, struct usb_request, list);
+		list_del(&req->list);
+		dev->tx_agg_req = req;
+		dev->tx_agg_pkts = 0;
+	}
+
+	memcpy(req->buf + req->length, skb->data, skb->len);
+	req->length += skb->len;
+	dev->tx_agg_pkts++;
+	net->stats.tx_packets++;
+	net->stats.tx_bytes += skb->len;
+
+	send = dev->tx_agg_pkts >= max_pkts
+		|| req->length + dev->tx_agg_frame > max_size
+		|| atomic_read(&dev->tx_qlen) == 0;
+	if (send) {
+		dev->tx_agg_req = NULL;
+
+		/* temporarily stop TX queue when the freelist empties */
+		if (list_empty(&dev->tx_reqs))
+			netif_stop_queue(net);
+	}
+	spin_unlock_irqrestore(&dev->req_lock, flags);
+	dev_kfree_skb_any(skb);
+
+	if (send)
+		eth_queue_agg(dev, in, req);
+	return NETDEV_TX_OK;
+
+drop_skb:
+	dev_kfree_skb_any(skb);
+drop:
+	net->stats.tx_dropped++;
+	return NETDEV_TX_OK;
+}
+
 static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 					struct net_device *net)
 {
@@ -504,11 +718,14 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 	unsigned long		flags;
 	struct usb_ep		*in;
 	u16			cdc_filter;
+	u32			max_pkts = 0, max_size = 0;
 
 	spin_lock_irqsave(&dev->lock, flags);
 	if (dev->port_usb) {
 		in = dev->port_usb->in_ep;
 		cdc_filter = dev->port_usb->cdc_filter;
+		max_pkts = dev->port_usb->dl_max_pkts_per_xfer;
+		max_size = dev->port_usb->dl_max_xfer_size;
 	} else {
 		in = NULL;
 		cdc_filter = 0;
@@ -542,6 +759,9 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 		/* ignores USB_CDC_PACKET_TYPE_DIRECTED */
 	}
 
+	if (dev->tx_agg_bufsize)
+		return eth_start_xmit_agg(dev, skb, in, max_pkts, max_size);
+
 	spin_lock_irqsave(&dev->req_lock, flags);
 	/*
 	 * this freelist can be empty if an interrupt triggered disconnect()
@@ -647,6 +867,7 @@ static int eth_open(struct net_device *net)
 	struct gether	*link;
 
 	DBG(dev, "%s\n", __func__);
+	napi_enable(&dev->napi);
 	if (netif_carrier_ok(dev->net))
 		eth_start(dev, GFP_KERNEL);
 
@@ -666,6 +887,8 @@ static int eth_stop(struct net_device *net)
 
 	VDBG(dev, "%s\n", __func__);
 	netif_stop_queue(net);
+	napi_disable(&dev->napi);
+	skb_queue_purge(&dev->rx_frames);
 
 	DBG(dev, "stop stats: rx/tx %ld/%ld, errs %ld/%ld\n",
 		dev->net->stats.rx_packets, dev->net->stats.tx_packets,
@@ -804,6 +1027,7 @@ int gether_setup_name(struct usb_gadget *g, u8 ethaddr[ETH_ALEN],
 	INIT_LIST_HEAD(&dev->rx_reqs);
 
 	skb_queue_head_init(&dev->rx_frames);
+	netif_napi_add(net, &dev->napi, gether_poll, ETH_NAPI_WEIGHT);
 
 	/* network device setup */
 	dev->net = net;
@@ -909,6 +1133,9 @@ struct net_device *gether_connect(struct gether *link)
 	if (result == 0)
 		result = alloc_requests(dev, link, qlen(dev->gadget));
 
+	if (result == 0 && link->dl_max_pkts_per_xfer > 1)
+		alloc_tx_agg(dev, link);
+
 	if (result == 0) {
 		dev->zlp = link->is_zlp_ok;
 		DBG(dev, "qlen %d\n", qlen(dev->gadget));
@@ -977,15 +1204,22 @@ void gether_disconnect(struct gether *link)
 	 */
 	usb_ep_disable(link->in_ep);
 	spin_lock(&dev->req_lock);
+	if (dev->tx_agg_req) {
+		list_add(&dev->tx_agg_req->list, &dev->tx_reqs);
+		dev->tx_agg_req = NULL;
+	}
 	while (!list_empty(&dev->tx_reqs)) {
 		req = container_of(dev->tx_reqs.next,
 					struct usb_request, list);
 		list_del(&req->list);
 
 		spin_unlock(&dev->req_lock);
+		if (dev->tx_agg_bufsize)
+			kfree(req->buf);
 		usb_ep_free_request(link->in_ep, req);
 		spin_lock(&dev->req_lock);
 	}
+	dev->tx_agg_bufsize = 0;
 	spin_unlock(&dev->req_lock);
 	link->in_ep->driver_data = NULL;
 	link->in = NULL;
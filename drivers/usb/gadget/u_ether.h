@@ -66,6 +66,13 @@ struct gether {
 	bool				is_fixed;
 	u32				fixed_out_len;
 	u32				fixed_in_len;
+	/* several frames per IN transfer (RNDIS); gether_connect()
+	 * sizes buffers for dl_max_pkts_per_xfer frames, while the host
+	 * may bound transfers further through dl_max_xfer_size (zero
+	 * until known).  Zero or one packets disables aggregation.
+	 */
+	u32				dl_max_pkts_per_xfer;
+	u32				dl_max_xfer_size;
 	struct sk_buff			*(*wrap)(struct gether *port,
 						struct sk_buff *skb);
 	int				(*unwrap)(struct gether *port,
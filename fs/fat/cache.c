@@ -6,6 +6,9 @@
  *  Mar 1999. AV. Changed cache, so that it uses the starting cluster instead
  *	of inode number.
  *  May 1999. AV. Fixed the bogosity with FAT32 (read "FAT28"). Fscking lusers.
+ *
+ *  The caches of an inode are extents of its cluster chain, kept in an
+ *  rbtree by file cluster for lookup and on an LRU list for reclaim.
  */
 
 #include <linux/fs.h>
@@ -13,11 +16,15 @@
 #include <linux/buffer_head.h>
 #include "fat.h"
 
-/* this must be > 0. */
-#define FAT_MAX_CACHE	8
+/*
+ * this must be > 0.  Enough for every fragment of a large, moderately
+ * fragmented file, so seeking in it never has to walk the FAT again.
+ */
+#define FAT_MAX_CACHE	512
 
 struct fat_cache {
 	struct list_head cache_list;
+	struct rb_node cache_node;
 	int nr_contig;	/* number of contiguous clusters */
 	int fcluster;	/* cluster number in the file. */
 	int dcluster;	/* cluster number on disk. */
@@ -71,6 +78,41 @@ static inline void fat_cache_free(struct fat_cache *cache)
 	kmem_cache_free(fat_cache_cachep, cache);
 }
 
+static void fat_cache_tree_insert(struct inode *inode, struct fat_cache *new)
+{
+	struct rb_node **p = &MSDOS_I(inode)->cache_tree.rb_node;
+	struct rb_node *parent = NULL;
+	struct fat_cache *cache;
+
+	while (*p) {
+		parent = *p;
+		cache = rb_entry(parent, struct fat_cache, cache_node);
+		if (new->fcluster < cache->fcluster)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+	rb_link_node(&new->cache_node, parent, p);
+	rb_insert_color(&new->cache_node, &MSDOS_I(inode)->cache_tree);
+}
+
+/* Find the cache with the highest fcluster not above "fclus". */
+static struct fat_cache *fat_cache_tree_lookup(struct inode *inode, int fclus)
+{
+	struct rb_node *n = MSDOS_I(inode)->cache_tree.rb_node;
+	struct fat_cache *cache, *hit = NULL;
+
+	while (n) {
+		cache = rb_entry(n, struct fat_cache, cache_node);
+		if (cache->fcluster <= fclus) {
+			hit = cache;
+			n = n->rb_right;
+		} else
+			n = n->rb_left;
+	}
+	return hit;
+}
+
 static inline void fat_cache_update_lru(struct inode *inode,
 					struct fat_cache *cache)
 {
@@ -82,25 +124,17 @@ static int fat_cache_lookup(struct inode *inode, int fclus,
 			    struct fat_cache_id *cid,
 			    int *cached_fclus, int *cached_dclus)
 {
-	static struct fat_cache nohit = { .fcluster = 0, };
-
-	struct fat_cache *hit = &nohit, *p;
+	struct fat_cache *hit;
 	int offset = -1;
 
 	spin_lock(&MSDOS_I(inode)->cache_lru_lock);
-	list_for_each_entry(p, &MSDOS_I(inode)->cache_lru, cache_list) {
-		/* Find the cache of "fclus" or nearest cache. */
-		if (p->fcluster <= fclus && hit->fcluster < p->fcluster) {
-			hit = p;
-			if ((hit->fcluster + hit->nr_contig) < fclus) {
-				offset = hit->nr_contig;
-			} else {
-				offset = fclus - hit->fcluster;
-				break;
-			}
-		}
-	}
-	if (hit != &nohit) {
+	/* Find the cache of "fclus" or nearest cache. */
+	hit = fat_cache_tree_lookup(inode, fclus);
+	if (hit) {
+		if ((hit->fcluster + hit->nr_contig) < fclus)
+			offset = hit->nr_contig;
+		else
+			offset = fclus - hit->fcluster;
 		fat_cache_update_lru(inode, hit);
 
 		cid->id = MSDOS_I(inode)->cache_valid_id;
@@ -120,14 +154,13 @@ static struct fat_cache *fat_cache_merge(struct inode *inode,
 {
 	struct fat_cache *p;
 
-	list_for_each_entry(p, &MSDOS_I(inode)->cache_lru, cache_list) {
-		/* Find the same part as "new" in cluster-chain. */
-		if (p->fcluster == new->fcluster) {
-			BUG_ON(p->dcluster != new->dcluster);
-			if (new->nr_contig > p->nr_contig)
-				p->nr_contig = new->nr_contig;
-			return p;
-		}
+	/* Find the same part as "new" in cluster-chain. */
+	p = fat_cache_tree_lookup(inode, new->fcluster);
+	if (p && p->fcluster == new->fcluster) {
+		BUG_ON(p->dcluster != new->dcluster);
+		if (new->nr_contig > p->nr_contig)
+			p->nr_contig = new->nr_contig;
+		return p;
 	}
 	return NULL;
 }
@@ -169,10 +202,12 @@ static void fat_cache_add(struct inode *inode, struct fat_cache_id *new)
 		} else {
 			struct list_head *p = MSDOS_I(inode)->cache_lru.prev;
 			cache = list_entry(p, struct fat_cache, cache_list);
+			rb_erase(&cache->cache_node, &MSDOS_I(inode)->cache_tree);
 		}
 		cache->fcluster = new->fcluster;
 		cache->dcluster = new->dcluster;
 		cache->nr_contig = new->nr_contig;
+		fat_cache_tree_insert(inode, cache);
 	}
 out_update_lru:
 	fat_cache_update_lru(inode, cache);
@@ -192,6 +227,7 @@ static void __fat_cache_inval_inode(struct inode *inode)
 	while (!list_empty(&i->cache_lru)) {
 		cache = list_entry(i->cache_lru.next, struct fat_cache, cache_list);
 		list_del_init(&cache->cache_list);
+		rb_erase(&cache->cache_node, &i->cache_tree);
 		i->nr_caches--;
 		fat_cache_free(cache);
 	}
@@ -272,8 +308,16 @@ int fat_get_cluster(struct inode *inode, int cluster, int *fclus, int *dclus)
 		}
 		(*fclus)++;
 		*dclus = nr;
-		if (!cache_contiguous(&cid, *dclus))
+		if (!cache_contiguous(&cid, *dclus)) {
+			/*
+			 * Remember every extent passed on the way, not
+			 * just the last one, so the next seek anywhere
+			 * before this point skips the walk.
+			 */
+			cid.nr_contig--;
+			fat_cache_add(inode, &cid);
 			cache_init(&cid, *fclus, *dclus);
+		}
 	}
 	nr = 0;
 	fat_cache_add(inode, &cid);
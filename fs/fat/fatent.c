@@ -7,6 +7,7 @@
 #include <linux/fs.h>
 #include <linux/msdos_fs.h>
 #include <linux/blkdev.h>
+#include <linux/vmalloc.h>
 #include "fat.h"
 
 struct fatent_operations {
@@ -452,6 +453,47 @@ static void fat_collect_bhs(struct buffer_head **bhs, int *nr_bhs,
 	}
 }
 
+/* a new chain is started in a free run at least this long, if there is one */
+#define FAT_ALLOC_RUN		16
+
+/*
+ * Pick a free cluster from sbi->alloc_bitmap.  The cluster right after
+ * the previously allocated one comes first, so a growing file stays
+ * contiguous.  Otherwise take the start of a free run of at least
+ * FAT_ALLOC_RUN clusters rather than the first hole, so new files don't
+ * get scattered over the single-cluster gaps of an old, full volume.
+ */
+static int fat_bitmap_find_free(struct msdos_sb_info *sbi, int nr)
+{
+	unsigned long *map = sbi->alloc_bitmap;
+	unsigned long size = sbi->max_cluster;
+	unsigned long hint = sbi->prev_free + 1;
+	unsigned long entry;
+
+	if (hint >= size)
+		hint = FAT_START_ENT;
+	if (!test_bit(hint, map))
+		return hint;
+
+	nr = max(nr, FAT_ALLOC_RUN);
+	entry = bitmap_find_next_zero_area(map, size, hint, nr, 0);
+	if (entry + nr <= size)
+		return entry;
+	entry = bitmap_find_next_zero_area(map, min(hint + nr, size),
+					   FAT_START_ENT, nr, 0);
+	if (entry + nr <= min(hint + nr, size))
+		return entry;
+
+	/* no such run, fall back to first fit */
+	entry = find_next_zero_bit(map, size, hint);
+	if (entry < size)
+		return entry;
+	entry = find_next_zero_bit(map, hint, FAT_START_ENT);
+	if (entry < hint)
+		return entry;
+	return -1;
+}
+
 int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 {
 	struct super_block *sb = inode->i_sb;
@@ -474,6 +516,48 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 	count = FAT_START_ENT;
 	fatent_init(&prev_ent);
 	fatent_init(&fatent);
+
+	if (sbi->alloc_bitmap_ready) {
+		int offset, entry;
+		sector_t blocknr;
+
+		while ((entry = fat_bitmap_find_free(sbi,
+					nr_cluster - idx_clus)) >= 0) {
+			fatent_set_entry(&fatent, entry);
+			ops->ent_blocknr(sb, entry, &offset, &blocknr);
+			if (!fat_ent_update_ptr(sb, &fatent, offset, blocknr)) {
+				fatent_brelse(&fatent);
+				err = ops->ent_bread(sb, &fatent, offset, blocknr);
+				if (err)
+					goto out;
+			}
+
+			__set_bit(entry, sbi->alloc_bitmap);
+			/* the bitmap is only a hint, the FAT has the final say */
+			if (ops->ent_get(&fatent) != FAT_ENT_FREE)
+				continue;
+
+			ops->ent_put(&fatent, FAT_ENT_EOF);
+			if (prev_ent.nr_bhs)
+				ops->ent_put(&prev_ent, entry);
+
+			fat_collect_bhs(bhs, &nr_bhs, &fatent);
+
+			sbi->prev_free = entry;
+			if (sbi->free_clusters != -1)
+				sbi->free_clusters--;
+			sb->s_dirt = 1;
+
+			cluster[idx_clus] = entry;
+			idx_clus++;
+			if (idx_clus == nr_cluster)
+				goto out;
+
+			prev_ent = fatent;
+		}
+		goto out_nospc;
+	}
+
 	fatent_set_entry(&fatent, sbi->prev_free + 1);
 	while (count < sbi->max_cluster) {
 		if (fatent.entry >= sbi->max_cluster)
@@ -495,6 +579,8 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 
 				fat_collect_bhs(bhs, &nr_bhs, &fatent);
 
+				if (sbi->alloc_bitmap)
+					__set_bit(entry, sbi->alloc_bitmap);
 				sbi->prev_free = entry;
 				if (sbi->free_clusters != -1)
 					sbi->free_clusters--;
@@ -517,6 +603,7 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 		} while (fat_ent_next(sbi, &fatent));
 	}
 
+out_nospc:
 	/* Couldn't allocate the free entries */
 	sbi->free_clusters = 0;
 	sbi->free_clus_valid = 1;
@@ -611,6 +698,8 @@ int fat_free_clusters(struct inode *inode, int cluster)
 		}
 
 		ops->ent_put(&fatent, FAT_ENT_FREE);
+		if (sbi->alloc_bitmap)
+			__clear_bit(fatent.entry, sbi->alloc_bitmap);
 		if (sbi->free_clusters != -1) {
 			sbi->free_clusters++;
 			sb->s_dirt = 1;
@@ -685,6 +774,13 @@ int fat_count_free_clusters(struct super_block *sb)
 	unsigned long reada_blocks, reada_mask, cur_block;
 	int err = 0, free;
 
+	/*
+	 * The bitmap loader counts the free clusters as a side effect,
+	 * let it finish instead of reading the whole FAT twice.
+	 */
+	while (flush_work_sync(&sbi->alloc_bitmap_work))
+		;
+
 	lock_fat(sbi);
 	if (sbi->free_clusters != -1 && sbi->free_clus_valid)
 		goto out;
@@ -721,3 +817,98 @@ out:
 	unlock_fat(sbi);
 	return err;
 }
+
+/*
+ * Load the FAT into sbi->alloc_bitmap, FAT_READA_SIZE at a time.  Each
+ * run requeues itself until the whole FAT is covered, so umount only
+ * has to wait for one chunk.  The FAT lock is taken per block, and
+ * allocations and frees keep the bitmap up to date in the meantime, so
+ * a block is exact as soon as it has been loaded.
+ */
+static void fat_alloc_bitmap_load(struct work_struct *work)
+{
+	struct msdos_sb_info *sbi =
+		container_of(work, struct msdos_sb_info, alloc_bitmap_work);
+	struct super_block *sb = sbi->fat_inode->i_sb;
+	struct fatent_operations *ops = sbi->fatent_ops;
+	unsigned long reada_blocks, *bitmap = NULL;
+	struct fat_entry fatent;
+	sector_t blocknr;
+	int i, offset, err = 0;
+
+	reada_blocks = FAT_READA_SIZE >> sb->s_blocksize_bits;
+
+	fatent_init(&fatent);
+	fatent_set_entry(&fatent, sbi->alloc_bitmap_next);
+	ops->ent_blocknr(sb, fatent.entry, &offset, &blocknr);
+	fat_ent_reada(sb, &fatent, min_t(unsigned long, reada_blocks,
+			sbi->fat_start + sbi->fat_length - blocknr));
+
+	for (i = 0; i < reada_blocks; i++) {
+		if (fatent.entry >= sbi->max_cluster)
+			break;
+
+		lock_fat(sbi);
+		err = fat_ent_read_block(sb, &fatent);
+		if (err) {
+			unlock_fat(sbi);
+			break;
+		}
+		do {
+			if (ops->ent_get(&fatent) == FAT_ENT_FREE)
+				__clear_bit(fatent.entry, sbi->alloc_bitmap);
+			else
+				__set_bit(fatent.entry, sbi->alloc_bitmap);
+		} while (fat_ent_next(sbi, &fatent));
+		unlock_fat(sbi);
+	}
+	fatent_brelse(&fatent);
+
+	lock_fat(sbi);
+	if (err) {
+		/* fall back to scanning the FAT */
+		bitmap = sbi->alloc_bitmap;
+		sbi->alloc_bitmap = NULL;
+	} else if (fatent.entry >= sbi->max_cluster) {
+		sbi->free_clusters = sbi->max_cluster -
+			bitmap_weight(sbi->alloc_bitmap, sbi->max_cluster);
+		sbi->free_clus_valid = 1;
+		sbi->alloc_bitmap_ready = 1;
+		sb->s_dirt = 1;
+	} else
+		sbi->alloc_bitmap_next = fatent.entry;
+	unlock_fat(sbi);
+
+	if (err)
+		vfree(bitmap);
+	else if (!sbi->alloc_bitmap_ready)
+		queue_work(system_long_wq, work);
+}
+
+void fat_alloc_bitmap_init(struct super_block *sb)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+
+	INIT_WORK(&sbi->alloc_bitmap_work, fat_alloc_bitmap_load);
+
+	/* without it, allocation just searches the FAT as before */
+	sbi->alloc_bitmap = vzalloc(BITS_TO_LONGS(sbi->max_cluster) *
+				    sizeof(unsigned long));
+	if (!sbi->alloc_bitmap)
+		return;
+
+	/* entries 0 and 1 are reserved */
+	__set_bit(0, sbi->alloc_bitmap);
+	__set_bit(1, sbi->alloc_bitmap);
+	sbi->alloc_bitmap_next = FAT_START_ENT;
+	queue_work(system_long_wq, &sbi->alloc_bitmap_work);
+}
+
+void fat_alloc_bitmap_destroy(struct super_block *sb)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+
+	cancel_work_sync(&sbi->alloc_bitmap_work);
+	vfree(sbi->alloc_bitmap);
+	sbi->alloc_bitmap = NULL;
+}
@@ -167,6 +167,7 @@ enum {
 	TRACE_EVENT_FL_FILTERED_BIT,
 	TRACE_EVENT_FL_RECORDED_CMD_BIT,
 	TRACE_EVENT_FL_CAP_ANY_BIT,
+	TRACE_EVENT_FL_HIST_BIT,
 };
 
 enum {
@@ -174,8 +175,11 @@ enum {
 	TRACE_EVENT_FL_FILTERED		= (1 << TRACE_EVENT_FL_FILTERED_BIT),
 	TRACE_EVENT_FL_RECORDED_CMD	= (1 << TRACE_EVENT_FL_RECORDED_CMD_BIT),
 	TRACE_EVENT_FL_CAP_ANY		= (1 << TRACE_EVENT_FL_CAP_ANY_BIT),
+	TRACE_EVENT_FL_HIST		= (1 << TRACE_EVENT_FL_HIST_BIT),
 };
 
+struct event_hist;
+
 struct ftrace_event_call {
 	struct list_head	list;
 	struct ftrace_event_class *class;
@@ -192,6 +196,8 @@ struct ftrace_event_call {
 	 *   bit 1:		enabled
 	 *   bit 2:		filter_active
 	 *   bit 3:		enabled cmd record
+	 *   bit 4:		allow trace by non root (cap any)
+	 *   bit 5:		histogram active
 	 *
 	 * Changes to flags must hold the event_mutex.
 	 *
@@ -208,6 +214,9 @@ struct ftrace_event_call {
 	int				perf_refcount;
 	struct hlist_head __percpu	*perf_events;
 #endif
+#ifdef CONFIG_TRACE_EVENT_HIST
+	struct event_hist		*hist;
+#endif
 };
 
 #define __TRACE_EVENT_FLAGS(name, value)				\
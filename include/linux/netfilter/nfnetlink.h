@@ -48,7 +48,11 @@ struct nfgenmsg {
 #define NFNL_SUBSYS_ULOG		4
 #define NFNL_SUBSYS_OSF			5
 #define NFNL_SUBSYS_IPSET		6
-#define NFNL_SUBSYS_COUNT		7
+/* Not an upstream subsystem: kept at the top of the 8 bit ID space so
+ * it can't collide with IDs upstream hands out from the bottom.  Must
+ * stay decimal for MODULE_ALIAS_NFNL_SUBSYS(). */
+#define NFNL_SUBSYS_XTSTATE		240
+#define NFNL_SUBSYS_COUNT		241
 
 #ifdef __KERNEL__
 
@@ -0,0 +1,42 @@
+#ifndef _NFNETLINK_XTSTATE_H
+#define _NFNETLINK_XTSTATE_H
+
+/* State of xtables matches and targets that keep named objects (quota2
+ * counters, IDLETIMER timers), all returned by one NLM_F_DUMP request.
+ * This file is shared between kernel and userspace.
+ */
+
+#include <linux/types.h>
+#include <linux/netfilter/nfnetlink.h>
+
+enum nfnl_xtstate_msg_types {
+	NFNL_MSG_XTSTATE_GET,		/* dump request / reply */
+
+	NFNL_MSG_XTSTATE_MAX
+};
+
+enum nfnl_xtstate_attr {
+	NFXTSTATE_UNSPEC,
+	NFXTSTATE_QUOTA,		/* nested NFXTSTATE_QUOTA_* */
+	NFXTSTATE_IDLETIMER,		/* nested NFXTSTATE_IDLETIMER_* */
+	__NFXTSTATE_MAX
+};
+#define NFXTSTATE_MAX (__NFXTSTATE_MAX - 1)
+
+enum nfnl_xtstate_quota_attr {
+	NFXTSTATE_QUOTA_UNSPEC,
+	NFXTSTATE_QUOTA_NAME,		/* NLA_NUL_STRING */
+	NFXTSTATE_QUOTA_VALUE,		/* u64, network byte order */
+	__NFXTSTATE_QUOTA_MAX
+};
+#define NFXTSTATE_QUOTA_MAX (__NFXTSTATE_QUOTA_MAX - 1)
+
+enum nfnl_xtstate_idletimer_attr {
+	NFXTSTATE_IDLETIMER_UNSPEC,
+	NFXTSTATE_IDLETIMER_LABEL,	/* NLA_NUL_STRING */
+	NFXTSTATE_IDLETIMER_REMAINING,	/* u32 seconds, network byte order */
+	__NFXTSTATE_IDLETIMER_MAX
+};
+#define NFXTSTATE_IDLETIMER_MAX (__NFXTSTATE_IDLETIMER_MAX - 1)
+
+#endif /* _NFNETLINK_XTSTATE_H */
@@ -148,6 +148,7 @@ ring_buffer_swap_cpu(struct ring_buffer *buffer_a,
 
 int ring_buffer_empty(struct ring_buffer *buffer);
 int ring_buffer_empty_cpu(struct ring_buffer *buffer, int cpu);
+int ring_buffer_full_page_cpu(struct ring_buffer *buffer, int cpu);
 
 void ring_buffer_record_disable(struct ring_buffer *buffer);
 void ring_buffer_record_enable(struct ring_buffer *buffer);
@@ -159,6 +160,7 @@ unsigned long ring_buffer_overruns(struct ring_buffer *buffer);
 unsigned long ring_buffer_entries_cpu(struct ring_buffer *buffer, int cpu);
 unsigned long ring_buffer_overrun_cpu(struct ring_buffer *buffer, int cpu);
 unsigned long ring_buffer_commit_overrun_cpu(struct ring_buffer *buffer, int cpu);
+unsigned long ring_buffer_commit_pages_cpu(struct ring_buffer *buffer, int cpu);
 
 u64 ring_buffer_time_stamp(struct ring_buffer *buffer, int cpu);
 void ring_buffer_normalize_time_stamp(struct ring_buffer *buffer,
@@ -167,6 +169,7 @@ void ring_buffer_set_clock(struct ring_buffer *buffer,
 			   u64 (*clock)(void));
 
 size_t ring_buffer_page_len(void *page);
+size_t ring_buffer_page_hdr_size(void);
 
 
 void *ring_buffer_alloc_read_page(struct ring_buffer *buffer);
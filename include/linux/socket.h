@@ -152,6 +152,12 @@ struct ucred {
 	__u32	gid;
 };
 
+/* getsockopt(SO_BUSY_POLL_STATS) */
+struct sock_busy_poll_stats {
+	__u32	hits;		/* data arrived while busy polling */
+	__u32	misses;		/* busy polled, then slept */
+};
+
 /* Supported address families. */
 #define AF_UNSPEC	0
 #define AF_UNIX		1	/* Unix domain sockets 		*/
@@ -264,6 +270,8 @@ struct ucred {
 #define MSG_SENDPAGE_NOTLAST 0x20000 /* sendpage() internal : not the last page */
 #define MSG_EOF         MSG_FIN
 
+#define MSG_FASTOPEN	0x20000000	/* Send data in TCP SYN */
+
 #define MSG_CMSG_CLOEXEC 0x40000000	/* Set close_on_exit for file
 					   descriptor received through
 					   SCM_RIGHTS */
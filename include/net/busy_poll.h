@@ -0,0 +1,83 @@
+/*
+ * Busy polling on blocking socket receive.
+ *
+ * A receiver that would otherwise sleep on an empty queue spins for up
+ * to sk->sk_ll_usec microseconds first.  For local request/response
+ * traffic the reply usually lands within that window, which saves the
+ * scheduler round trip of a sleep and wakeup.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+#ifndef _NET_BUSY_POLL_H
+#define _NET_BUSY_POLL_H
+
+#include <linux/sched.h>
+#include <net/sock.h>
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+
+extern unsigned int sysctl_net_busy_read __read_mostly;
+
+/* Microsecond-ish clock: a shift instead of a divide, the ~2.4% error
+ * does not matter for a spin budget.
+ */
+static inline u64 busy_loop_us_clock(void)
+{
+	return local_clock() >> 10;
+}
+
+static inline bool sk_can_busy_loop(const struct sock *sk)
+{
+	return sk->sk_ll_usec && !signal_pending(current);
+}
+
+static inline u64 sk_busy_loop_end_time(const struct sock *sk)
+{
+	return busy_loop_us_clock() + ACCESS_ONCE(sk->sk_ll_usec);
+}
+
+static inline bool busy_loop_timeout(u64 end_time)
+{
+	return time_after64(busy_loop_us_clock(), end_time);
+}
+
+/* Spin while @cond is false, for at most the socket's busy poll budget.
+ * Evaluates to true if @cond became true, and accounts the outcome in
+ * the socket's busy poll statistics.
+ */
+#define sk_busy_loop_cond(sk, cond)					\
+({									\
+	u64 __end = sk_busy_loop_end_time(sk);				\
+	bool __hit;							\
+									\
+	while (!(__hit = (cond)) && !need_resched() &&			\
+	       !signal_pending(current) && !busy_loop_timeout(__end))	\
+		cpu_relax();						\
+	if (__hit)							\
+		(sk)->sk_ll_hits++;					\
+	else								\
+		(sk)->sk_ll_misses++;					\
+	__hit;								\
+})
+
+extern bool sk_busy_loop(struct sock *sk);
+
+#else /* CONFIG_NET_RX_BUSY_POLL */
+
+static inline bool sk_can_busy_loop(const struct sock *sk)
+{
+	return false;
+}
+
+#define sk_busy_loop_cond(sk, cond)	(false)
+
+static inline bool sk_busy_loop(struct sock *sk)
+{
+	return false;
+}
+
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+#endif /* _NET_BUSY_POLL_H */
@@ -19,6 +19,8 @@
 #include <linux/ip.h>
 #include <linux/ipv6.h>
 #include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/seqlock.h>
 #include <linux/slab.h>
 #include <linux/socket.h>
 #include <linux/spinlock.h>
@@ -38,7 +40,7 @@
 
 /* This is for all connections with a full identity, no wildcards.
  * One chain is dedicated to TIME_WAIT sockets.
- * I'll experiment with dynamic table growth later.
+ * The table can be grown at runtime by inet_ehash_resize().
  */
 struct inet_ehash_bucket {
 	struct hlist_nulls_head chain;
@@ -107,6 +109,13 @@ struct inet_bind_hashbucket {
  * reallocated/inserted into established hash table
  */
 #define LISTENING_NULLS_BASE (1U << 29)
+
+/*
+ * Established tables alternate this bit in their nulls values on every
+ * resize, so a lookup that is moved from the old table into the new one
+ * sees an unexpected nulls value and restarts.
+ */
+#define INET_EHASH_NULLS_GEN (1U << 30)
 struct inet_listen_hashbucket {
 	spinlock_t		lock;
 	struct hlist_nulls_head	head;
@@ -127,6 +136,14 @@ struct inet_hashinfo {
 	spinlock_t			*ehash_locks;
 	unsigned int			ehash_mask;
 	unsigned int			ehash_locks_mask;
+	/* 0 or INET_EHASH_NULLS_GEN, added to the bucket nulls values */
+	unsigned int			ehash_nulls;
+
+	/* While inet_ehash_resize() runs, the table being emptied */
+	struct inet_ehash_bucket	*ehash_old;
+	unsigned int			ehash_old_mask;
+	u8				*ehash_old_state;
+	seqcount_t			ehash_seq;
 
 	/* Ok, let's try this, I give up, we do need a local binding
 	 * TCP hash as well as the others for fast bind/connect.
@@ -138,6 +155,9 @@ struct inet_hashinfo {
 
 	struct kmem_cache		*bind_bucket_cachep;
 
+	/* established lookups, NULL if not accounted */
+	struct sk_lookup_stats __percpu	*lookup_stats;
+
 	/* All the above members are written once at bootup and
 	 * never written again _or_ are predominantly read-access.
 	 *
@@ -154,11 +174,131 @@ struct inet_hashinfo {
 	atomic_t			bsockets;
 };
 
+/* Tables reported by inet_hashinfo_chain_stats() */
+enum {
+	INET_CHAINS_EHASH,
+	INET_CHAINS_TWCHAIN,
+	INET_CHAINS_BHASH,
+	INET_CHAINS_LHASH,
+	INET_CHAINS_MAX
+};
+
+extern void inet_hashinfo_chain_stats(struct inet_hashinfo *h,
+				      struct sk_chain_stats *st);
+
+/* Consistent snapshot of the established tables */
+struct inet_ehash_view {
+	struct inet_ehash_bucket	*ehash;
+	unsigned int			mask;
+	unsigned int			nulls;
+	struct inet_ehash_bucket	*old;
+	unsigned int			old_mask;
+	u8				*old_state;
+};
+
+/* Progress of each old bucket during a resize */
+enum {
+	INET_EHASH_UNMOVED,
+	INET_EHASH_MOVING,
+	INET_EHASH_MOVED,
+};
+
+/*
+ * Serializes inet_ehash_resize() against walkers that cannot go through
+ * inet_ehash_bucket() one bucket at a time.
+ */
+extern struct mutex inet_ehash_mutex;
+
+extern int inet_ehash_resize(struct inet_hashinfo *hashinfo,
+			     unsigned int size);
+extern void inet_ehash_migrate(const struct inet_ehash_view *v,
+			       unsigned int hash);
+
+/*
+ * The tables must be read under rcu_read_lock() or with the ehash lock
+ * of the bucket held.
+ */
+static inline void inet_ehash_view(struct inet_hashinfo *hashinfo,
+				   struct inet_ehash_view *v)
+{
+	unsigned int seq;
+
+	do {
+		seq = read_seqcount_begin(&hashinfo->ehash_seq);
+		v->ehash = hashinfo->ehash;
+		v->mask = hashinfo->ehash_mask;
+		v->nulls = hashinfo->ehash_nulls;
+		v->old = hashinfo->ehash_old;
+		v->old_mask = hashinfo->ehash_old_mask;
+		v->old_state = hashinfo->ehash_old_state;
+	} while (read_seqcount_retry(&hashinfo->ehash_seq, seq));
+}
+
+/*
+ * Bucket of @hash in the current table, or in the old one if @old is set,
+ * and the nulls value that ends its chains.  For lockless lookups, which
+ * search the old table first while a resize is running.
+ */
+static inline struct inet_ehash_bucket *inet_ehash_view_bucket(
+	const struct inet_ehash_view *v, int old, unsigned int hash,
+	unsigned int *nulls)
+{
+	unsigned int slot;
+
+	if (old) {
+		slot = hash & v->old_mask;
+		*nulls = slot | (v->nulls ^ INET_EHASH_NULLS_GEN);
+		return &v->old[slot];
+	}
+	slot = hash & v->mask;
+	*nulls = slot | v->nulls;
+	return &v->ehash[slot];
+}
+
+/* State of the old bucket of @hash, read before the lookup walks it */
+static inline u8 inet_ehash_old_state(const struct inet_ehash_view *v,
+				      unsigned int hash)
+{
+	u8 state;
+
+	if (!v->old)
+		return INET_EHASH_MOVED;
+	state = ACCESS_ONCE(v->old_state[hash & v->old_mask]);
+	smp_rmb();
+	return state;
+}
+
+/*
+ * A socket being moved is briefly on no chain at all.  A lookup that
+ * found nothing must start over if the move of its old bucket overlapped
+ * it: not finished when the lookup began, started by the time it ended.
+ */
+static inline bool inet_ehash_lookup_retry(const struct inet_ehash_view *v,
+					   unsigned int hash, u8 state)
+{
+	if (state == INET_EHASH_MOVED)
+		return false;
+	smp_rmb();
+	return ACCESS_ONCE(v->old_state[hash & v->old_mask]) !=
+		INET_EHASH_UNMOVED;
+}
+
+/*
+ * Bucket of @hash in the current table.  The caller must hold
+ * inet_ehash_lockp(hashinfo, hash).  If a resize is running, the sockets
+ * of the matching old bucket are moved over first, so the returned bucket
+ * holds every socket with this hash.
+ */
 static inline struct inet_ehash_bucket *inet_ehash_bucket(
 	struct inet_hashinfo *hashinfo,
 	unsigned int hash)
 {
-	return &hashinfo->ehash[hash & hashinfo->ehash_mask];
+	struct inet_ehash_view v;
+
+	inet_ehash_view(hashinfo, &v);
+	if (unlikely(v.old))
+		inet_ehash_migrate(&v, hash);
+	return &v.ehash[hash & v.mask];
 }
 
 static inline spinlock_t *inet_ehash_lockp(
@@ -168,6 +308,23 @@ static inline spinlock_t *inet_ehash_lockp(
 	return &hashinfo->ehash_locks[hash & hashinfo->ehash_locks_mask];
 }
 
+/* Lockless hint for dump walkers that no socket sits in bucket @slot */
+static inline bool inet_ehash_slot_empty(struct inet_hashinfo *hashinfo,
+					 unsigned int slot)
+{
+	struct inet_ehash_view v;
+	struct inet_ehash_bucket *head;
+	bool empty;
+
+	rcu_read_lock();
+	inet_ehash_view(hashinfo, &v);
+	head = &v.ehash[slot & v.mask];
+	empty = !v.old && hlist_nulls_empty(&head->chain) &&
+		hlist_nulls_empty(&head->twchain);
+	rcu_read_unlock();
+	return empty;
+}
+
 static inline int inet_ehash_locks_alloc(struct inet_hashinfo *hashinfo)
 {
 	unsigned int i, size = 256;
@@ -12,6 +12,7 @@
 #include <linux/jiffies.h>
 #include <linux/spinlock.h>
 #include <linux/rtnetlink.h>
+#include <linux/tcp.h>
 #include <net/ipv6.h>
 #include <asm/atomic.h>
 
@@ -54,6 +55,11 @@ struct inet_peer {
 			u32				pmtu_orig;
 			u32				pmtu_learned;
 			struct inetpeer_addr_base	redirect_learned;
+			/* TCP Fast Open client state, see tcp_fastopen.c */
+			struct tcp_fastopen_cookie	tfo_cookie;
+			u16				tfo_mss;
+			u16				tfo_syn_loss;
+			unsigned long			tfo_syn_loss_ts;
 		};
 		struct rcu_head         rcu;
 	};
@@ -0,0 +1,32 @@
+#ifndef _KER_NFNETLINK_XTSTATE_H
+#define _KER_NFNETLINK_XTSTATE_H
+
+#include <linux/list.h>
+#include <linux/skbuff.h>
+
+/**
+ * struct nfnl_xtstate_provider - source of NFNL_MSG_XTSTATE_GET entries
+ * @fill: append one attribute per object, starting with object *@pos;
+ *	on -EMSGSIZE set *@pos to the first object left out.  Called in
+ *	process context.
+ */
+struct nfnl_xtstate_provider {
+	struct list_head	list;
+	int			(*fill)(struct sk_buff *skb, unsigned long *pos);
+};
+
+#if defined(CONFIG_NETFILTER_NETLINK_XTSTATE) || \
+    defined(CONFIG_NETFILTER_NETLINK_XTSTATE_MODULE)
+extern void nfnl_xtstate_register(struct nfnl_xtstate_provider *p);
+extern void nfnl_xtstate_unregister(struct nfnl_xtstate_provider *p);
+#else
+static inline void nfnl_xtstate_register(struct nfnl_xtstate_provider *p)
+{
+}
+
+static inline void nfnl_xtstate_unregister(struct nfnl_xtstate_provider *p)
+{
+}
+#endif
+
+#endif /* _KER_NFNETLINK_XTSTATE_H */
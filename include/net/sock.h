@@ -214,6 +214,9 @@ struct sock_common {
   *	@sk_peer_cred: %SO_PEERCRED setting
   *	@sk_rcvlowat: %SO_RCVLOWAT setting
   *	@sk_rcvtimeo: %SO_RCVTIMEO setting
+  *	@sk_ll_usec: usecs to busypoll when there is no data
+  *	@sk_ll_hits: blocking receives satisfied by busy polling
+  *	@sk_ll_misses: blocking receives that busy polled and then slept
   *	@sk_sndtimeo: %SO_SNDTIMEO setting
   *	@sk_rxhash: flow hash received from netif layer
   *	@sk_filter: socket filtering instructions
@@ -326,6 +329,11 @@ struct sock {
 	const struct cred	*sk_peer_cred;
 	long			sk_rcvtimeo;
 	long			sk_sndtimeo;
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	unsigned int		sk_ll_usec;
+	unsigned int		sk_ll_hits;
+	unsigned int		sk_ll_misses;
+#endif
 	void			*sk_protinfo;
 	struct timer_list	sk_timer;
 	ktime_t			sk_stamp;
@@ -867,6 +875,47 @@ static void inline sock_prot_inuse_add(struct net *net, struct proto *prot,
 #endif
 
 
+/* Per-cpu counters of lookups in a socket hash table (/proc/net/sockhash) */
+struct sk_lookup_stats {
+	unsigned long	lookups;
+	unsigned long	walked;		/* chain entries examined */
+};
+
+static inline void sk_lookup_stats_add(struct sk_lookup_stats __percpu *stats,
+				       unsigned int walked)
+{
+	if (stats) {
+		this_cpu_inc(stats->lookups);
+		this_cpu_add(stats->walked, walked);
+	}
+}
+
+/* Chain lengths of a socket hash table.  hist[0] counts empty chains,
+ * hist[i] chains of 2^(i-1) to 2^i - 1 entries, the last one all longer.
+ */
+#define SK_CHAIN_HIST	8
+
+struct sk_chain_stats {
+	unsigned int	buckets;
+	unsigned int	used;
+	unsigned int	entries;
+	unsigned int	max_len;
+	unsigned int	hist[SK_CHAIN_HIST];
+};
+
+static inline void sk_chain_stats_add(struct sk_chain_stats *st,
+				      unsigned int len)
+{
+	st->buckets++;
+	st->entries += len;
+	if (len)
+		st->used++;
+	if (len > st->max_len)
+		st->max_len = len;
+	st->hist[min_t(unsigned int, fls(len), SK_CHAIN_HIST - 1)]++;
+}
+
+
 /* With per-bucket locks this operation is not-atomic, so that
  * this version is not worse.
  */
@@ -76,9 +76,13 @@ struct udp_table {
 	struct udp_hslot	*hash2;
 	unsigned int		mask;
 	unsigned int		log;
+	struct sk_lookup_stats __percpu *lookup_stats;
 };
 extern struct udp_table udp_table;
 extern void udp_table_init(struct udp_table *, const char *);
+extern void udp_table_chain_stats(struct udp_table *table,
+				  struct sk_chain_stats *st,
+				  struct sk_chain_stats *st2);
 static inline struct udp_hslot *udp_hashslot(struct udp_table *table,
 					     struct net *net, unsigned num)
 {
@@ -415,6 +415,17 @@ size_t ring_buffer_page_len(void *page)
 		+ BUF_PAGE_HDR_SIZE;
 }
 
+/**
+ * ring_buffer_page_hdr_size - the size of the header of a data page.
+ *
+ * ring_buffer_read_page() needs a length larger than this to return
+ * any event.
+ */
+size_t ring_buffer_page_hdr_size(void)
+{
+	return BUF_PAGE_HDR_SIZE;
+}
+
 /*
  * Also stolen from mm/slob.c. Thanks to Mathieu Desnoyers for pointing
  * this issue out.
@@ -493,6 +504,7 @@ struct ring_buffer_per_cpu {
 	local_t				entries;
 	local_t				committing;
 	local_t				commits;
+	local_t				commit_pages;
 	unsigned long			read;
 	u64				write_stamp;
 	u64				read_stamp;
@@ -1537,6 +1549,7 @@ rb_set_commit_to_write(struct ring_buffer_per_cpu *cpu_buffer)
 		local_set(&cpu_buffer->commit_page->page->commit,
 			  rb_page_write(cpu_buffer->commit_page));
 		rb_inc_page(cpu_buffer, &cpu_buffer->commit_page);
+		local_inc(&cpu_buffer->commit_pages);
 		cpu_buffer->write_stamp =
 			cpu_buffer->commit_page->page->time_stamp;
 		/* add barrier to keep gcc from optimizing too much */
@@ -2705,6 +2718,29 @@ ring_buffer_commit_overrun_cpu(struct ring_buffer *buffer, int cpu)
 }
 EXPORT_SYMBOL_GPL(ring_buffer_commit_overrun_cpu);
 
+/**
+ * ring_buffer_commit_pages_cpu - count of pages the writer has finished
+ * @buffer: The ring buffer
+ * @cpu: The per CPU buffer to read from
+ *
+ * The count only ever goes up and is cheap to read, so writers can
+ * use it to notice that a new page is ready for ring_buffer_read_page()
+ * without taking the reader lock.
+ */
+unsigned long
+ring_buffer_commit_pages_cpu(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return 0;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	return local_read(&cpu_buffer->commit_pages);
+}
+EXPORT_SYMBOL_GPL(ring_buffer_commit_pages_cpu);
+
 /**
  * ring_buffer_entries - get the number of entries in a buffer
  * @buffer: The ring buffer
@@ -3637,6 +3673,44 @@ int ring_buffer_empty_cpu(struct ring_buffer *buffer, int cpu)
 }
 EXPORT_SYMBOL_GPL(ring_buffer_empty_cpu);
 
+/**
+ * ring_buffer_full_page_cpu - does a cpu buffer hold a finished page?
+ * @buffer: The ring buffer
+ * @cpu: The CPU buffer to test
+ *
+ * Returns 1 if ring_buffer_read_page() with @full set would find a
+ * page that the writer has moved off of, 0 otherwise.  A reader page
+ * that has been partly consumed (by trace_pipe) cannot be handed out
+ * whole, so it does not count until the rest of it has been read.
+ */
+int ring_buffer_full_page_cpu(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct buffer_page *reader;
+	struct buffer_page *head;
+	unsigned long flags;
+	int ret;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return 0;
+
+	cpu_buffer = buffer->buffers[cpu];
+	spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	reader = cpu_buffer->reader_page;
+	if (reader->read < rb_page_size(reader)) {
+		/* the reader page is handed out as is */
+		ret = !reader->read && reader != cpu_buffer->commit_page;
+	} else {
+		/* the head page gets swapped in as the next reader page */
+		head = rb_set_head_page(cpu_buffer);
+		ret = head && head != cpu_buffer->commit_page;
+	}
+	spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_full_page_cpu);
+
 #ifdef CONFIG_RING_BUFFER_ALLOW_SWAP
 /**
  * ring_buffer_swap_cpu - swap a CPU buffer between two ring buffers
@@ -32,6 +32,11 @@ static struct task_struct *producer;
 static struct task_struct *consumer;
 static unsigned long read;
 
+/* time the consumer spent reading, and how often it was woken */
+static unsigned long long read_time;
+static unsigned long read_wakeups;
+static unsigned long last_pages;
+
 static int disable_reader;
 module_param(disable_reader, uint, 0644);
 MODULE_PARM_DESC(disable_reader, "only run producer");
@@ -40,6 +45,10 @@ static int write_iteration = 50;
 module_param(write_iteration, uint, 0644);
 MODULE_PARM_DESC(write_iteration, "# of writes between timestamp readings");
 
+static int page_wakeup;
+module_param(page_wakeup, uint, 0644);
+MODULE_PARM_DESC(page_wakeup, "wake the reader once per filled page");
+
 static int producer_nice = 19;
 static int consumer_nice = 19;
 
@@ -178,9 +187,13 @@ static void ring_buffer_consumer(void)
 	read_events ^= 1;
 
 	read = 0;
+	read_time = 0;
+	read_wakeups = 0;
 	while (!reader_finish && !kill_test) {
+		u64 start = local_clock();
 		int found;
 
+		read_wakeups++;
 		do {
 			int cpu;
 
@@ -200,6 +213,8 @@ static void ring_buffer_consumer(void)
 			}
 		} while (found && !kill_test);
 
+		read_time += local_clock() - start;
+
 		set_current_state(TASK_INTERRUPTIBLE);
 		if (reader_finish)
 			break;
@@ -211,6 +226,26 @@ static void ring_buffer_consumer(void)
 	complete(&read_done);
 }
 
+/*
+ * Either wake the reader every wakeup_interval write iterations, or,
+ * like per_cpu/cpuN/trace_pipe_raw readers are, only once the writer
+ * has finished a page that the reader can take whole.
+ */
+static int wake_reader(int cnt)
+{
+	unsigned long pages;
+
+	if (!page_wakeup)
+		return !(cnt % wakeup_interval);
+
+	pages = ring_buffer_commit_pages_cpu(buffer, raw_smp_processor_id());
+	if (pages == last_pages)
+		return 0;
+
+	last_pages = pages;
+	return 1;
+}
+
 static void ring_buffer_producer(void)
 {
 	struct timeval start_tv;
@@ -248,7 +283,7 @@ static void ring_buffer_producer(void)
 		do_gettimeofday(&end_tv);
 
 		cnt++;
-		if (consumer && !(cnt % wakeup_interval))
+		if (consumer && wake_reader(cnt))
 			wake_up_process(consumer);
 
 #ifndef CONFIG_PREEMPT
@@ -315,9 +350,17 @@ static void ring_buffer_producer(void)
 	trace_printk("Overruns: %lld\n", overruns);
 	if (disable_reader)
 		trace_printk("Read:     (reader disabled)\n");
-	else
+	else {
 		trace_printk("Read:     %ld  (by %s)\n", read,
 			read_events ? "events" : "pages");
+		trace_printk("Wakeups:  %ld  (%s)\n", read_wakeups,
+			page_wakeup ? "per page" : "per interval");
+		if (read) {
+			/* Reader cost, the overhead of capturing the trace */
+			do_div(read_time, read);
+			trace_printk("%lld ns per entry read\n", read_time);
+		}
+	}
 	trace_printk("Entries:  %lld\n", entries);
 	trace_printk("Total:    %lld\n", entries + overruns + read);
 	trace_printk("Missed:   %ld\n", missed);
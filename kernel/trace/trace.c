@@ -177,6 +177,8 @@ int filter_current_check_discard(struct ring_buffer *buffer,
 				 struct ftrace_event_call *call, void *rec,
 				 struct ring_buffer_event *event)
 {
+	if (unlikely(call->flags & TRACE_EVENT_FL_HIST))
+		return event_hist_check_discard(call, rec, buffer, event);
 	return filter_check_discard(call, rec, buffer, event);
 }
 EXPORT_SYMBOL_GPL(filter_current_check_discard);
@@ -335,6 +337,14 @@ static inline void trace_access_lock_init(void)
 /* trace_wait is a waitqueue for tasks blocked on trace_poll */
 static DECLARE_WAIT_QUEUE_HEAD(trace_wait);
 
+/*
+ * Readers of per_cpu/cpuN/trace_pipe_raw wait here for whole pages.
+ * trace_raw_pages is the page count of the buffer at the last wake up,
+ * so that writers wake them once per page rather than once per event.
+ */
+static DEFINE_PER_CPU(wait_queue_head_t, trace_raw_wait);
+static DEFINE_PER_CPU(unsigned long, trace_raw_pages);
+
 /* trace_flags holds trace_options default values */
 unsigned long trace_flags = TRACE_ITER_PRINT_PARENT | TRACE_ITER_PRINTK |
 	TRACE_ITER_ANNOTATE | TRACE_ITER_CONTEXT_INFO | TRACE_ITER_SLEEP_TIME |
@@ -343,6 +353,22 @@ unsigned long trace_flags = TRACE_ITER_PRINT_PARENT | TRACE_ITER_PRINTK |
 static int trace_stop_count;
 static DEFINE_SPINLOCK(tracing_start_lock);
 
+static void trace_wake_up_raw(int cpu)
+{
+	wait_queue_head_t *wq = &per_cpu(trace_raw_wait, cpu);
+	unsigned long pages;
+
+	if (!waitqueue_active(wq))
+		return;
+
+	pages = ring_buffer_commit_pages_cpu(global_trace.buffer, cpu);
+	if (pages == per_cpu(trace_raw_pages, cpu))
+		return;
+
+	per_cpu(trace_raw_pages, cpu) = pages;
+	wake_up(wq);
+}
+
 /**
  * trace_wake_up - wake up tasks waiting for trace input
  *
@@ -360,8 +386,10 @@ void trace_wake_up(void)
 	 * have for now:
 	 */
 	cpu = get_cpu();
-	if (!runqueue_is_locked(cpu))
+	if (!runqueue_is_locked(cpu)) {
 		wake_up(&trace_wait);
+		trace_wake_up_raw(cpu);
+	}
 	put_cpu();
 }
 
@@ -3686,6 +3714,39 @@ static int tracing_buffers_open(struct inode *inode, struct file *filp)
 	return nonseekable_open(inode, filp);
 }
 
+/*
+ * Sleep until the writer has moved off a page of this cpu's buffer.
+ * Writers that commit without waking (the function tracer, or any
+ * tracer with the "block" option set) are caught by polling, like
+ * poll_wait_pipe() does for trace_pipe.
+ */
+static int tracing_buffers_wait(struct ftrace_buffer_info *info)
+{
+	wait_queue_head_t *wq = &per_cpu(trace_raw_wait, info->cpu);
+	long ret;
+
+	do {
+		ret = wait_event_interruptible_timeout(*wq,
+				ring_buffer_full_page_cpu(info->tr->buffer,
+							  info->cpu),
+				HZ / 10);
+	} while (!ret);
+
+	return ret < 0 ? ret : 0;
+}
+
+static unsigned int
+tracing_buffers_poll(struct file *filp, poll_table *poll_table)
+{
+	struct ftrace_buffer_info *info = filp->private_data;
+
+	poll_wait(filp, &per_cpu(trace_raw_wait, info->cpu), poll_table);
+	if (ring_buffer_full_page_cpu(info->tr->buffer, info->cpu))
+		return POLLIN | POLLRDNORM;
+
+	return 0;
+}
+
 static ssize_t
 tracing_buffers_read(struct file *filp, char __user *ubuf,
 		     size_t count, loff_t *ppos)
@@ -3706,14 +3767,34 @@ tracing_buffers_read(struct file *filp, char __user *ubuf,
 	if (info->read < PAGE_SIZE)
 		goto read;
 
+	/* too short to hold any event */
+	if (count <= ring_buffer_page_hdr_size())
+		return -EINVAL;
+
+again:
 	trace_access_lock(info->cpu);
 	ret = ring_buffer_read_page(info->tr->buffer,
 				    &info->spare,
 				    count,
 				    info->cpu, 0);
 	trace_access_unlock(info->cpu);
-	if (ret < 0)
-		return 0;
+	if (ret < 0) {
+		/*
+		 * Only an empty buffer is worth waiting for; otherwise
+		 * count is smaller than the next event and waiting would
+		 * not change that.
+		 */
+		if (!ring_buffer_empty_cpu(info->tr->buffer, info->cpu))
+			return 0;
+		if (filp->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		if (signal_pending(current))
+			return -ERESTARTSYS;
+		ret = tracing_buffers_wait(info);
+		if (ret)
+			return ret;
+		goto again;
+	}
 
 	info->read = 0;
 
@@ -3822,6 +3903,7 @@ tracing_buffers_splice_read(struct file *file, loff_t *ppos,
 	};
 	struct buffer_ref *ref;
 	int entries, size, i;
+	int waited = 0;
 	size_t ret;
 
 	if (splice_grow_spd(pipe, &spd))
@@ -3842,6 +3924,13 @@ tracing_buffers_splice_read(struct file *file, loff_t *ppos,
 		len &= PAGE_MASK;
 	}
 
+again:
+	if (signal_pending(current)) {
+		ret = -ERESTARTSYS;
+		goto out;
+	}
+	ret = 0;
+
 	trace_access_lock(info->cpu);
 	entries = ring_buffer_entries_cpu(info->tr->buffer, info->cpu);
 
@@ -3850,14 +3939,17 @@ tracing_buffers_splice_read(struct file *file, loff_t *ppos,
 		int r;
 
 		ref = kzalloc(sizeof(*ref), GFP_KERNEL);
-		if (!ref)
+		if (!ref) {
+			ret = -ENOMEM;
 			break;
+		}
 
 		ref->ref = 1;
 		ref->buffer = info->tr->buffer;
 		ref->page = ring_buffer_alloc_read_page(ref->buffer);
 		if (!ref->page) {
 			kfree(ref);
+			ret = -ENOMEM;
 			break;
 		}
 
@@ -3895,12 +3987,27 @@ tracing_buffers_splice_read(struct file *file, loff_t *ppos,
 
 	/* did we read anything? */
 	if (!spd.nr_pages) {
-		if (flags & SPLICE_F_NONBLOCK)
+		if (ret == -ENOMEM)
+			goto out;
+		if ((file->f_flags & O_NONBLOCK) ||
+		    (flags & SPLICE_F_NONBLOCK)) {
 			ret = -EAGAIN;
-		else
+			goto out;
+		}
+		/*
+		 * A full page was reported but could not be taken: don't
+		 * spin on it, return nothing as before.
+		 */
+		if (waited &&
+		    ring_buffer_full_page_cpu(info->tr->buffer, info->cpu)) {
 			ret = 0;
-		/* TODO: block */
-		goto out;
+			goto out;
+		}
+		ret = tracing_buffers_wait(info);
+		if (ret)
+			goto out;
+		waited = 1;
+		goto again;
 	}
 
 	ret = splice_to_pipe(pipe, &spd);
@@ -3912,6 +4019,7 @@ out:
 static const struct file_operations tracing_buffers_fops = {
 	.open		= tracing_buffers_open,
 	.read		= tracing_buffers_read,
+	.poll		= tracing_buffers_poll,
 	.release	= tracing_buffers_release,
 	.splice_read	= tracing_buffers_splice_read,
 	.llseek		= no_llseek,
@@ -4598,6 +4706,9 @@ __init static int tracer_alloc_buffers(void)
 	cpumask_copy(tracing_buffer_mask, cpu_possible_mask);
 	cpumask_copy(tracing_cpumask, cpu_all_mask);
 
+	for_each_possible_cpu(i)
+		init_waitqueue_head(&per_cpu(trace_raw_wait, i));
+
 	/* TODO: make the number of buffers hot pluggable with CPUS */
 	global_trace.buffer = ring_buffer_alloc(ring_buf_size, rb_flags);
 	if (!global_trace.buffer) {
@@ -770,6 +770,35 @@ filter_check_discard(struct ftrace_event_call *call, void *rec,
 
 extern void trace_event_enable_cmd_record(bool enable);
 
+#ifdef CONFIG_TRACE_EVENT_HIST
+extern int event_hist_check_discard(struct ftrace_event_call *call, void *rec,
+				    struct ring_buffer *buffer,
+				    struct ring_buffer_event *event);
+extern int event_hist_open(struct inode *inode, struct file *filp);
+extern ssize_t event_hist_write(struct file *filp, const char __user *ubuf,
+				size_t cnt, loff_t *ppos);
+extern void event_hist_destroy(struct ftrace_event_call *call);
+#else
+static inline int
+event_hist_check_discard(struct ftrace_event_call *call, void *rec,
+			 struct ring_buffer *buffer,
+			 struct ring_buffer_event *event)
+{
+	return filter_check_discard(call, rec, buffer, event);
+}
+static inline int event_hist_open(struct inode *inode, struct file *filp)
+{
+	return -ENODEV;
+}
+static inline ssize_t
+event_hist_write(struct file *filp, const char __user *ubuf,
+		 size_t cnt, loff_t *ppos)
+{
+	return -ENODEV;
+}
+static inline void event_hist_destroy(struct ftrace_event_call *call) { }
+#endif
+
 extern struct mutex event_mutex;
 extern struct list_head ftrace_events;
 
@@ -209,7 +209,9 @@ static int ftrace_event_enable_disable(struct ftrace_event_call *call,
 				tracing_stop_cmdline_record();
 				call->flags &= ~TRACE_EVENT_FL_RECORDED_CMD;
 			}
-			call->class->reg(call, TRACE_REG_UNREGISTER);
+			/* a histogram keeps the probe registered */
+			if (!(call->flags & TRACE_EVENT_FL_HIST))
+				call->class->reg(call, TRACE_REG_UNREGISTER);
 		}
 		break;
 	case 1:
@@ -218,7 +220,9 @@ static int ftrace_event_enable_disable(struct ftrace_event_call *call,
 				tracing_start_cmdline_record();
 				call->flags |= TRACE_EVENT_FL_RECORDED_CMD;
 			}
-			ret = call->class->reg(call, TRACE_REG_REGISTER);
+			if (!(call->flags & TRACE_EVENT_FL_HIST))
+				ret = call->class->reg(call,
+						       TRACE_REG_REGISTER);
 			if (ret) {
 				tracing_stop_cmdline_record();
 				pr_info("event trace: Could not enable event "
@@ -1045,6 +1049,14 @@ static const struct file_operations ftrace_event_filter_fops = {
 	.llseek = default_llseek,
 };
 
+static const struct file_operations ftrace_event_hist_fops = {
+	.open = event_hist_open,
+	.read = seq_read,
+	.write = event_hist_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static const struct file_operations ftrace_subsystem_filter_fops = {
 	.open = subsystem_open,
 	.read = subsystem_filter_read,
@@ -1157,7 +1169,8 @@ event_create_dir(struct ftrace_event_call *call, struct dentry *d_events,
 		 const struct file_operations *id,
 		 const struct file_operations *enable,
 		 const struct file_operations *filter,
-		 const struct file_operations *format)
+		 const struct file_operations *format,
+		 const struct file_operations *hist)
 {
 	struct list_head *head;
 	int ret;
@@ -1205,6 +1218,12 @@ event_create_dir(struct ftrace_event_call *call, struct dentry *d_events,
 	trace_create_file("format", 0444, call->dir, call,
 			  format);
 
+#ifdef CONFIG_TRACE_EVENT_HIST
+	if (call->class->reg)
+		trace_create_file("hist", 0644, call->dir, call,
+				  hist);
+#endif
+
 	return 0;
 }
 
@@ -1213,7 +1232,8 @@ __trace_add_event_call(struct ftrace_event_call *call, struct module *mod,
 		       const struct file_operations *id,
 		       const struct file_operations *enable,
 		       const struct file_operations *filter,
-		       const struct file_operations *format)
+		       const struct file_operations *format,
+		       const struct file_operations *hist)
 {
 	struct dentry *d_events;
 	int ret;
@@ -1236,7 +1256,8 @@ __trace_add_event_call(struct ftrace_event_call *call, struct module *mod,
 	if (!d_events)
 		return -ENOENT;
 
-	ret = event_create_dir(call, d_events, id, enable, filter, format);
+	ret = event_create_dir(call, d_events, id, enable, filter, format,
+			       hist);
 	if (!ret)
 		list_add(&call->list, &ftrace_events);
 	call->mod = mod;
@@ -1252,7 +1273,8 @@ int trace_add_event_call(struct ftrace_event_call *call)
 	ret = __trace_add_event_call(call, NULL, &ftrace_event_id_fops,
 				     &ftrace_enable_fops,
 				     &ftrace_event_filter_fops,
-				     &ftrace_event_format_fops);
+				     &ftrace_event_format_fops,
+				     &ftrace_event_hist_fops);
 	mutex_unlock(&event_mutex);
 	return ret;
 }
@@ -1281,6 +1303,7 @@ static void remove_subsystem_dir(const char *name)
  */
 static void __trace_remove_event_call(struct ftrace_event_call *call)
 {
+	event_hist_destroy(call);
 	ftrace_event_enable_disable(call, 0);
 	if (call->event.funcs)
 		__unregister_ftrace_event(&call->event);
@@ -1321,6 +1344,7 @@ struct ftrace_module_file_ops {
 	struct file_operations		enable;
 	struct file_operations		format;
 	struct file_operations		filter;
+	struct file_operations		hist;
 };
 
 static struct ftrace_module_file_ops *
@@ -1353,6 +1377,9 @@ trace_create_file_ops(struct module *mod)
 	file_ops->format = ftrace_event_format_fops;
 	file_ops->format.owner = mod;
 
+	file_ops->hist = ftrace_event_hist_fops;
+	file_ops->hist.owner = mod;
+
 	list_add(&file_ops->list, &ftrace_module_file_list);
 
 	return file_ops;
@@ -1376,7 +1403,8 @@ static void trace_module_add_events(struct module *mod)
 	for_each_event(call, start, end) {
 		__trace_add_event_call(*call, mod,
 				       &file_ops->id, &file_ops->enable,
-				       &file_ops->filter, &file_ops->format);
+				       &file_ops->filter, &file_ops->format,
+				       &file_ops->hist);
 	}
 }
 
@@ -1510,7 +1538,8 @@ static __init int event_trace_init(void)
 		__trace_add_event_call(*call, NULL, &ftrace_event_id_fops,
 				       &ftrace_enable_fops,
 				       &ftrace_event_filter_fops,
-				       &ftrace_event_format_fops);
+				       &ftrace_event_format_fops,
+				       &ftrace_event_hist_fops);
 	}
 
 	while (true) {
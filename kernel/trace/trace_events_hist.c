@@ -0,0 +1,647 @@
+/*
+ * trace_events_hist - in-kernel histograms of trace event fields
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Writing a spec to events/<system>/<event>/hist makes every hit of
+ * the event update a table keyed by up to HIST_KEYS_MAX of its fields.
+ * Each entry counts the hits, sums up to HIST_VALS_MAX value fields
+ * and spreads the first value over log2 or linear buckets.  Reading
+ * the file prints the table; the event itself only goes to the ring
+ * buffer if it is also enabled.
+ *
+ * The tables are per cpu, so the update needs no lock.  Readers and
+ * spec changes serialize on event_mutex, and a table is only freed
+ * after synchronize_sched() since probes run with preemption off.
+ */
+
+#include <linux/module.h>
+#include <linux/hardirq.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+
+#include "trace.h"
+
+#define HIST_KEYS_MAX		2
+#define HIST_VALS_MAX		2
+#define HIST_BUCKETS_LOG2	64
+#define HIST_BUCKETS_MAX	64
+#define HIST_SIZE_DEFAULT	256
+#define HIST_SIZE_MAX		1024
+
+struct hist_entry {
+	u64			key[HIST_KEYS_MAX];
+	u64			hits;
+	u64			sum[HIST_VALS_MAX];
+	u64			buckets[0];
+};
+
+struct hist_table {
+	unsigned int		size;		/* power of two */
+	unsigned int		limit;		/* max entries in use */
+	unsigned int		entries;
+	size_t			entry_size;
+	unsigned long		dropped;
+	u64			data[0];
+};
+
+struct event_hist {
+	struct ftrace_event_field *keys[HIST_KEYS_MAX];
+	struct ftrace_event_field *vals[HIST_VALS_MAX];
+	int			n_keys;
+	int			n_vals;
+	int			n_buckets;	/* 0 without a value */
+	u64			width;		/* 0 for log2 buckets */
+	unsigned int		size;
+	struct hist_table	**tables;	/* one per possible cpu */
+};
+
+static inline struct hist_entry *
+hist_entry(struct hist_table *table, unsigned int idx)
+{
+	return (void *)table->data + idx * table->entry_size;
+}
+
+static u64 hist_field_value(struct ftrace_event_field *field, void *rec)
+{
+	void *addr = rec + field->offset;
+
+	switch (field->size) {
+	case 1:
+		return field->is_signed ? (s64)*(s8 *)addr : *(u8 *)addr;
+	case 2:
+		return field->is_signed ? (s64)*(s16 *)addr : *(u16 *)addr;
+	case 4:
+		return field->is_signed ? (s64)*(s32 *)addr : *(u32 *)addr;
+	default:
+		return *(u64 *)addr;
+	}
+}
+
+/* Values are bucketed as unsigned, negative ones land in the last bucket */
+static unsigned int hist_bucket(struct event_hist *hist, u64 val)
+{
+	u64 idx;
+
+	if (!hist->width)
+		idx = fls64(val);
+	else
+		idx = div64_u64(val, hist->width);
+
+	return min_t(u64, idx, hist->n_buckets - 1);
+}
+
+/*
+ * Find the entry for @key, claiming a free slot for it if there is
+ * none yet.  The table is never filled past its limit, so a probe
+ * sequence always ends on a free slot.
+ */
+static struct hist_entry *
+hist_table_find(struct event_hist *hist, struct hist_table *table, u64 *key)
+{
+	size_t len = hist->n_keys * sizeof(u64);
+	unsigned int mask = table->size - 1;
+	struct hist_entry *entry;
+	unsigned int idx;
+
+	idx = jhash2((u32 *)key, len / sizeof(u32), 0) & mask;
+	for (;;) {
+		entry = hist_entry(table, idx);
+		if (!entry->hits)
+			break;
+		if (!memcmp(entry->key, key, len))
+			return entry;
+		idx = (idx + 1) & mask;
+	}
+
+	if (table->entries >= table->limit)
+		return NULL;
+
+	memcpy(entry->key, key, len);
+	table->entries++;
+	/* readers on other cpus test hits before looking at the key */
+	smp_wmb();
+
+	return entry;
+}
+
+static void event_hist_update(struct ftrace_event_call *call, void *rec)
+{
+	struct event_hist *hist = rcu_dereference_sched(call->hist);
+	struct hist_table *table;
+	struct hist_entry *entry;
+	u64 key[HIST_KEYS_MAX];
+	unsigned long flags;
+	u64 val;
+	int i;
+
+	/* an NMI could land in the middle of an update on this cpu */
+	if (!hist || in_nmi())
+		return;
+
+	for (i = 0; i < hist->n_keys; i++)
+		key[i] = hist_field_value(hist->keys[i], rec);
+
+	local_irq_save(flags);
+	table = hist->tables[smp_processor_id()];
+	entry = hist_table_find(hist, table, key);
+	if (!entry) {
+		table->dropped++;
+		goto out;
+	}
+
+	entry->hits++;
+	for (i = 0; i < hist->n_vals; i++) {
+		val = hist_field_value(hist->vals[i], rec);
+		entry->sum[i] += val;
+		if (!i && hist->n_buckets)
+			entry->buckets[hist_bucket(hist, val)]++;
+	}
+ out:
+	local_irq_restore(flags);
+}
+
+/*
+ * Called instead of filter_check_discard() for events with a histogram.
+ * Events that only have their probe registered for the histogram are
+ * discarded from the ring buffer once they have been counted.
+ */
+int event_hist_check_discard(struct ftrace_event_call *call, void *rec,
+			     struct ring_buffer *buffer,
+			     struct ring_buffer_event *event)
+{
+	if (filter_check_discard(call, rec, buffer, event))
+		return 1;
+
+	event_hist_update(call, rec);
+
+	if (call->flags & TRACE_EVENT_FL_ENABLED)
+		return 0;
+
+	ring_buffer_discard_commit(buffer, event);
+	return 1;
+}
+
+static struct hist_table *hist_table_alloc(struct event_hist *hist,
+					   unsigned int size, int node)
+{
+	size_t entry_size = sizeof(struct hist_entry) +
+			    hist->n_buckets * sizeof(u64);
+	struct hist_table *table;
+
+	table = vmalloc_node(sizeof(*table) + size * entry_size, node);
+	if (!table)
+		return NULL;
+
+	memset(table, 0, sizeof(*table) + size * entry_size);
+	table->size = size;
+	table->limit = size - size / 4;
+	table->entry_size = entry_size;
+
+	return table;
+}
+
+static void hist_free(struct event_hist *hist)
+{
+	int cpu;
+
+	if (!hist)
+		return;
+
+	if (hist->tables) {
+		for_each_possible_cpu(cpu)
+			vfree(hist->tables[cpu]);
+		kfree(hist->tables);
+	}
+	kfree(hist);
+}
+
+static int hist_alloc_tables(struct event_hist *hist)
+{
+	int cpu;
+
+	hist->tables = kcalloc(nr_cpu_ids, sizeof(*hist->tables), GFP_KERNEL);
+	if (!hist->tables)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		hist->tables[cpu] = hist_table_alloc(hist, hist->size,
+						     cpu_to_node(cpu));
+		if (!hist->tables[cpu])
+			return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static struct ftrace_event_field *
+hist_find_field(struct ftrace_event_call *call, const char *name)
+{
+	struct ftrace_event_field *field;
+	struct list_head *head;
+
+	head = &ftrace_common_fields;
+	list_for_each_entry(field, head, link) {
+		if (!strcmp(field->name, name))
+			goto found;
+	}
+
+	head = trace_get_fields(call);
+	list_for_each_entry(field, head, link) {
+		if (!strcmp(field->name, name))
+			goto found;
+	}
+
+	return NULL;
+
+ found:
+	/* only plain numbers can be keys or values */
+	if (field->filter_type != FILTER_OTHER || field->size > 8 ||
+	    !is_power_of_2(field->size))
+		return NULL;
+
+	return field;
+}
+
+static int hist_parse_fields(struct ftrace_event_call *call, char *str,
+			     struct ftrace_event_field **fields, int max)
+{
+	char *name;
+	int n = 0;
+
+	while ((name = strsep(&str, ",")) != NULL) {
+		if (n == max)
+			return -E2BIG;
+		fields[n] = hist_find_field(call, name);
+		if (!fields[n])
+			return -EINVAL;
+		n++;
+	}
+
+	return n;
+}
+
+static int hist_parse_buckets(struct event_hist *hist, char *str)
+{
+	unsigned long long width;
+	unsigned long count;
+	char *kind;
+
+	kind = strsep(&str, ",");
+	if (!strcmp(kind, "log2")) {
+		if (str)
+			return -EINVAL;
+		hist->width = 0;
+		hist->n_buckets = HIST_BUCKETS_LOG2;
+		return 0;
+	}
+
+	if (strcmp(kind, "linear") || !str)
+		return -EINVAL;
+
+	if (kstrtoull(strsep(&str, ","), 0, &width) || !width)
+		return -EINVAL;
+	if (!str || kstrtoul(str, 0, &count) || count < 2 ||
+	    count > HIST_BUCKETS_MAX)
+		return -EINVAL;
+
+	hist->width = width;
+	hist->n_buckets = count;
+
+	return 0;
+}
+
+/*
+ * keys=<field>[,<field>][:vals=<field>[,<field>]]
+ *	[:buckets=log2|linear,<width>,<count>][:size=<entries>]
+ */
+static struct event_hist *
+hist_parse(struct ftrace_event_call *call, char *spec)
+{
+	struct event_hist *hist;
+	unsigned long size = HIST_SIZE_DEFAULT;
+	int buckets = 0;
+	char *opt, *val;
+	int ret = 0;
+
+	hist = kzalloc(sizeof(*hist), GFP_KERNEL);
+	if (!hist)
+		return ERR_PTR(-ENOMEM);
+
+	while (!ret && (opt = strsep(&spec, ":")) != NULL) {
+		val = opt;
+		opt = strsep(&val, "=");
+		if (!val) {
+			ret = -EINVAL;
+		} else if (!strcmp(opt, "keys")) {
+			ret = hist_parse_fields(call, val, hist->keys,
+						HIST_KEYS_MAX);
+			if (ret > 0) {
+				hist->n_keys = ret;
+				ret = 0;
+			}
+		} else if (!strcmp(opt, "vals")) {
+			ret = hist_parse_fields(call, val, hist->vals,
+						HIST_VALS_MAX);
+			if (ret > 0) {
+				hist->n_vals = ret;
+				ret = 0;
+			}
+		} else if (!strcmp(opt, "buckets")) {
+			ret = hist_parse_buckets(hist, val);
+			buckets = 1;
+		} else if (!strcmp(opt, "size")) {
+			if (kstrtoul(val, 0, &size) || !size ||
+			    size > HIST_SIZE_MAX)
+				ret = -EINVAL;
+		} else {
+			ret = -EINVAL;
+		}
+	}
+
+	/* buckets need a value, and a value gets log2 buckets by default */
+	if (!ret && buckets && !hist->n_vals)
+		ret = -EINVAL;
+	if (!ret && !buckets && hist->n_vals)
+		hist->n_buckets = HIST_BUCKETS_LOG2;
+
+	if (ret) {
+		kfree(hist);
+		return ERR_PTR(ret);
+	}
+
+	/* keep a quarter of the slots free for the open addressing */
+	hist->size = roundup_pow_of_two(size + size / 3);
+
+	return hist;
+}
+
+static struct event_hist *hist_create(struct event_hist *hist)
+{
+	int ret;
+
+	ret = hist_alloc_tables(hist);
+	if (ret) {
+		hist_free(hist);
+		return ERR_PTR(ret);
+	}
+
+	return hist;
+}
+
+static int hist_install(struct ftrace_event_call *call,
+			struct event_hist *hist)
+{
+	struct event_hist *old = call->hist;
+	int ret;
+
+	rcu_assign_pointer(call->hist, hist);
+	if (hist)
+		call->flags |= TRACE_EVENT_FL_HIST;
+	else
+		call->flags &= ~TRACE_EVENT_FL_HIST;
+
+	if (!(call->flags & TRACE_EVENT_FL_ENABLED)) {
+		if (hist && !old) {
+			ret = call->class->reg(call, TRACE_REG_REGISTER);
+			if (ret) {
+				call->flags &= ~TRACE_EVENT_FL_HIST;
+				rcu_assign_pointer(call->hist, NULL);
+				hist_free(hist);
+				return ret;
+			}
+		} else if (!hist && old) {
+			call->class->reg(call, TRACE_REG_UNREGISTER);
+		}
+	}
+
+	synchronize_sched();
+	hist_free(old);
+
+	return 0;
+}
+
+/* Must be called with event_mutex held */
+void event_hist_destroy(struct ftrace_event_call *call)
+{
+	if (call->hist)
+		hist_install(call, NULL);
+}
+
+static int event_hist_set(struct ftrace_event_call *call, char *spec)
+{
+	struct event_hist *hist;
+
+	if (!strcmp(spec, "0"))
+		return call->hist ? hist_install(call, NULL) : 0;
+
+	if (!strcmp(spec, "clear")) {
+		if (!call->hist)
+			return -ENOENT;
+		hist = kmemdup(call->hist, sizeof(*hist), GFP_KERNEL);
+		if (!hist)
+			return -ENOMEM;
+		hist->tables = NULL;
+	} else {
+		hist = hist_parse(call, spec);
+		if (IS_ERR(hist))
+			return PTR_ERR(hist);
+	}
+
+	hist = hist_create(hist);
+	if (IS_ERR(hist))
+		return PTR_ERR(hist);
+
+	return hist_install(call, hist);
+}
+
+ssize_t event_hist_write(struct file *filp, const char __user *ubuf,
+			 size_t cnt, loff_t *ppos)
+{
+	struct seq_file *m = filp->private_data;
+	struct ftrace_event_call *call = m->private;
+	char *buf;
+	int err;
+
+	if (cnt >= PAGE_SIZE)
+		return -EINVAL;
+
+	buf = (char *)__get_free_page(GFP_TEMPORARY);
+	if (!buf)
+		return -ENOMEM;
+
+	if (copy_from_user(buf, ubuf, cnt)) {
+		free_page((unsigned long) buf);
+		return -EFAULT;
+	}
+	buf[cnt] = '\0';
+
+	mutex_lock(&event_mutex);
+	err = event_hist_set(call, strstrip(buf));
+	mutex_unlock(&event_mutex);
+	free_page((unsigned long) buf);
+	if (err < 0)
+		return err;
+
+	*ppos += cnt;
+
+	return cnt;
+}
+
+/* Fold the per cpu tables into one, racing with the writers */
+static struct hist_table *hist_merge(struct event_hist *hist)
+{
+	struct hist_entry *src, *dst;
+	struct hist_table *merged;
+	struct hist_table *table;
+	unsigned int i;
+	int cpu, j;
+	u64 hits;
+
+	merged = hist_table_alloc(hist, roundup_pow_of_two(hist->size *
+						num_possible_cpus()), -1);
+	if (!merged)
+		return NULL;
+
+	for_each_possible_cpu(cpu) {
+		table = hist->tables[cpu];
+		merged->dropped += table->dropped;
+		for (i = 0; i < table->size; i++) {
+			src = hist_entry(table, i);
+			hits = ACCESS_ONCE(src->hits);
+			if (!hits)
+				continue;
+			smp_rmb();
+			dst = hist_table_find(hist, merged, src->key);
+			if (!dst)
+				continue;
+			dst->hits += hits;
+			for (j = 0; j < hist->n_vals; j++)
+				dst->sum[j] += src->sum[j];
+			for (j = 0; j < hist->n_buckets; j++)
+				dst->buckets[j] += src->buckets[j];
+		}
+	}
+
+	return merged;
+}
+
+static void hist_show_field(struct seq_file *m,
+			    struct ftrace_event_field *field, u64 val)
+{
+	if (field->is_signed)
+		seq_printf(m, " %s: %lld", field->name, (s64)val);
+	else
+		seq_printf(m, " %s: %llu", field->name, val);
+}
+
+static void hist_show_spec(struct seq_file *m, struct event_hist *hist)
+{
+	int i;
+
+	seq_puts(m, "# keys=");
+	for (i = 0; i < hist->n_keys; i++)
+		seq_printf(m, "%s%s", i ? "," : "", hist->keys[i]->name);
+	if (hist->n_vals) {
+		seq_puts(m, ":vals=");
+		for (i = 0; i < hist->n_vals; i++)
+			seq_printf(m, "%s%s", i ? "," : "",
+				   hist->vals[i]->name);
+		if (hist->width)
+			seq_printf(m, ":buckets=linear,%llu,%d", hist->width,
+				   hist->n_buckets);
+		else
+			seq_puts(m, ":buckets=log2");
+	}
+	seq_putc(m, '\n');
+}
+
+static void hist_show_buckets(struct seq_file *m, struct event_hist *hist,
+			      struct hist_entry *entry)
+{
+	u64 lo, hi;
+	int i;
+
+	for (i = 0; i < hist->n_buckets; i++) {
+		if (!entry->buckets[i])
+			continue;
+		if (hist->width) {
+			lo = i * hist->width;
+			hi = lo + hist->width - 1;
+		} else {
+			lo = i ? 1ULL << (i - 1) : 0;
+			hi = i ? (lo << 1) - 1 : 0;
+		}
+		if (i == hist->n_buckets - 1)
+			seq_printf(m, "\t[%llu - ...]: %llu\n", lo,
+				   entry->buckets[i]);
+		else
+			seq_printf(m, "\t[%llu - %llu]: %llu\n", lo, hi,
+				   entry->buckets[i]);
+	}
+}
+
+static int event_hist_show(struct seq_file *m, void *v)
+{
+	struct ftrace_event_call *call = m->private;
+	struct hist_entry *entry;
+	struct event_hist *hist;
+	struct hist_table *merged;
+	unsigned int i;
+	int j;
+
+	mutex_lock(&event_mutex);
+	hist = call->hist;
+	if (!hist) {
+		seq_puts(m, "none\n");
+		goto out;
+	}
+
+	merged = hist_merge(hist);
+	if (!merged) {
+		mutex_unlock(&event_mutex);
+		return -ENOMEM;
+	}
+
+	hist_show_spec(m, hist);
+	seq_printf(m, "# entries: %u dropped: %lu\n", merged->entries,
+		   merged->dropped);
+
+	for (i = 0; i < merged->size; i++) {
+		entry = hist_entry(merged, i);
+		if (!entry->hits)
+			continue;
+		seq_putc(m, '{');
+		for (j = 0; j < hist->n_keys; j++)
+			hist_show_field(m, hist->keys[j], entry->key[j]);
+		seq_printf(m, " } hitcount: %llu", entry->hits);
+		for (j = 0; j < hist->n_vals; j++)
+			hist_show_field(m, hist->vals[j], entry->sum[j]);
+		seq_putc(m, '\n');
+		hist_show_buckets(m, hist, entry);
+	}
+	vfree(merged);
+ out:
+	mutex_unlock(&event_mutex);
+
+	return 0;
+}
+
+int event_hist_open(struct inode *inode, struct file *filp)
+{
+	return single_open(filp, event_hist_show, inode->i_private);
+}
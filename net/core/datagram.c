@@ -56,6 +56,7 @@
 #include <net/checksum.h>
 #include <net/sock.h>
 #include <net/tcp_states.h>
+#include <net/busy_poll.h>
 #include <trace/events/skb.h>
 
 /*
@@ -78,6 +79,19 @@ static int receiver_wake_function(wait_queue_t *wait, unsigned mode, int sync,
 		return 0;
 	return autoremove_wake_function(wait, mode, sync, key);
 }
+#ifdef CONFIG_NET_RX_BUSY_POLL
+unsigned int sysctl_net_busy_read __read_mostly;
+
+/*
+ * Spin on the receive queue instead of sleeping; true if data arrived.
+ */
+bool sk_busy_loop(struct sock *sk)
+{
+	return sk_busy_loop_cond(sk, !skb_queue_empty(&sk->sk_receive_queue));
+}
+EXPORT_SYMBOL(sk_busy_loop);
+#endif
+
 /*
  * Wait for a packet..
  */
@@ -201,7 +215,8 @@ struct sk_buff *__skb_recv_datagram(struct sock *sk, unsigned flags,
 		if (!timeo)
 			goto no_packet;
 
-	} while (!wait_for_packet(sk, err, &timeo));
+	} while ((sk_can_busy_loop(sk) && sk_busy_loop(sk)) ||
+		 !wait_for_packet(sk, err, &timeo));
 
 	return NULL;
 
@@ -2182,7 +2182,7 @@ gso:
 			return rc;
 		}
 		txq_trans_update(txq);
-		if (unlikely(netif_tx_queue_stopped(txq) && skb->next))
+		if (unlikely(netif_xmit_stopped(txq) && skb->next))
 			return NETDEV_TX_BUSY;
 	} while (skb->next);
 
@@ -2456,7 +2456,7 @@ int dev_queue_xmit(struct sk_buff *skb)
 
 			HARD_TX_LOCK(dev, txq, cpu);
 
-			if (!netif_tx_queue_stopped(txq)) {
+			if (!netif_xmit_stopped(txq)) {
 				__this_cpu_inc(xmit_recursion);
 				rc = dev_hard_start_xmit(skb, dev, txq);
 				__this_cpu_dec(xmit_recursion);
@@ -3506,6 +3506,22 @@ gro_result_t napi_gro_receive(struct napi_struct *napi, struct sk_buff *skb)
 }
 EXPORT_SYMBOL(napi_gro_receive);
 
+/*
+ * For devices that do no receive checksumming: GRO only merges TCP
+ * segments with a known checksum, so supply the full sum of an IPv4
+ * datagram (its header sums to zero) that the stack would compute anyway.
+ */
+gro_result_t napi_gro_receive_csum(struct napi_struct *napi,
+				   struct sk_buff *skb)
+{
+	if (skb->protocol == htons(ETH_P_IP)) {
+		skb->csum = csum_partial(skb->data, skb->len, 0);
+		skb->ip_summed = CHECKSUM_COMPLETE;
+	}
+	return napi_gro_receive(napi, skb);
+}
+EXPORT_SYMBOL(napi_gro_receive_csum);
+
 static void napi_reuse_skb(struct napi_struct *napi, struct sk_buff *skb)
 {
 	__skb_pull(skb, skb_headlen(skb));
@@ -5405,6 +5421,9 @@ static void netdev_init_one_queue(struct net_device *dev,
 	queue->xmit_lock_owner = -1;
 	netdev_queue_numa_node_write(queue, NUMA_NO_NODE);
 	queue->dev = dev;
+#ifdef CONFIG_BQL
+	dql_init(&queue->dql, HZ);
+#endif
 }
 
 static int netif_alloc_netdev_queues(struct net_device *dev)
@@ -125,6 +125,7 @@
 #include <net/xfrm.h>
 #include <linux/ipsec.h>
 #include <net/cls_cgroup.h>
+#include <net/busy_poll.h>
 
 #include <linux/filter.h>
 
@@ -747,6 +748,20 @@ set_rcvbuf:
 		else
 			sock_reset_flag(sk, SOCK_RXQ_OVFL);
 		break;
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	case SO_BUSY_POLL:
+		/* allow unprivileged users to decrease the value */
+		if ((val > sk->sk_ll_usec) && !capable(CAP_NET_ADMIN))
+			ret = -EPERM;
+		else {
+			if (val < 0)
+				ret = -EINVAL;
+			else
+				sk->sk_ll_usec = val;
+		}
+		break;
+#endif
 	default:
 		ret = -ENOPROTOOPT;
 		break;
@@ -780,6 +795,7 @@ int sock_getsockopt(struct socket *sock, int level, int optname,
 		int val;
 		struct linger ling;
 		struct timeval tm;
+		struct sock_busy_poll_stats bp;
 	} v;
 
 	int lv = sizeof(int);
@@ -968,6 +984,18 @@ int sock_getsockopt(struct socket *sock, int level, int optname,
 		v.val = !!sock_flag(sk, SOCK_RXQ_OVFL);
 		break;
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	case SO_BUSY_POLL:
+		v.val = sk->sk_ll_usec;
+		break;
+
+	case SO_BUSY_POLL_STATS:
+		lv = sizeof(struct sock_busy_poll_stats);
+		v.bp.hits = sk->sk_ll_hits;
+		v.bp.misses = sk->sk_ll_misses;
+		break;
+#endif
+
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -2029,6 +2057,12 @@ void sock_init_data(struct socket *sock, struct sock *sk)
 
 	sk->sk_stamp = ktime_set(-1L, 0);
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	sk->sk_ll_usec		=	sysctl_net_busy_read;
+	sk->sk_ll_hits		=	0;
+	sk->sk_ll_misses	=	0;
+#endif
+
 	/*
 	 * Before updating sk_refcnt, we must commit prior changes to memory
 	 * (Documentation/RCU/rculist_nulls.txt for details)
@@ -13,6 +13,7 @@
  *      2 of the License, or (at your option) any later version.
  */
 
+#include <linux/log2.h>
 #include <linux/module.h>
 #include <linux/random.h>
 #include <linux/sched.h>
@@ -231,12 +232,23 @@ struct sock * __inet_lookup_established(struct net *net,
 	 * have wildcards anyways.
 	 */
 	unsigned int hash = inet_ehashfn(net, daddr, hnum, saddr, sport);
-	unsigned int slot = hash & hashinfo->ehash_mask;
-	struct inet_ehash_bucket *head = &hashinfo->ehash[slot];
+	struct inet_ehash_bucket *head;
+	struct inet_ehash_view v;
+	unsigned int slot, walked = 0;
+	int old;
+	u8 state;
 
 	rcu_read_lock();
+restart:
+	inet_ehash_view(hashinfo, &v);
+	/* sockets only move from the old table to the new one */
+	old = v.old != NULL;
+	state = inet_ehash_old_state(&v, hash);
+lookup:
+	head = inet_ehash_view_bucket(&v, old, hash, &slot);
 begin:
 	sk_nulls_for_each_rcu(sk, node, &head->chain) {
+		walked++;
 		if (INET_MATCH(sk, net, hash, acookie,
 					saddr, daddr, ports, dif)) {
 			if (unlikely(!atomic_inc_not_zero(&sk->sk_refcnt)))
@@ -260,6 +272,7 @@ begin:
 begintw:
 	/* Must check for a TIME_WAIT'er before going to listener hash. */
 	sk_nulls_for_each_rcu(sk, node, &head->twchain) {
+		walked++;
 		if (INET_TW_MATCH(sk, net, hash, acookie,
 					saddr, daddr, ports, dif)) {
 			if (unlikely(!atomic_inc_not_zero(&sk->sk_refcnt))) {
@@ -281,9 +294,16 @@ begintw:
 	 */
 	if (get_nulls_value(node) != slot)
 		goto begintw;
+	if (old) {
+		old = 0;
+		goto lookup;
+	}
+	if (unlikely(inet_ehash_lookup_retry(&v, hash, state)))
+		goto restart;
 	sk = NULL;
 out:
 	rcu_read_unlock();
+	sk_lookup_stats_add(hashinfo->lookup_stats, walked);
 	return sk;
 }
 EXPORT_SYMBOL_GPL(__inet_lookup_established);
@@ -303,7 +323,7 @@ static int __inet_check_established(struct inet_timewait_death_row *death_row,
 	struct net *net = sock_net(sk);
 	unsigned int hash = inet_ehashfn(net, daddr, lport,
 					 saddr, inet->inet_dport);
-	struct inet_ehash_bucket *head = inet_ehash_bucket(hinfo, hash);
+	struct inet_ehash_bucket *head;
 	spinlock_t *lock = inet_ehash_lockp(hinfo, hash);
 	struct sock *sk2;
 	const struct hlist_nulls_node *node;
@@ -311,6 +331,7 @@ static int __inet_check_established(struct inet_timewait_death_row *death_row,
 	int twrefcnt = 0;
 
 	spin_lock(lock);
+	head = inet_ehash_bucket(hinfo, hash);
 
 	/* Check TIME-WAIT sockets first. */
 	sk_nulls_for_each(sk2, node, &head->twchain) {
@@ -384,11 +405,11 @@ int __inet_hash_nolisten(struct sock *sk, struct inet_timewait_sock *tw)
 	WARN_ON(!sk_unhashed(sk));
 
 	sk->sk_hash = inet_sk_ehashfn(sk);
-	head = inet_ehash_bucket(hashinfo, sk->sk_hash);
-	list = &head->chain;
 	lock = inet_ehash_lockp(hashinfo, sk->sk_hash);
 
 	spin_lock(lock);
+	head = inet_ehash_bucket(hashinfo, sk->sk_hash);
+	list = &head->chain;
 	__sk_nulls_add_node_rcu(sk, list);
 	if (tw) {
 		WARN_ON(sk->sk_hash != tw->tw_hash);
@@ -582,3 +603,212 @@ void inet_hashinfo_init(struct inet_hashinfo *h)
 		}
 }
 EXPORT_SYMBOL_GPL(inet_hashinfo_init);
+
+static unsigned int inet_nulls_chain_len(struct hlist_nulls_head *head)
+{
+	struct hlist_nulls_node *node;
+	unsigned int len = 0;
+
+	for (node = rcu_dereference(hlist_nulls_first_rcu(head));
+	     !is_a_nulls(node);
+	     node = rcu_dereference(hlist_nulls_next_rcu(node)))
+		len++;
+	return len;
+}
+
+DEFINE_MUTEX(inet_ehash_mutex);
+
+static void inet_ehash_move_chain(struct hlist_nulls_head *from,
+				  const struct inet_ehash_view *v, int tw)
+{
+	struct hlist_nulls_node *node;
+	struct inet_ehash_bucket *to;
+	struct sock *sk;
+
+	while (!hlist_nulls_empty(from)) {
+		node = from->first;
+		/* timewait sockets share the sock_common layout */
+		sk = hlist_nulls_entry(node, struct sock, sk_nulls_node);
+		to = &v->ehash[sk->sk_hash & v->mask];
+		/*
+		 * A lockless reader standing on sk follows it into the new
+		 * chain, ends on a nulls value of the new table and restarts.
+		 * One that misses sk between the two steps is caught by
+		 * inet_ehash_lookup_retry().
+		 */
+		hlist_nulls_del_rcu(node);
+		hlist_nulls_add_head_rcu(node, tw ? &to->twchain : &to->chain);
+	}
+}
+
+/*
+ * Move the sockets of the old bucket of @hash into the current table.
+ * Called with the ehash lock of @hash held, which also covers every
+ * socket of that bucket since ehash_locks_mask <= ehash_old_mask.
+ */
+void inet_ehash_migrate(const struct inet_ehash_view *v, unsigned int hash)
+{
+	unsigned int slot = hash & v->old_mask;
+	struct inet_ehash_bucket *head = &v->old[slot];
+
+	if (v->old_state[slot] == INET_EHASH_MOVED)
+		return;
+	v->old_state[slot] = INET_EHASH_MOVING;
+	smp_wmb();
+	inet_ehash_move_chain(&head->chain, v, 0);
+	inet_ehash_move_chain(&head->twchain, v, 1);
+	smp_wmb();
+	v->old_state[slot] = INET_EHASH_MOVED;
+}
+EXPORT_SYMBOL_GPL(inet_ehash_migrate);
+
+/*
+ * Grow the established table to @size buckets, rounded up to a power
+ * of two.  The new table is published first, then the old buckets are
+ * emptied one at a time under their ehash lock.  Lockless lookups search
+ * the old table before the new one until it is gone, and start over
+ * on a miss that overlapped the move of their bucket.  Writers move
+ * their old bucket over themselves through inet_ehash_bucket().
+ */
+int inet_ehash_resize(struct inet_hashinfo *hashinfo, unsigned int size)
+{
+	struct inet_ehash_bucket *ehash, *old;
+	unsigned int i, old_mask, nulls;
+	u8 *state;
+	int err = 0;
+
+	if (!size || size > LISTENING_NULLS_BASE)
+		return -EINVAL;
+	size = roundup_pow_of_two(size);
+
+	mutex_lock(&inet_ehash_mutex);
+	old = hashinfo->ehash;
+	old_mask = hashinfo->ehash_mask;
+	if (size <= old_mask + 1) {
+		/* shrinking is not supported */
+		err = size == old_mask + 1 ? 0 : -EINVAL;
+		goto out;
+	}
+	/* a bucket must never need more than one lock */
+	if (hashinfo->ehash_locks_mask > old_mask) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	ehash = vmalloc(size * sizeof(*ehash));
+	state = vzalloc(old_mask + 1);
+	if (!ehash || !state) {
+		vfree(ehash);
+		vfree(state);
+		err = -ENOMEM;
+		goto out;
+	}
+	nulls = hashinfo->ehash_nulls ^ INET_EHASH_NULLS_GEN;
+	for (i = 0; i < size; i++) {
+		INIT_HLIST_NULLS_HEAD(&ehash[i].chain, i | nulls);
+		INIT_HLIST_NULLS_HEAD(&ehash[i].twchain, i | nulls);
+	}
+
+	local_bh_disable();
+	write_seqcount_begin(&hashinfo->ehash_seq);
+	hashinfo->ehash_old = old;
+	hashinfo->ehash_old_mask = old_mask;
+	hashinfo->ehash_old_state = state;
+	hashinfo->ehash = ehash;
+	hashinfo->ehash_mask = size - 1;
+	hashinfo->ehash_nulls = nulls;
+	write_seqcount_end(&hashinfo->ehash_seq);
+	local_bh_enable();
+
+	/*
+	 * Lookups that took their view before the publish walk the old
+	 * table as the current one and would not notice moves.
+	 */
+	synchronize_net();
+
+	for (i = 0; i <= old_mask; i++) {
+		spinlock_t *lock = inet_ehash_lockp(hashinfo, i);
+
+		spin_lock_bh(lock);
+		inet_ehash_bucket(hashinfo, i);
+		spin_unlock_bh(lock);
+		if (!(i & 1023))
+			cond_resched();
+	}
+
+	local_bh_disable();
+	write_seqcount_begin(&hashinfo->ehash_seq);
+	hashinfo->ehash_old = NULL;
+	hashinfo->ehash_old_state = NULL;
+	write_seqcount_end(&hashinfo->ehash_seq);
+	local_bh_enable();
+
+	/* Wait for lock holders and lockless lookups still looking at old. */
+	for (i = 0; i <= hashinfo->ehash_locks_mask; i++) {
+		spin_lock_bh(&hashinfo->ehash_locks[i]);
+		spin_unlock_bh(&hashinfo->ehash_locks[i]);
+	}
+	synchronize_net();
+
+	/* a boot time table from bootmem can't be given back */
+	if (is_vmalloc_addr(old))
+		vfree(old);
+	vfree(state);
+out:
+	mutex_unlock(&inet_ehash_mutex);
+	return err;
+}
+EXPORT_SYMBOL_GPL(inet_ehash_resize);
+
+/*
+ * Fill st[INET_CHAINS_MAX] with the chain lengths of each table.  The
+ * established and listening chains are walked under RCU only, so with
+ * sockets moving around the counts are a snapshot, not exact.
+ */
+void inet_hashinfo_chain_stats(struct inet_hashinfo *h,
+			       struct sk_chain_stats *st)
+{
+	struct inet_bind_hashbucket *bhead;
+	struct inet_bind_bucket *tb;
+	struct hlist_node *node;
+	unsigned int i, len;
+
+	memset(st, 0, INET_CHAINS_MAX * sizeof(*st));
+
+	mutex_lock(&inet_ehash_mutex);
+	for (i = 0; i <= h->ehash_mask; i++) {
+		struct inet_ehash_bucket *head = &h->ehash[i];
+
+		rcu_read_lock();
+		sk_chain_stats_add(&st[INET_CHAINS_EHASH],
+				   inet_nulls_chain_len(&head->chain));
+		sk_chain_stats_add(&st[INET_CHAINS_TWCHAIN],
+				   inet_nulls_chain_len(&head->twchain));
+		rcu_read_unlock();
+		if (!(i & 1023))
+			cond_resched();
+	}
+	mutex_unlock(&inet_ehash_mutex);
+
+	for (i = 0; i < h->bhash_size; i++) {
+		bhead = &h->bhash[i];
+		len = 0;
+		spin_lock_bh(&bhead->lock);
+		inet_bind_bucket_for_each(tb, node, &bhead->chain)
+			len++;
+		spin_unlock_bh(&bhead->lock);
+		sk_chain_stats_add(&st[INET_CHAINS_BHASH], len);
+		if (!(i & 1023))
+			cond_resched();
+	}
+
+	for (i = 0; i < INET_LHTABLE_SIZE; i++) {
+		struct inet_listen_hashbucket *ilb = &h->listening_hash[i];
+
+		rcu_read_lock();
+		len = inet_nulls_chain_len(&ilb->head);
+		rcu_read_unlock();
+		sk_chain_stats_add(&st[INET_CHAINS_LHASH], len);
+	}
+}
+EXPORT_SYMBOL_GPL(inet_hashinfo_chain_stats);
@@ -127,7 +127,7 @@ void __inet_twsk_hashdance(struct inet_timewait_sock *tw, struct sock *sk,
 {
 	const struct inet_sock *inet = inet_sk(sk);
 	const struct inet_connection_sock *icsk = inet_csk(sk);
-	struct inet_ehash_bucket *ehead = inet_ehash_bucket(hashinfo, sk->sk_hash);
+	struct inet_ehash_bucket *ehead;
 	spinlock_t *lock = inet_ehash_lockp(hashinfo, sk->sk_hash);
 	struct inet_bind_hashbucket *bhead;
 	/* Step 1: Put TW into bind hash. Original socket stays there too.
@@ -143,6 +143,7 @@ void __inet_twsk_hashdance(struct inet_timewait_sock *tw, struct sock *sk,
 	spin_unlock(&bhead->lock);
 
 	spin_lock(lock);
+	ehead = inet_ehash_bucket(hashinfo, sk->sk_hash);
 
 	/*
 	 * Step 2: Hash TW into TIMEWAIT chain.
@@ -484,6 +485,8 @@ void inet_twsk_purge(struct inet_hashinfo *hashinfo,
 	struct hlist_nulls_node *node;
 	unsigned int slot;
 
+	/* no resize while the table is walked locklessly */
+	mutex_lock(&inet_ehash_mutex);
 	for (slot = 0; slot <= hashinfo->ehash_mask; slot++) {
 		struct inet_ehash_bucket *head = &hashinfo->ehash[slot];
 restart_rcu:
@@ -515,9 +518,10 @@ restart:
 		 * not the expected one, we must restart lookup.
 		 * We probably met an item that was moved to another chain.
 		 */
-		if (get_nulls_value(node) != slot)
+		if (get_nulls_value(node) != (slot | hashinfo->ehash_nulls))
 			goto restart;
 		rcu_read_unlock();
 	}
+	mutex_unlock(&inet_ehash_mutex);
 }
 EXPORT_SYMBOL_GPL(inet_twsk_purge);
@@ -88,6 +88,84 @@ static const struct file_operations sockstat_seq_fops = {
 	.release = single_release_net,
 };
 
+/*
+ *	Report socket hash table chain lengths and lookup costs.  The tables
+ *	are shared by all namespaces.
+ */
+static void sockhash_show_chains(struct seq_file *seq, const char *name,
+				 const struct sk_chain_stats *st)
+{
+	int i;
+
+	seq_printf(seq, "%s: buckets %u used %u entries %u maxlen %u hist",
+		   name, st->buckets, st->used, st->entries, st->max_len);
+	for (i = 0; i < SK_CHAIN_HIST; i++)
+		seq_printf(seq, " %u", st->hist[i]);
+	seq_putc(seq, '\n');
+}
+
+static void sockhash_show_lookups(struct seq_file *seq, const char *name,
+				  struct sk_lookup_stats __percpu *stats)
+{
+	unsigned long lookups = 0, walked = 0;
+	int cpu;
+
+	if (!stats)
+		return;
+	for_each_possible_cpu(cpu) {
+		const struct sk_lookup_stats *s = per_cpu_ptr(stats, cpu);
+
+		lookups += s->lookups;
+		walked += s->walked;
+	}
+	seq_printf(seq, "%s: lookups %lu walked %lu\n", name, lookups, walked);
+}
+
+static void sockhash_show_udp(struct seq_file *seq, const char *name,
+			      const char *name2, struct udp_table *table)
+{
+	struct sk_chain_stats st, st2;
+
+	udp_table_chain_stats(table, &st, &st2);
+	sockhash_show_chains(seq, name, &st);
+	sockhash_show_chains(seq, name2, &st2);
+	sockhash_show_lookups(seq, name, table->lookup_stats);
+}
+
+static int sockhash_seq_show(struct seq_file *seq, void *v)
+{
+	static const char *const names[INET_CHAINS_MAX] = {
+		[INET_CHAINS_EHASH]	= "TCP-ehash",
+		[INET_CHAINS_TWCHAIN]	= "TCP-tw",
+		[INET_CHAINS_BHASH]	= "TCP-bhash",
+		[INET_CHAINS_LHASH]	= "TCP-listen",
+	};
+	struct sk_chain_stats st[INET_CHAINS_MAX];
+	int i;
+
+	inet_hashinfo_chain_stats(&tcp_hashinfo, st);
+	for (i = 0; i < INET_CHAINS_MAX; i++)
+		sockhash_show_chains(seq, names[i], &st[i]);
+	sockhash_show_lookups(seq, "TCP-ehash", tcp_hashinfo.lookup_stats);
+
+	sockhash_show_udp(seq, "UDP", "UDP-hash2", &udp_table);
+	sockhash_show_udp(seq, "UDPLITE", "UDPLITE-hash2", &udplite_table);
+	return 0;
+}
+
+static int sockhash_seq_open(struct inode *inode, struct file *file)
+{
+	return single_open_net(inode, file, sockhash_seq_show);
+}
+
+static const struct file_operations sockhash_seq_fops = {
+	.owner	 = THIS_MODULE,
+	.open	 = sockhash_seq_open,
+	.read	 = seq_read,
+	.llseek	 = seq_lseek,
+	.release = single_release_net,
+};
+
 /* snmp items */
 static const struct snmp_mib snmp4_ipstats_list[] = {
 	SNMP_MIB_ITEM("InReceives", IPSTATS_MIB_INPKTS),
@@ -254,6 +332,10 @@ static const struct snmp_mib snmp4_net_list[] = {
 	SNMP_MIB_ITEM("TCPDeferAcceptDrop", LINUX_MIB_TCPDEFERACCEPTDROP),
 	SNMP_MIB_ITEM("IPReversePathFilter", LINUX_MIB_IPRPFILTER),
 	SNMP_MIB_ITEM("TCPTimeWaitOverflow", LINUX_MIB_TCPTIMEWAITOVERFLOW),
+	SNMP_MIB_ITEM("TCPFastOpenActive", LINUX_MIB_TCPFASTOPENACTIVE),
+	SNMP_MIB_ITEM("TCPLossProbes", LINUX_MIB_TCPLOSSPROBES),
+	SNMP_MIB_ITEM("TCPLossProbeRecovery", LINUX_MIB_TCPLOSSPROBERECOVERY),
+	SNMP_MIB_ITEM("TCPEarlyRetrans", LINUX_MIB_TCPEARLYRETRANS),
 	SNMP_MIB_SENTINEL
 };
 
@@ -465,9 +547,14 @@ static __net_init int ip_proc_init_net(struct net *net)
 		goto out_netstat;
 	if (!proc_net_fops_create(net, "snmp", S_IRUGO, &snmp_seq_fops))
 		goto out_snmp;
+	/* walks every bucket, so keep it away from unprivileged users */
+	if (!proc_net_fops_create(net, "sockhash", S_IRUSR, &sockhash_seq_fops))
+		goto out_sockhash;
 
 	return 0;
 
+out_sockhash:
+	proc_net_remove(net, "snmp");
 out_snmp:
 	proc_net_remove(net, "netstat");
 out_netstat:
@@ -478,6 +565,7 @@ out_sockstat:
 
 static __net_exit void ip_proc_exit_net(struct net *net)
 {
+	proc_net_remove(net, "sockhash");
 	proc_net_remove(net, "snmp");
 	proc_net_remove(net, "netstat");
 	proc_net_remove(net, "sockstat");
@@ -26,6 +26,7 @@
 
 static int zero;
 static int tcp_retr1_max = 255;
+static int tcp_early_retrans_max = 4;
 static int ip_local_port_range_min[] = { 1, 1 };
 static int ip_local_port_range_max[] = { 65535, 65535 };
 static int tcp_adv_win_scale_min = -31;
@@ -137,6 +138,24 @@ static int proc_tcp_congestion_control(ctl_table *ctl, int write,
 	return ret;
 }
 
+static int proc_tcp_ehash_entries(ctl_table *ctl, int write,
+				  void __user *buffer, size_t *lenp,
+				  loff_t *ppos)
+{
+	int entries = tcp_hashinfo.ehash_mask + 1;
+	ctl_table tbl = {
+		.data = &entries,
+		.maxlen = sizeof(entries),
+	};
+	int ret;
+
+	ret = proc_dointvec(&tbl, write, buffer, lenp, ppos);
+	if (write && ret == 0)
+		ret = entries > 0 ?
+			inet_ehash_resize(&tcp_hashinfo, entries) : -EINVAL;
+	return ret;
+}
+
 static int proc_tcp_available_congestion_control(ctl_table *ctl,
 						 int write,
 						 void __user *buffer, size_t *lenp,
@@ -254,6 +273,12 @@ static struct ctl_table ipv4_table[] = {
 		.mode		= 0644,
 		.proc_handler	= proc_dointvec
 	},
+	{
+		.procname	= "tcp_ehash_entries",
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_tcp_ehash_entries,
+	},
 	{
 		.procname	= "ip_dynaddr",
 		.data		= &sysctl_ip_dynaddr,
@@ -638,6 +663,13 @@ static struct ctl_table ipv4_table[] = {
 		.mode		= 0644,
 		.proc_handler	= proc_dointvec
 	},
+	{
+		.procname	= "tcp_fastopen",
+		.data		= &sysctl_tcp_fastopen,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec,
+	},
 	{
 		.procname       = "tcp_thin_linear_timeouts",
 		.data           = &sysctl_tcp_thin_linear_timeouts,
@@ -652,6 +684,15 @@ static struct ctl_table ipv4_table[] = {
 		.mode           = 0644,
 		.proc_handler   = proc_dointvec
 	},
+	{
+		.procname	= "tcp_early_retrans",
+		.data		= &sysctl_tcp_early_retrans,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &zero,
+		.extra2		= &tcp_early_retrans_max
+	},
 	{
 		.procname	= "udp_mem",
 		.data		= &sysctl_udp_mem,
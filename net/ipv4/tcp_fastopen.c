@@ -0,0 +1,72 @@
+/*
+ * TCP Fast Open: send data in the opening SYN (draft-ietf-tcpm-fastopen).
+ *
+ * Only the client side is implemented.  It keeps the cookie and the MSS
+ * learned from a server in the inet_peer entry of the destination.
+ *
+ * A server would have to create the child socket from the SYN and queue
+ * its payload to the listener before the handshake completes, which the
+ * request_sock path here cannot do.  The sysctl flag 2 stays reserved
+ * for it.
+ */
+
+#include <linux/kernel.h>
+#include <linux/seqlock.h>
+#include <net/inetpeer.h>
+#include <net/tcp.h>
+
+int sysctl_tcp_fastopen __read_mostly;
+
+/* Protects the Fast Open fields of all inet_peer entries. */
+static DEFINE_SEQLOCK(fastopen_seqlock);
+
+void tcp_fastopen_cache_get(struct sock *sk, u16 *mss,
+			    struct tcp_fastopen_cookie *cookie,
+			    int *syn_loss, unsigned long *last_syn_loss)
+{
+	struct inet_peer *peer;
+	bool release_it;
+	unsigned int seq;
+
+	peer = inet_csk(sk)->icsk_af_ops->get_peer(sk, &release_it);
+	if (!peer)
+		return;
+
+	do {
+		seq = read_seqbegin(&fastopen_seqlock);
+		if (peer->tfo_mss)
+			*mss = peer->tfo_mss;
+		*cookie = peer->tfo_cookie;
+		*syn_loss = peer->tfo_syn_loss;
+		*last_syn_loss = *syn_loss ? peer->tfo_syn_loss_ts : 0;
+	} while (read_seqretry(&fastopen_seqlock, seq));
+
+	if (release_it)
+		inet_putpeer(peer);
+}
+
+void tcp_fastopen_cache_set(struct sock *sk, u16 mss,
+			    struct tcp_fastopen_cookie *cookie, bool syn_lost)
+{
+	struct inet_peer *peer;
+	bool release_it;
+
+	peer = inet_csk(sk)->icsk_af_ops->get_peer(sk, &release_it);
+	if (!peer)
+		return;
+
+	write_seqlock_bh(&fastopen_seqlock);
+	if (mss)
+		peer->tfo_mss = mss;
+	if (cookie->len > 0)
+		peer->tfo_cookie = *cookie;
+	if (syn_lost) {
+		++peer->tfo_syn_loss;
+		peer->tfo_syn_loss_ts = jiffies;
+	} else
+		peer->tfo_syn_loss = 0;
+	write_sequnlock_bh(&fastopen_seqlock);
+
+	if (release_it)
+		inet_putpeer(peer);
+}
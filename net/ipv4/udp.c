@@ -401,7 +401,8 @@ static inline int compute_score2(struct sock *sk, struct net *net,
 static struct sock *udp4_lib_lookup2(struct net *net,
 		__be32 saddr, __be16 sport,
 		__be32 daddr, unsigned int hnum, int dif,
-		struct udp_hslot *hslot2, unsigned int slot2)
+		struct udp_hslot *hslot2, unsigned int slot2,
+		unsigned int *walked)
 {
 	struct sock *sk, *result;
 	struct hlist_nulls_node *node;
@@ -411,6 +412,7 @@ begin:
 	result = NULL;
 	badness = -1;
 	udp_portaddr_for_each_entry_rcu(sk, node, &hslot2->head) {
+		(*walked)++;
 		score = compute_score2(sk, net, saddr, sport,
 				      daddr, hnum, dif);
 		if (score > badness) {
@@ -454,6 +456,7 @@ static struct sock *__udp4_lib_lookup(struct net *net, __be32 saddr,
 	unsigned int hash2, slot2, slot = udp_hashfn(net, hnum, udptable->mask);
 	struct udp_hslot *hslot2, *hslot = &udptable->hash[slot];
 	int score, badness;
+	unsigned int walked = 0;
 
 	rcu_read_lock();
 	if (hslot->count > 10) {
@@ -465,7 +468,7 @@ static struct sock *__udp4_lib_lookup(struct net *net, __be32 saddr,
 
 		result = udp4_lib_lookup2(net, saddr, sport,
 					  daddr, hnum, dif,
-					  hslot2, slot2);
+					  hslot2, slot2, &walked);
 		if (!result) {
 			hash2 = udp4_portaddr_hash(net, htonl(INADDR_ANY), hnum);
 			slot2 = hash2 & udptable->mask;
@@ -475,15 +478,17 @@ static struct sock *__udp4_lib_lookup(struct net *net, __be32 saddr,
 
 			result = udp4_lib_lookup2(net, saddr, sport,
 						  htonl(INADDR_ANY), hnum, dif,
-						  hslot2, slot2);
+						  hslot2, slot2, &walked);
 		}
 		rcu_read_unlock();
+		sk_lookup_stats_add(udptable->lookup_stats, walked);
 		return result;
 	}
 begin:
 	result = NULL;
 	badness = -1;
 	sk_nulls_for_each_rcu(sk, node, &hslot->head) {
+		walked++;
 		score = compute_score(sk, net, saddr, hnum, sport,
 				      daddr, dport, dif);
 		if (score > badness) {
@@ -509,6 +514,7 @@ begin:
 		}
 	}
 	rcu_read_unlock();
+	sk_lookup_stats_add(udptable->lookup_stats, walked);
 	return result;
 }
 
@@ -2211,8 +2217,27 @@ void __init udp_table_init(struct udp_table *table, const char *name)
 		table->hash2[i].count = 0;
 		spin_lock_init(&table->hash2[i].lock);
 	}
+	/* lookups just go unaccounted if this fails */
+	table->lookup_stats = alloc_percpu(struct sk_lookup_stats);
 }
 
+/* Chain lengths of the port (st) and port+address (st2) hashes, from the
+ * per slot counts.
+ */
+void udp_table_chain_stats(struct udp_table *table, struct sk_chain_stats *st,
+			   struct sk_chain_stats *st2)
+{
+	unsigned int i;
+
+	memset(st, 0, sizeof(*st));
+	memset(st2, 0, sizeof(*st2));
+	for (i = 0; i <= table->mask; i++) {
+		sk_chain_stats_add(st, ACCESS_ONCE(table->hash[i].count));
+		sk_chain_stats_add(st2, ACCESS_ONCE(table->hash2[i].count));
+	}
+}
+EXPORT_SYMBOL(udp_table_chain_stats);
+
 void __init udp_init(void)
 {
 	unsigned long limit;
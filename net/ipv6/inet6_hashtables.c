@@ -43,9 +43,9 @@ int __inet6_hash(struct sock *sk, struct inet_timewait_sock *tw)
 		spinlock_t *lock;
 
 		sk->sk_hash = hash = inet6_sk_ehashfn(sk);
-		list = &inet_ehash_bucket(hashinfo, hash)->chain;
 		lock = inet_ehash_lockp(hashinfo, hash);
 		spin_lock(lock);
+		list = &inet_ehash_bucket(hashinfo, hash)->chain;
 		__sk_nulls_add_node_rcu(sk, list);
 		if (tw) {
 			WARN_ON(sk->sk_hash != tw->tw_hash);
@@ -80,13 +80,22 @@ struct sock *__inet6_lookup_established(struct net *net,
 	 * have wildcards anyways.
 	 */
 	unsigned int hash = inet6_ehashfn(net, daddr, hnum, saddr, sport);
-	unsigned int slot = hash & hashinfo->ehash_mask;
-	struct inet_ehash_bucket *head = &hashinfo->ehash[slot];
-
+	struct inet_ehash_bucket *head;
+	struct inet_ehash_view v;
+	unsigned int slot, walked = 0;
+	int old;
+	u8 state;
 
 	rcu_read_lock();
+restart:
+	inet_ehash_view(hashinfo, &v);
+	old = v.old != NULL;
+	state = inet_ehash_old_state(&v, hash);
+lookup:
+	head = inet_ehash_view_bucket(&v, old, hash, &slot);
 begin:
 	sk_nulls_for_each_rcu(sk, node, &head->chain) {
+		walked++;
 		/* For IPV6 do the cheaper port and family tests first. */
 		if (INET6_MATCH(sk, net, hash, saddr, daddr, ports, dif)) {
 			if (unlikely(!atomic_inc_not_zero(&sk->sk_refcnt)))
@@ -104,6 +113,7 @@ begin:
 begintw:
 	/* Must check for a TIME_WAIT'er before going to listener hash. */
 	sk_nulls_for_each_rcu(sk, node, &head->twchain) {
+		walked++;
 		if (INET6_TW_MATCH(sk, net, hash, saddr, daddr, ports, dif)) {
 			if (unlikely(!atomic_inc_not_zero(&sk->sk_refcnt))) {
 				sk = NULL;
@@ -118,9 +128,16 @@ begintw:
 	}
 	if (get_nulls_value(node) != slot)
 		goto begintw;
+	if (old) {
+		old = 0;
+		goto lookup;
+	}
+	if (unlikely(inet_ehash_lookup_retry(&v, hash, state)))
+		goto restart;
 	sk = NULL;
 out:
 	rcu_read_unlock();
+	sk_lookup_stats_add(hashinfo->lookup_stats, walked);
 	return sk;
 }
 EXPORT_SYMBOL(__inet6_lookup_established);
@@ -225,7 +242,7 @@ static int __inet6_check_established(struct inet_timewait_death_row *death_row,
 	struct net *net = sock_net(sk);
 	const unsigned int hash = inet6_ehashfn(net, daddr, lport, saddr,
 						inet->inet_dport);
-	struct inet_ehash_bucket *head = inet_ehash_bucket(hinfo, hash);
+	struct inet_ehash_bucket *head;
 	spinlock_t *lock = inet_ehash_lockp(hinfo, hash);
 	struct sock *sk2;
 	const struct hlist_nulls_node *node;
@@ -233,6 +250,7 @@ static int __inet6_check_established(struct inet_timewait_death_row *death_row,
 	int twrefcnt = 0;
 
 	spin_lock(lock);
+	head = inet_ehash_bucket(hinfo, hash);
 
 	/* Check TIME-WAIT sockets first. */
 	sk_nulls_for_each(sk2, node, &head->twchain) {
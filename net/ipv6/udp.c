@@ -198,7 +198,8 @@ static inline int compute_score2(struct sock *sk, struct net *net,
 static struct sock *udp6_lib_lookup2(struct net *net,
 		const struct in6_addr *saddr, __be16 sport,
 		const struct in6_addr *daddr, unsigned int hnum, int dif,
-		struct udp_hslot *hslot2, unsigned int slot2)
+		struct udp_hslot *hslot2, unsigned int slot2,
+		unsigned int *walked)
 {
 	struct sock *sk, *result;
 	struct hlist_nulls_node *node;
@@ -208,6 +209,7 @@ begin:
 	result = NULL;
 	badness = -1;
 	udp_portaddr_for_each_entry_rcu(sk, node, &hslot2->head) {
+		(*walked)++;
 		score = compute_score2(sk, net, saddr, sport,
 				      daddr, hnum, dif);
 		if (score > badness) {
@@ -249,6 +251,7 @@ static struct sock *__udp6_lib_lookup(struct net *net,
 	unsigned int hash2, slot2, slot = udp_hashfn(net, hnum, udptable->mask);
 	struct udp_hslot *hslot2, *hslot = &udptable->hash[slot];
 	int score, badness;
+	unsigned int walked = 0;
 
 	rcu_read_lock();
 	if (hslot->count > 10) {
@@ -260,7 +263,7 @@ static struct sock *__udp6_lib_lookup(struct net *net,
 
 		result = udp6_lib_lookup2(net, saddr, sport,
 					  daddr, hnum, dif,
-					  hslot2, slot2);
+					  hslot2, slot2, &walked);
 		if (!result) {
 			hash2 = udp6_portaddr_hash(net, &in6addr_any, hnum);
 			slot2 = hash2 & udptable->mask;
@@ -270,15 +273,17 @@ static struct sock *__udp6_lib_lookup(struct net *net,
 
 			result = udp6_lib_lookup2(net, saddr, sport,
 						  &in6addr_any, hnum, dif,
-						  hslot2, slot2);
+						  hslot2, slot2, &walked);
 		}
 		rcu_read_unlock();
+		sk_lookup_stats_add(udptable->lookup_stats, walked);
 		return result;
 	}
 begin:
 	result = NULL;
 	badness = -1;
 	sk_nulls_for_each_rcu(sk, node, &hslot->head) {
+		walked++;
 		score = compute_score(sk, net, hnum, saddr, sport, daddr, dport, dif);
 		if (score > badness) {
 			result = sk;
@@ -303,6 +308,7 @@ begin:
 		}
 	}
 	rcu_read_unlock();
+	sk_lookup_stats_add(udptable->lookup_stats, walked);
 	return result;
 }
 
@@ -0,0 +1,127 @@
+/*
+ * nfnetlink_xtstate - report the named objects of xtables extensions
+ * (quota2 counters, IDLETIMER timers) in one netlink dump, instead of
+ * one procfs or sysfs read per object.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/skbuff.h>
+#include <linux/netlink.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nfnetlink_xtstate.h>
+#include <net/netlink.h>
+#include <net/netfilter/nfnetlink_xtstate.h>
+
+static LIST_HEAD(nfnl_xtstate_providers);
+static DEFINE_MUTEX(nfnl_xtstate_mutex);
+
+void nfnl_xtstate_register(struct nfnl_xtstate_provider *p)
+{
+	mutex_lock(&nfnl_xtstate_mutex);
+	list_add_tail(&p->list, &nfnl_xtstate_providers);
+	mutex_unlock(&nfnl_xtstate_mutex);
+}
+EXPORT_SYMBOL_GPL(nfnl_xtstate_register);
+
+void nfnl_xtstate_unregister(struct nfnl_xtstate_provider *p)
+{
+	mutex_lock(&nfnl_xtstate_mutex);
+	list_del(&p->list);
+	mutex_unlock(&nfnl_xtstate_mutex);
+}
+EXPORT_SYMBOL_GPL(nfnl_xtstate_unregister);
+
+/* cb->args[0]: provider to resume with, cb->args[1]: object within it,
+ * cb->args[2]: set once everything has been sent.
+ */
+static int nfnl_xtstate_dump(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct nfnl_xtstate_provider *p;
+	struct nlmsghdr *nlh;
+	struct nfgenmsg *nfmsg;
+	unsigned char *empty;
+	unsigned long i = 0;
+	int err = 0;
+
+	if (cb->args[2])
+		return 0;
+
+	nlh = nlmsg_put(skb, NETLINK_CB(cb->skb).pid, cb->nlh->nlmsg_seq,
+			NFNL_SUBSYS_XTSTATE << 8 | NFNL_MSG_XTSTATE_GET,
+			sizeof(*nfmsg), NLM_F_MULTI);
+	if (!nlh)
+		return -EMSGSIZE;
+
+	nfmsg = nlmsg_data(nlh);
+	nfmsg->nfgen_family = AF_UNSPEC;
+	nfmsg->version = NFNETLINK_V0;
+	nfmsg->res_id = 0;
+	empty = skb_tail_pointer(skb);
+
+	mutex_lock(&nfnl_xtstate_mutex);
+	list_for_each_entry(p, &nfnl_xtstate_providers, list) {
+		if (i++ < cb->args[0])
+			continue;
+		err = p->fill(skb, &cb->args[1]);
+		if (err < 0)
+			break;
+		cb->args[0]++;
+		cb->args[1] = 0;
+	}
+	mutex_unlock(&nfnl_xtstate_mutex);
+
+	if (err < 0 && skb_tail_pointer(skb) == empty) {
+		/* not even one object fits, don't loop forever */
+		nlmsg_cancel(skb, nlh);
+		return err;
+	}
+	if (err == 0)
+		cb->args[2] = 1;
+	nlmsg_end(skb, nlh);
+	return skb->len;
+}
+
+static int nfnl_xtstate_get(struct sock *nl, struct sk_buff *skb,
+			    const struct nlmsghdr *nlh,
+			    const struct nlattr * const cda[])
+{
+	if (!(nlh->nlmsg_flags & NLM_F_DUMP))
+		return -EOPNOTSUPP;
+
+	return netlink_dump_start(nl, skb, nlh, nfnl_xtstate_dump, NULL);
+}
+
+static const struct nfnl_callback nfnl_xtstate_cb[NFNL_MSG_XTSTATE_MAX] = {
+	[NFNL_MSG_XTSTATE_GET]	= { .call = nfnl_xtstate_get,
+				    .attr_count = NFXTSTATE_MAX, },
+};
+
+static const struct nfnetlink_subsystem nfnl_xtstate_subsys = {
+	.name		= "xtstate",
+	.subsys_id	= NFNL_SUBSYS_XTSTATE,
+	.cb_count	= NFNL_MSG_XTSTATE_MAX,
+	.cb		= nfnl_xtstate_cb,
+};
+
+static int __init nfnl_xtstate_init(void)
+{
+	return nfnetlink_subsys_register(&nfnl_xtstate_subsys);
+}
+
+static void __exit nfnl_xtstate_exit(void)
+{
+	nfnetlink_subsys_unregister(&nfnl_xtstate_subsys);
+}
+
+module_init(nfnl_xtstate_init);
+module_exit(nfnl_xtstate_exit);
+
+MODULE_DESCRIPTION("netfilter: xtables object state over nfnetlink");
+MODULE_LICENSE("GPL");
+MODULE_ALIAS_NFNL_SUBSYS(NFNL_SUBSYS_XTSTATE);
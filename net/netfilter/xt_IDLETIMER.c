@@ -36,10 +36,13 @@
 #include <linux/netfilter.h>
 #include <linux/netfilter/x_tables.h>
 #include <linux/netfilter/xt_IDLETIMER.h>
+#include <linux/netfilter/nfnetlink_xtstate.h>
 #include <linux/kdev_t.h>
 #include <linux/kobject.h>
 #include <linux/workqueue.h>
 #include <linux/sysfs.h>
+#include <net/netlink.h>
+#include <net/netfilter/nfnetlink_xtstate.h>
 
 struct idletimer_tg_attr {
 	struct attribute attr;
@@ -78,6 +81,14 @@ struct idletimer_tg *__idletimer_tg_find_by_label(const char *label)
 	return NULL;
 }
 
+/* seconds until the timer expires, 0 once it has */
+static unsigned int idletimer_tg_remaining(unsigned long expires)
+{
+	if (time_after(expires, jiffies))
+		return jiffies_to_msecs(expires - jiffies) / 1000;
+	return 0;
+}
+
 static ssize_t idletimer_tg_show(struct kobject *kobj, struct attribute *attr,
 				 char *buf)
 {
@@ -92,13 +103,43 @@ static ssize_t idletimer_tg_show(struct kobject *kobj, struct attribute *attr,
 
 	mutex_unlock(&list_mutex);
 
-	if (time_after(expires, jiffies))
-		return sprintf(buf, "%u\n",
-			       jiffies_to_msecs(expires - jiffies) / 1000);
+	return sprintf(buf, "%u\n", idletimer_tg_remaining(expires));
+}
+
+static int idletimer_tg_xtstate_fill(struct sk_buff *skb, unsigned long *pos)
+{
+	struct idletimer_tg *entry;
+	struct nlattr *nest = NULL;
+	unsigned long i = 0;
 
-	return sprintf(buf, "0\n");
+	mutex_lock(&list_mutex);
+	list_for_each_entry(entry, &idletimer_tg_list, entry) {
+		if (i++ < *pos)
+			continue;
+
+		nest = nla_nest_start(skb, NFXTSTATE_IDLETIMER);
+		if (nest == NULL)
+			goto nla_put_failure;
+		NLA_PUT_STRING(skb, NFXTSTATE_IDLETIMER_LABEL,
+			       entry->attr.attr.name);
+		NLA_PUT_BE32(skb, NFXTSTATE_IDLETIMER_REMAINING,
+			     htonl(idletimer_tg_remaining(entry->timer.expires)));
+		nla_nest_end(skb, nest);
+		(*pos)++;
+	}
+	mutex_unlock(&list_mutex);
+	return 0;
+
+nla_put_failure:
+	nla_nest_cancel(skb, nest);
+	mutex_unlock(&list_mutex);
+	return -EMSGSIZE;
 }
 
+static struct nfnl_xtstate_provider idletimer_tg_xtstate = {
+	.fill = idletimer_tg_xtstate_fill,
+};
+
 static void idletimer_tg_work(struct work_struct *work)
 {
 	struct idletimer_tg *timer = container_of(work, struct idletimer_tg,
@@ -289,6 +330,7 @@ static int __init idletimer_tg_init(void)
 		goto out_dev;
 	}
 
+	nfnl_xtstate_register(&idletimer_tg_xtstate);
 	return 0;
 out_dev:
 	device_destroy(idletimer_tg_class, MKDEV(0, 0));
@@ -300,6 +342,7 @@ out:
 
 static void __exit idletimer_tg_exit(void)
 {
+	nfnl_xtstate_unregister(&idletimer_tg_xtstate);
 	xt_unregister_target(&idletimer_tg);
 
 	device_destroy(idletimer_tg_class, MKDEV(0, 0));
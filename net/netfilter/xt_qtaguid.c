@@ -15,6 +15,7 @@
 #define DEBUG
 
 #include <linux/file.h>
+#include <linux/hash.h>
 #include <linux/inetdevice.h>
 #include <linux/module.h>
 #include <linux/netfilter/x_tables.h>
@@ -113,6 +114,9 @@ static struct proc_dir_entry *iface_stat_procdir;
 static const char *iface_stat_all_procfilename = "iface_stat_all";
 static struct proc_dir_entry *iface_stat_all_procfile;
 
+/* Per-cpu tag_stat counter arrays, see struct tag_stat_counters */
+static struct kmem_cache *tag_stat_counters_cachep;
+
 /*
  * Ordering of locks:
  *  outer locks:
@@ -124,6 +128,13 @@ static struct proc_dir_entry *iface_stat_all_procfile;
  * Notice how sock_tag_list_lock is held sometimes when uid_tag_data_tree_lock
  * is acquired.
  *
+ * The per packet path does not take iface_stat_list_lock, sock_tag_list_lock,
+ * tag_counter_set_list_lock nor tag_stat_list_lock: iface_stat_list,
+ * sock_tag_hash, tag_counter_set_hash and the iface_stat->tag_stat_hash are
+ * walked under rcu_read_lock(), and the tag_stat counters are per cpu. The
+ * locks above only serialize the writers and the slow path creating a new
+ * tag_stat.
+ *
  * Call tree with all lock holders as of 2011-09-25:
  *
  * iface_stat_all_proc_read()
@@ -178,15 +189,13 @@ static struct proc_dir_entry *iface_stat_all_procfile;
  * qtaguid_mt()
  *   account_for_uid()
  *     if_tag_stat_update()
- *       get_sock_stat()
- *         sock_tag_list_lock
- *       struct iface_stat->tag_stat_list_lock
+ *       rcu_read_lock()
+ *         get_sock_tag_rcu()
  *         tag_stat_update()
  *           get_active_counter_set()
- *             tag_counter_set_list_lock
- *         tag_stat_update()
- *           get_active_counter_set()
- *             tag_counter_set_list_lock
+ *         struct iface_stat->tag_stat_list_lock (new tag_stat only)
+ *           tag_stat_update()
+ *             get_active_counter_set()
  *
  *
  * qtaguid_ctrl_parse()
@@ -216,9 +225,18 @@ static DEFINE_SPINLOCK(iface_stat_list_lock);
 
 static struct rb_root sock_tag_tree = RB_ROOT;
 static DEFINE_SPINLOCK(sock_tag_list_lock);
+/* Mirrors sock_tag_tree for RCU lookups. Updated under sock_tag_list_lock. */
+#define SOCK_TAG_HASH_BITS 8
+static struct hlist_head sock_tag_hash[1 << SOCK_TAG_HASH_BITS];
 
 static struct rb_root tag_counter_set_tree = RB_ROOT;
 static DEFINE_SPINLOCK(tag_counter_set_list_lock);
+/*
+ * Mirrors tag_counter_set_tree for RCU lookups.
+ * Updated under tag_counter_set_list_lock.
+ */
+#define TAG_COUNTER_SET_HASH_BITS 5
+static struct hlist_head tag_counter_set_hash[1 << TAG_COUNTER_SET_HASH_BITS];
 
 static struct rb_root uid_tag_data_tree = RB_ROOT;
 static DEFINE_SPINLOCK(uid_tag_data_tree_lock);
@@ -345,6 +363,26 @@ static void tag_counter_set_tree_insert(struct tag_counter_set *data,
 	tag_node_tree_insert(&data->tn, root);
 }
 
+static inline struct hlist_head *tag_counter_set_hash_bucket(tag_t tag)
+{
+	return &tag_counter_set_hash[hash_64(tag, TAG_COUNTER_SET_HASH_BITS)];
+}
+
+/* Caller must hold tag_counter_set_list_lock */
+static void tag_counter_set_link(struct tag_counter_set *tcs)
+{
+	tag_counter_set_tree_insert(tcs, &tag_counter_set_tree);
+	hlist_add_head_rcu(&tcs->hnode,
+			   tag_counter_set_hash_bucket(tcs->tn.tag));
+}
+
+/* Caller must hold tag_counter_set_list_lock */
+static void tag_counter_set_unlink(struct tag_counter_set *tcs)
+{
+	rb_erase(&tcs->tn.node, &tag_counter_set_tree);
+	hlist_del_rcu(&tcs->hnode);
+}
+
 static struct tag_counter_set *tag_counter_set_tree_search(struct rb_root *root,
 							   tag_t tag)
 {
@@ -424,10 +462,31 @@ static void sock_tag_tree_erase(struct rb_root *st_to_free_tree)
 			 get_uid_from_tag(st_entry->tag));
 		rb_erase(&st_entry->sock_node, st_to_free_tree);
 		sockfd_put(st_entry->socket);
-		kfree(st_entry);
+		/* The packet path might still be looking at it */
+		kfree_rcu(st_entry, rcu);
 	}
 }
 
+static inline struct hlist_head *sock_tag_hash_bucket(const struct sock *sk)
+{
+	return &sock_tag_hash[hash_ptr((void *)sk, SOCK_TAG_HASH_BITS)];
+}
+
+/* Caller must hold sock_tag_list_lock */
+static void sock_tag_link(struct sock_tag *st_entry)
+{
+	sock_tag_tree_insert(st_entry, &sock_tag_tree);
+	hlist_add_head_rcu(&st_entry->sock_hnode,
+			   sock_tag_hash_bucket(st_entry->sk));
+}
+
+/* Caller must hold sock_tag_list_lock */
+static void sock_tag_unlink(struct sock_tag *st_entry)
+{
+	rb_erase(&st_entry->sock_node, &sock_tag_tree);
+	hlist_del_rcu(&st_entry->sock_hnode);
+}
+
 static struct proc_qtu_data *proc_qtu_data_tree_search(struct rb_root *root,
 						       const pid_t pid)
 {
@@ -739,23 +798,29 @@ static int get_active_counter_set(tag_t tag)
 {
 	int active_set = 0;
 	struct tag_counter_set *tcs;
+	struct hlist_node *node;
 
 	MT_DEBUG("qtaguid: get_active_counter_set(tag=0x%llx)"
 		 " (uid=%u)\n",
 		 tag, get_uid_from_tag(tag));
 	/* For now we only handle UID tags for active sets */
 	tag = get_utag_from_tag(tag);
-	spin_lock_bh(&tag_counter_set_list_lock);
-	tcs = tag_counter_set_tree_search(&tag_counter_set_tree, tag);
-	if (tcs)
-		active_set = tcs->active_set;
-	spin_unlock_bh(&tag_counter_set_list_lock);
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(tcs, node, tag_counter_set_hash_bucket(tag),
+				 hnode) {
+		if (tcs->tn.tag == tag) {
+			active_set = ACCESS_ONCE(tcs->active_set);
+			break;
+		}
+	}
+	rcu_read_unlock();
 	return active_set;
 }
 
 /*
  * Find the entry for tracking the specified interface.
- * Caller must hold iface_stat_list_lock
+ * Caller must hold iface_stat_list_lock or rcu_read_lock().
+ * iface_stat entries are never freed once on the list.
  */
 static struct iface_stat *get_iface_entry(const char *ifname)
 {
@@ -768,7 +833,7 @@ static struct iface_stat *get_iface_entry(const char *ifname)
 	}
 
 	/* Iterate over interfaces */
-	list_for_each_entry(iface_entry, &iface_stat_list, list) {
+	list_for_each_entry_rcu(iface_entry, &iface_stat_list, list) {
 		if (!strcmp(ifname, iface_entry->ifname))
 			goto done;
 	}
@@ -923,6 +988,7 @@ static struct iface_stat *iface_alloc(struct net_device *net_dev)
 	}
 	spin_lock_init(&new_iface->tag_stat_list_lock);
 	new_iface->tag_stat_tree = RB_ROOT;
+	/* kzalloc() already left the tag_stat_hash heads empty */
 	_iface_stat_set_active(new_iface, net_dev, true);
 
 	/*
@@ -941,7 +1007,7 @@ static struct iface_stat *iface_alloc(struct net_device *net_dev)
 	isw->iface_entry = new_iface;
 	INIT_WORK(&isw->iface_work, iface_create_proc_worker);
 	schedule_work(&isw->iface_work);
-	list_add(&new_iface->list, &iface_stat_list);
+	list_add_rcu(&new_iface->list, &iface_stat_list);
 	return new_iface;
 }
 
@@ -1131,22 +1197,50 @@ static struct sock_tag *get_sock_stat_nl(const struct sock *sk)
 	return sock_tag_tree_search(&sock_tag_tree, sk);
 }
 
-static struct sock_tag *get_sock_stat(const struct sock *sk)
+/*
+ * Lockless lookup of the tag on a socket.
+ * Caller must hold rcu_read_lock().
+ * Returns false if the socket is not tagged.
+ */
+static bool get_sock_tag_rcu(const struct sock *sk, tag_t *tag)
 {
 	struct sock_tag *sock_tag_entry;
-	MT_DEBUG("qtaguid: get_sock_stat(sk=%p)\n", sk);
+	struct hlist_node *node;
+
+	MT_DEBUG("qtaguid: get_sock_tag_rcu(sk=%p)\n", sk);
 	if (!sk)
-		return NULL;
-	spin_lock_bh(&sock_tag_list_lock);
-	sock_tag_entry = get_sock_stat_nl(sk);
-	spin_unlock_bh(&sock_tag_list_lock);
-	return sock_tag_entry;
+		return false;
+	hlist_for_each_entry_rcu(sock_tag_entry, node,
+				 sock_tag_hash_bucket(sk), sock_hnode) {
+		if (sock_tag_entry->sk == sk) {
+			unsigned seq;
+
+			do {
+				seq = read_seqcount_begin(
+					&sock_tag_entry->tag_seq);
+				*tag = sock_tag_entry->tag;
+			} while (read_seqcount_retry(&sock_tag_entry->tag_seq,
+						     seq));
+			return true;
+		}
+	}
+	return false;
 }
 
 static void
-data_counters_update(struct data_counters *dc, int set,
+data_counters_update(struct tag_stat_counters *tsc, int set,
 		     enum ifs_tx_rx direction, int proto, int bytes)
 {
+	struct data_counters *dc;
+
+	/*
+	 * The same cpu can come in here from process context (tx) and from
+	 * softirq (rx), so keep BHs off while touching our slot.
+	 */
+	local_bh_disable();
+	tsc += smp_processor_id();
+	dc = &tsc->dc;
+	u64_stats_update_begin(&tsc->syncp);
 	switch (proto) {
 	case IPPROTO_TCP:
 		dc_add_byte_packets(dc, set, direction, IFS_TCP, bytes, 1);
@@ -1160,6 +1254,8 @@ data_counters_update(struct data_counters *dc, int set,
 				    1);
 		break;
 	}
+	u64_stats_update_end(&tsc->syncp);
+	local_bh_enable();
 }
 
 /*
@@ -1225,20 +1321,43 @@ static void tag_stat_update(struct tag_stat *tag_entry,
 		 "dir=%d proto=%d bytes=%d)\n",
 		 tag_entry->tn.tag, get_uid_from_tag(tag_entry->tn.tag),
 		 active_set, direction, proto, bytes);
-	data_counters_update(&tag_entry->counters, active_set, direction,
+	data_counters_update(tag_entry->counters, active_set, direction,
 			     proto, bytes);
 	if (tag_entry->parent_counters)
 		data_counters_update(tag_entry->parent_counters, active_set,
 				     direction, proto, bytes);
 }
 
+static inline struct hlist_head *tag_stat_hash_bucket(
+	struct iface_stat *iface_entry, tag_t tag)
+{
+	return &iface_entry->tag_stat_hash[hash_64(tag, TAG_STAT_HASH_BITS)];
+}
+
+/* Caller must hold rcu_read_lock() or iface_entry->tag_stat_list_lock */
+static struct tag_stat *tag_stat_hash_search(struct iface_stat *iface_entry,
+					     tag_t tag)
+{
+	struct tag_stat *ts_entry;
+	struct hlist_node *node;
+
+	hlist_for_each_entry_rcu(ts_entry, node,
+				 tag_stat_hash_bucket(iface_entry, tag),
+				 hnode) {
+		if (ts_entry->tn.tag == tag)
+			return ts_entry;
+	}
+	return NULL;
+}
+
 /*
  * Create a new entry for tracking the specified {acct_tag,uid_tag} within
  * the interface.
  * iface_entry->tag_stat_list_lock should be held.
  */
 static struct tag_stat *create_if_tag_stat(struct iface_stat *iface_entry,
-					   tag_t tag)
+					   tag_t tag,
+					   struct tag_stat_counters *parent)
 {
 	struct tag_stat *new_tag_stat_entry = NULL;
 	IF_DEBUG("qtaguid: iface_stat: %s(): ife=%p tag=0x%llx"
@@ -1249,12 +1368,45 @@ static struct tag_stat *create_if_tag_stat(struct iface_stat *iface_entry,
 		pr_err("qtaguid: iface_stat: tag stat alloc failed\n");
 		goto done;
 	}
+	new_tag_stat_entry->counters = kmem_cache_zalloc(
+		tag_stat_counters_cachep, GFP_ATOMIC);
+	if (!new_tag_stat_entry->counters) {
+		pr_err("qtaguid: iface_stat: tag stat counters alloc failed\n");
+		kfree(new_tag_stat_entry);
+		new_tag_stat_entry = NULL;
+		goto done;
+	}
 	new_tag_stat_entry->tn.tag = tag;
+	/* Must be set before the packet path can find the entry */
+	new_tag_stat_entry->parent_counters = parent;
 	tag_stat_tree_insert(new_tag_stat_entry, &iface_entry->tag_stat_tree);
+	hlist_add_head_rcu(&new_tag_stat_entry->hnode,
+			   tag_stat_hash_bucket(iface_entry, tag));
 done:
 	return new_tag_stat_entry;
 }
 
+static void tag_stat_free_rcu(struct rcu_head *head)
+{
+	struct tag_stat *ts_entry = container_of(head, struct tag_stat, rcu);
+
+	kmem_cache_free(tag_stat_counters_cachep, ts_entry->counters);
+	kfree(ts_entry);
+}
+
+/*
+ * Remove from both the tree and the hash, and free once the packet path
+ * can no longer see it.
+ * iface_entry->tag_stat_list_lock should be held.
+ */
+static void destroy_if_tag_stat(struct iface_stat *iface_entry,
+				struct tag_stat *ts_entry)
+{
+	rb_erase(&ts_entry->tn.node, &iface_entry->tag_stat_tree);
+	hlist_del_rcu(&ts_entry->hnode);
+	call_rcu(&ts_entry->rcu, tag_stat_free_rcu);
+}
+
 static void if_tag_stat_update(const char *ifname, uid_t uid,
 			       const struct sock *sk, enum ifs_tx_rx direction,
 			       int proto, int bytes)
@@ -1262,20 +1414,19 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 	struct tag_stat *tag_stat_entry;
 	tag_t tag, acct_tag;
 	tag_t uid_tag;
-	struct data_counters *uid_tag_counters;
-	struct sock_tag *sock_tag_entry;
+	struct tag_stat_counters *uid_tag_counters;
 	struct iface_stat *iface_entry;
 	struct tag_stat *new_tag_stat = NULL;
 	MT_DEBUG("qtaguid: if_tag_stat_update(ifname=%s "
 		"uid=%u sk=%p dir=%d proto=%d bytes=%d)\n",
 		 ifname, uid, sk, direction, proto, bytes);
 
-
+	rcu_read_lock();
 	iface_entry = get_iface_entry(ifname);
 	if (!iface_entry) {
 		pr_info("qtaguid: iface_stat: stat_update() %s not found\n",
 		       ifname);
-		return;
+		goto unlock;
 	}
 	/* It is ok to process data when an iface_entry is inactive */
 
@@ -1286,9 +1437,7 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 	 * Look for a tagged sock.
 	 * It will have an acct_uid.
 	 */
-	sock_tag_entry = get_sock_stat(sk);
-	if (sock_tag_entry) {
-		tag = sock_tag_entry->tag;
+	if (get_sock_tag_rcu(sk, &tag)) {
 		acct_tag = get_atag_from_tag(tag);
 		uid_tag = get_utag_from_tag(tag);
 	} else {
@@ -1299,19 +1448,24 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 	MT_DEBUG("qtaguid: iface_stat: stat_update(): "
 		 " looking for tag=0x%llx (uid=%u) in ife=%p\n",
 		 tag, get_uid_from_tag(tag), iface_entry);
-	/* Loop over tag list under this interface for {acct_tag,uid_tag} */
-	spin_lock_bh(&iface_entry->tag_stat_list_lock);
 
+	/*
+	 * Fast path: the {acct_tag, uid_tag} entry already exists.
+	 * Updating it handles both stats: {0, uid_tag} will also get updated.
+	 */
+	tag_stat_entry = tag_stat_hash_search(iface_entry, tag);
+	if (tag_stat_entry) {
+		tag_stat_update(tag_stat_entry, direction, proto, bytes);
+		goto unlock;
+	}
+
+	spin_lock_bh(&iface_entry->tag_stat_list_lock);
+	/* Somebody else might have created it while we were not looking */
 	tag_stat_entry = tag_stat_tree_search(&iface_entry->tag_stat_tree,
 					      tag);
 	if (tag_stat_entry) {
-		/*
-		 * Updating the {acct_tag, uid_tag} entry handles both stats:
-		 * {0, uid_tag} will also get updated.
-		 */
 		tag_stat_update(tag_stat_entry, direction, proto, bytes);
-		spin_unlock_bh(&iface_entry->tag_stat_list_lock);
-		return;
+		goto unlock_tag_stat;
 	}
 
 	/* Loop over tag list under this interface for {0,uid_tag} */
@@ -1323,18 +1477,25 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 		 * No parent counters. So
 		 *  - No {0, uid_tag} stats and no {acc_tag, uid_tag} stats.
 		 */
-		new_tag_stat = create_if_tag_stat(iface_entry, uid_tag);
-		uid_tag_counters = &new_tag_stat->counters;
+		new_tag_stat = create_if_tag_stat(iface_entry, uid_tag, NULL);
+		if (!new_tag_stat)
+			goto unlock_tag_stat;
+		uid_tag_counters = new_tag_stat->counters;
 	} else {
-		uid_tag_counters = &tag_stat_entry->counters;
+		uid_tag_counters = tag_stat_entry->counters;
 	}
 
 	if (acct_tag) {
-		new_tag_stat = create_if_tag_stat(iface_entry, tag);
-		new_tag_stat->parent_counters = uid_tag_counters;
+		new_tag_stat = create_if_tag_stat(iface_entry, tag,
+						  uid_tag_counters);
+		if (!new_tag_stat)
+			goto unlock_tag_stat;
 	}
 	tag_stat_update(new_tag_stat, direction, proto, bytes);
+unlock_tag_stat:
 	spin_unlock_bh(&iface_entry->tag_stat_list_lock);
+unlock:
+	rcu_read_unlock();
 }
 
 static int iface_netdev_event_handler(struct notifier_block *nb,
@@ -1478,8 +1639,24 @@ static int __init iface_stat_init(struct proc_dir_entry *parent_procdir)
 		       "failed to register ipv6 dev event handler\n");
 		goto err_unreg_ip4_addr;
 	}
+
+	/*
+	 * Aligned so that with the padding of struct tag_stat_counters
+	 * every cpu's slot is on cache lines of its own.
+	 */
+	tag_stat_counters_cachep = kmem_cache_create("qtaguid_tag_stat_counters",
+		nr_cpu_ids * sizeof(struct tag_stat_counters),
+		cache_line_size(), 0, NULL);
+	if (!tag_stat_counters_cachep) {
+		pr_err("qtaguid: iface_stat: init "
+		       "failed to create tag stat counters cache\n");
+		err = -ENOMEM;
+		goto err_unreg_ip6_addr;
+	}
 	return 0;
 
+err_unreg_ip6_addr:
+	unregister_inet6addr_notifier(&iface_inet6addr_notifier_blk);
 err_unreg_ip4_addr:
 	unregister_inetaddr_notifier(&iface_inetaddr_notifier_blk);
 err_unreg_nd:
@@ -1913,7 +2090,7 @@ static int ctrl_cmd_delete(const char *input)
 			 input, st_entry->tag, entry_uid);
 
 		if (!acct_tag || st_entry->tag == tag) {
-			rb_erase(&st_entry->sock_node, &sock_tag_tree);
+			sock_tag_unlink(st_entry);
 			/* Can't sockfd_put() within spinlock, do it later. */
 			sock_tag_tree_insert(st_entry, &st_to_free_tree);
 			tr_entry = lookup_tag_ref(st_entry->tag, NULL);
@@ -1945,8 +2122,9 @@ static int ctrl_cmd_delete(const char *input)
 			 tcs_entry->tn.tag,
 			 get_uid_from_tag(tcs_entry->tn.tag),
 			 tcs_entry->active_set);
-		rb_erase(&tcs_entry->tn.node, &tag_counter_set_tree);
-		kfree(tcs_entry);
+		tag_counter_set_unlink(tcs_entry);
+		/* The packet path might still be looking at it */
+		kfree_rcu(tcs_entry, rcu);
 	}
 	spin_unlock_bh(&tag_counter_set_list_lock);
 
@@ -1975,9 +2153,7 @@ static int ctrl_cmd_delete(const char *input)
 					 input, iface_entry->ifname,
 					 get_atag_from_tag(ts_entry->tn.tag),
 					 entry_uid);
-				rb_erase(&ts_entry->tn.node,
-					 &iface_entry->tag_stat_tree);
-				kfree(ts_entry);
+				destroy_if_tag_stat(iface_entry, ts_entry);
 			}
 		}
 		spin_unlock_bh(&iface_entry->tag_stat_list_lock);
@@ -2059,7 +2235,8 @@ static int ctrl_cmd_counter_set(const char *input)
 			goto err;
 		}
 		tcs->tn.tag = tag;
-		tag_counter_set_tree_insert(tcs, &tag_counter_set_tree);
+		tcs->active_set = counter_set;
+		tag_counter_set_link(tcs);
 		CT_DEBUG("qtaguid: ctrl_counterset(%s): added tcs tag=0x%llx "
 			 "(uid=%u) set=%d\n",
 			 input, tag, get_uid_from_tag(tag), counter_set);
@@ -2158,7 +2335,9 @@ static int ctrl_cmd_tag(const char *input)
 		BUG_ON(IS_ERR_OR_NULL(prev_tag_ref_entry));
 		BUG_ON(prev_tag_ref_entry->num_sock_tags <= 0);
 		prev_tag_ref_entry->num_sock_tags--;
+		write_seqcount_begin(&sock_tag_entry->tag_seq);
 		sock_tag_entry->tag = full_tag;
+		write_seqcount_end(&sock_tag_entry->tag_seq);
 	} else {
 		CT_DEBUG("qtaguid: ctrl_tag(%s): newtag for sk=%p\n",
 			 input, el_socket->sk);
@@ -2175,6 +2354,7 @@ static int ctrl_cmd_tag(const char *input)
 		sock_tag_entry->sk = el_socket->sk;
 		sock_tag_entry->socket = el_socket;
 		sock_tag_entry->pid = current->tgid;
+		seqcount_init(&sock_tag_entry->tag_seq);
 		sock_tag_entry->tag = combine_atag_with_uid(acct_tag,
 							    uid);
 		spin_lock_bh(&uid_tag_data_tree_lock);
@@ -2197,7 +2377,7 @@ static int ctrl_cmd_tag(const char *input)
 				 &pqd_entry->sock_tag_list);
 		spin_unlock_bh(&uid_tag_data_tree_lock);
 
-		sock_tag_tree_insert(sock_tag_entry, &sock_tag_tree);
+		sock_tag_link(sock_tag_entry);
 		atomic64_inc(&qtu_events.sockets_tagged);
 	}
 	spin_unlock_bh(&sock_tag_list_lock);
@@ -2261,7 +2441,7 @@ static int ctrl_cmd_untag(const char *input)
 	 * The socket already belongs to the current process
 	 * so it can do whatever it wants to it.
 	 */
-	rb_erase(&sock_tag_entry->sock_node, &sock_tag_tree);
+	sock_tag_unlink(sock_tag_entry);
 
 	tag_ref_entry = lookup_tag_ref(sock_tag_entry->tag, &utd_entry);
 	BUG_ON(!tag_ref_entry);
@@ -2298,7 +2478,7 @@ static int ctrl_cmd_untag(const char *input)
 		 atomic_long_read(&el_socket->file->f_count) - 1);
 	sockfd_put(el_socket);
 
-	kfree(sock_tag_entry);
+	kfree_rcu(sock_tag_entry, rcu);
 	atomic64_inc(&qtu_events.sockets_untagged);
 
 	return 0;
@@ -2382,7 +2562,8 @@ struct proc_print_info {
 static int pp_stats_line(struct proc_print_info *ppi, int cnt_set)
 {
 	int len;
-	struct data_counters *cnts;
+	struct data_counters sum;
+	struct data_counters *cnts = &sum;
 
 	if (!ppi->item_index) {
 		if (ppi->item_index++ < ppi->items_to_skip)
@@ -2412,7 +2593,7 @@ static int pp_stats_line(struct proc_print_info *ppi, int cnt_set)
 		}
 		if (ppi->item_index++ < ppi->items_to_skip)
 			return 0;
-		cnts = &ppi->ts_entry->counters;
+		tag_stat_counters_sum(cnts, ppi->ts_entry->counters);
 		len = snprintf(
 			ppi->outp, ppi->char_count,
 			"%d %s 0x%llx %u %u "
@@ -2656,7 +2837,7 @@ static int qtudev_release(struct inode *inode, struct file *file)
 		tr->num_sock_tags--;
 		free_tag_ref_from_utd_entry(tr, utd_entry);
 
-		rb_erase(&st_entry->sock_node, &sock_tag_tree);
+		sock_tag_unlink(st_entry);
 		list_del(&st_entry->list);
 		/* Can't sockfd_put() within spinlock, do it later. */
 		sock_tag_tree_insert(st_entry, &st_to_free_tree);
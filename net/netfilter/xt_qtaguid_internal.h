@@ -11,8 +11,15 @@
 #define __XT_QTAGUID_INTERNAL_H__
 
 #include <linux/types.h>
+#include <linux/cache.h>
+#include <linux/cpumask.h>
+#include <linux/list.h>
 #include <linux/rbtree.h>
+#include <linux/rcupdate.h>
+#include <linux/seqlock.h>
 #include <linux/spinlock_types.h>
+#include <linux/string.h>
+#include <linux/u64_stats_sync.h>
 #include <linux/workqueue.h>
 
 /* Iface handling */
@@ -179,6 +186,42 @@ struct data_counters {
 	struct byte_packet_counters bpc[IFS_MAX_COUNTER_SETS][IFS_MAX_DIRECTIONS][IFS_MAX_PROTOS];
 };
 
+/*
+ * One slot per possible cpu, updated with BHs off by the owning cpu only.
+ * The slots are summed when the stats are read.
+ * The array comes from a cache-line aligned kmem_cache because tag_stats
+ * get created from the packet path where alloc_percpu() is not an option.
+ */
+struct tag_stat_counters {
+	struct data_counters dc;
+	struct u64_stats_sync syncp;
+} ____cacheline_aligned_in_smp;
+
+static inline void tag_stat_counters_sum(struct data_counters *res,
+					 struct tag_stat_counters *tsc)
+{
+	int cpu, set, dir, proto;
+	unsigned int start;
+	struct data_counters snap;
+
+	memset(res, 0, sizeof(*res));
+	for_each_possible_cpu(cpu) {
+		do {
+			start = u64_stats_fetch_begin_bh(&tsc[cpu].syncp);
+			snap = tsc[cpu].dc;
+		} while (u64_stats_fetch_retry_bh(&tsc[cpu].syncp, start));
+		for (set = 0; set < IFS_MAX_COUNTER_SETS; set++)
+			for (dir = 0; dir < IFS_MAX_DIRECTIONS; dir++)
+				for (proto = 0; proto < IFS_MAX_PROTOS;
+				     proto++) {
+					res->bpc[set][dir][proto].bytes +=
+					  snap.bpc[set][dir][proto].bytes;
+					res->bpc[set][dir][proto].packets +=
+					  snap.bpc[set][dir][proto].packets;
+				}
+	}
+}
+
 /* Generic X based nodes used as a base for rb_tree ops */
 struct tag_node {
 	struct rb_node node;
@@ -187,14 +230,21 @@ struct tag_node {
 
 struct tag_stat {
 	struct tag_node tn;
-	struct data_counters counters;
+	/* in iface_stat.tag_stat_hash, for the lockless per-packet lookup */
+	struct hlist_node hnode;
+	struct rcu_head rcu;
+	/* Indexed by cpu, see struct tag_stat_counters */
+	struct tag_stat_counters *counters;
 	/*
 	 * If this tag is acct_tag based, we need to count against the
 	 * matching parent uid_tag.
 	 */
-	struct data_counters *parent_counters;
+	struct tag_stat_counters *parent_counters;
 };
 
+#define TAG_STAT_HASH_BITS 5
+#define TAG_STAT_HASH_SIZE (1 << TAG_STAT_HASH_BITS)
+
 struct iface_stat {
 	struct list_head list;  /* in iface_stat_list */
 	char *ifname;
@@ -217,7 +267,12 @@ struct iface_stat {
 
 	struct proc_dir_entry *proc_ptr;
 
+	/*
+	 * The tree is the authoritative set, walked under tag_stat_list_lock.
+	 * The hash mirrors it for the RCU lookups done per packet.
+	 */
 	struct rb_root tag_stat_tree;
+	struct hlist_head tag_stat_hash[TAG_STAT_HASH_SIZE];
 	spinlock_t tag_stat_list_lock;
 };
 
@@ -235,6 +290,9 @@ struct iface_stat_work {
  */
 struct sock_tag {
 	struct rb_node sock_node;
+	/* in sock_tag_hash, for the lockless per-packet lookup */
+	struct hlist_node sock_hnode;
+	struct rcu_head rcu;
 	struct sock *sk;  /* Only used as a number, never dereferenced */
 	/* The socket is needed for sockfd_put() */
 	struct socket *socket;
@@ -242,6 +300,8 @@ struct sock_tag {
 	struct list_head list;   /* in proc_qtu_data.sock_tag_list */
 	pid_t pid;
 
+	/* a retag can race with the packet path, see get_sock_tag_rcu() */
+	seqcount_t tag_seq;
 	tag_t tag;
 };
 
@@ -278,6 +338,9 @@ struct qtaguid_event_counts {
 /* Track the set active_set for the given tag. */
 struct tag_counter_set {
 	struct tag_node tn;
+	/* in tag_counter_set_hash, for the lockless per-packet lookup */
+	struct hlist_node hnode;
+	struct rcu_head rcu;
 	int active_set;
 };
 
@@ -153,7 +153,7 @@ char *pp_tag_stat(struct tag_stat *ts)
 {
 	char *tn_str;
 	char *counters_str;
-	char *parent_counters_str;
+	struct data_counters counters;
 	char *res;
 
 	if (!ts) {
@@ -162,15 +162,14 @@ char *pp_tag_stat(struct tag_stat *ts)
 		return res;
 	}
 	tn_str = pp_tag_node(&ts->tn);
-	counters_str = pp_data_counters(&ts->counters, true);
-	parent_counters_str = pp_data_counters(ts->parent_counters, false);
+	tag_stat_counters_sum(&counters, ts->counters);
+	counters_str = pp_data_counters(&counters, true);
 	res = kasprintf(GFP_ATOMIC,
-			"tag_stat@%p{%s, counters=%s, parent_counters=%s}",
-			ts, tn_str, counters_str, parent_counters_str);
+			"tag_stat@%p{%s, counters=%s, parent_counters=%p}",
+			ts, tn_str, counters_str, ts->parent_counters);
 	_bug_on_err_or_null(res);
 	kfree(tn_str);
 	kfree(counters_str);
-	kfree(parent_counters_str);
 	return res;
 }
 
@@ -12,6 +12,7 @@
  *	version 2 of the License, as published by the Free Software Foundation.
  */
 #include <linux/list.h>
+#include <linux/percpu_counter.h>
 #include <linux/proc_fs.h>
 #include <linux/skbuff.h>
 #include <linux/spinlock.h>
@@ -19,15 +20,19 @@
 
 #include <linux/netfilter/x_tables.h>
 #include <linux/netfilter/xt_quota2.h>
+#include <linux/netfilter/nfnetlink_xtstate.h>
+#include <net/netlink.h>
+#include <net/netfilter/nfnetlink_xtstate.h>
 #ifdef CONFIG_NETFILTER_XT_MATCH_QUOTA2_LOG
 #include <linux/netfilter_ipv4/ipt_ULOG.h>
 #endif
 
 /**
- * @lock:	lock to protect quota writers from each other
+ * @quota:	bytes or packets left, or counted in "grow" mode
+ * @lock:	serializes writers once a countdown quota nears zero
  */
 struct xt_quota_counter {
-	u_int64_t quota;
+	struct percpu_counter quota;
 	spinlock_t lock;
 	struct list_head list;
 	atomic_t ref;
@@ -48,6 +53,19 @@ static struct sock *nflognl;
 static LIST_HEAD(counter_list);
 static DEFINE_SPINLOCK(counter_list_lock);
 
+/*
+ * Each cpu folds its count into the shared one every QUOTA2_BATCH bytes.
+ * A countdown quota further than quota2_slack() from zero can thus be
+ * charged without the lock: every cpu may hold up to a batch of
+ * uncommitted charges plus one packet being matched.
+ */
+#define QUOTA2_BATCH	(64 * 1024)
+
+static inline s64 quota2_slack(void)
+{
+	return (s64)num_online_cpus() * (QUOTA2_BATCH + 65536);
+}
+
 static struct proc_dir_entry *proc_xt_quota;
 static unsigned int quota_list_perms = S_IRUGO | S_IWUSR;
 static unsigned int quota_list_uid   = 0;
@@ -126,7 +144,8 @@ static int quota_proc_read(char *page, char **start, off_t offset,
 	int ret;
 
 	spin_lock_bh(&e->lock);
-	ret = snprintf(page, PAGE_SIZE, "%llu\n", e->quota);
+	ret = snprintf(page, PAGE_SIZE, "%llu\n",
+		       (unsigned long long)percpu_counter_sum_positive(&e->quota));
 	spin_unlock_bh(&e->lock);
 	return ret;
 }
@@ -144,11 +163,19 @@ static int quota_proc_write(struct file *file, const char __user *input,
 	buf[sizeof(buf)-1] = '\0';
 
 	spin_lock_bh(&e->lock);
-	e->quota = simple_strtoull(buf, NULL, 0);
+	percpu_counter_set(&e->quota, simple_strtoull(buf, NULL, 0));
 	spin_unlock_bh(&e->lock);
 	return size;
 }
 
+static void q2_free_counter(struct xt_quota_counter *e)
+{
+	if (e == NULL)
+		return;
+	percpu_counter_destroy(&e->quota);
+	kfree(e);
+}
+
 static struct xt_quota_counter *
 q2_new_counter(const struct xt_quota_mtinfo2 *q, bool anon)
 {
@@ -161,7 +188,10 @@ q2_new_counter(const struct xt_quota_mtinfo2 *q, bool anon)
 	if (e == NULL)
 		return NULL;
 
-	e->quota = q->quota;
+	if (percpu_counter_init(&e->quota, q->quota) != 0) {
+		kfree(e);
+		return NULL;
+	}
 	spin_lock_init(&e->lock);
 	if (!anon) {
 		INIT_LIST_HEAD(&e->list);
@@ -195,7 +225,7 @@ q2_get_counter(const struct xt_quota_mtinfo2 *q)
 		if (strcmp(e->name, q->name) == 0) {
 			atomic_inc(&e->ref);
 			spin_unlock_bh(&counter_list_lock);
-			kfree(new_e);
+			q2_free_counter(new_e);
 			pr_debug("xt_quota2: old counter name=%s", e->name);
 			return e;
 		}
@@ -229,7 +259,7 @@ q2_get_counter(const struct xt_quota_mtinfo2 *q)
 	return e;
 
  out:
-	kfree(e);
+	q2_free_counter(e);
 	return NULL;
 }
 
@@ -263,7 +293,7 @@ static void quota_mt2_destroy(const struct xt_mtdtor_param *par)
 	struct xt_quota_counter *e = q->master;
 
 	if (*q->name == '\0') {
-		kfree(e);
+		q2_free_counter(e);
 		return;
 	}
 
@@ -276,7 +306,7 @@ static void quota_mt2_destroy(const struct xt_mtdtor_param *par)
 	list_del(&e->list);
 	remove_proc_entry(e->name, proc_xt_quota);
 	spin_unlock_bh(&counter_list_lock);
-	kfree(e);
+	q2_free_counter(e);
 }
 
 static bool
@@ -285,39 +315,85 @@ quota_mt2(const struct sk_buff *skb, struct xt_action_param *par)
 	struct xt_quota_mtinfo2 *q = (void *)par->matchinfo;
 	struct xt_quota_counter *e = q->master;
 	bool ret = q->flags & XT_QUOTA_INVERT;
+	s64 charge = (q->flags & XT_QUOTA_PACKET) ? 1 : skb->len;
+	s64 left;
 
-	spin_lock_bh(&e->lock);
 	if (q->flags & XT_QUOTA_GROW) {
 		/*
 		 * While no_change is pointless in "grow" mode, we will
 		 * implement it here simply to have a consistent behavior.
 		 */
-		if (!(q->flags & XT_QUOTA_NO_CHANGE)) {
-			e->quota += (q->flags & XT_QUOTA_PACKET) ? 1 : skb->len;
-		}
-		ret = true;
-	} else {
-		if (e->quota >= skb->len) {
-			if (!(q->flags & XT_QUOTA_NO_CHANGE))
-				e->quota -= (q->flags & XT_QUOTA_PACKET) ? 1 : skb->len;
-			ret = !ret;
-		} else {
-			/* We are transitioning, log that fact. */
-			if (e->quota) {
-				quota2_log(par->hooknum,
-					   skb,
-					   par->in,
-					   par->out,
-					   q->name);
-			}
-			/* we do not allow even small packets from now on */
-			e->quota = 0;
+		if (!(q->flags & XT_QUOTA_NO_CHANGE))
+			__percpu_counter_add(&e->quota, charge, QUOTA2_BATCH);
+		return true;
+	}
+
+	/* Far from exhausted: no lock, no sum over all cpus */
+	if (percpu_counter_read(&e->quota) >= skb->len + quota2_slack()) {
+		if (!(q->flags & XT_QUOTA_NO_CHANGE))
+			__percpu_counter_add(&e->quota, -charge, QUOTA2_BATCH);
+		return !ret;
+	}
+
+	spin_lock_bh(&e->lock);
+	left = percpu_counter_sum(&e->quota);
+	if (left >= skb->len) {
+		if (!(q->flags & XT_QUOTA_NO_CHANGE))
+			__percpu_counter_add(&e->quota, -charge, QUOTA2_BATCH);
+		ret = !ret;
+	} else if (left) {
+		/* We are transitioning, log that fact. */
+		if (left > 0) {
+			quota2_log(par->hooknum,
+				   skb,
+				   par->in,
+				   par->out,
+				   q->name);
 		}
+		/* we do not allow even small packets from now on */
+		percpu_counter_set(&e->quota, 0);
 	}
 	spin_unlock_bh(&e->lock);
 	return ret;
 }
 
+static int quota2_xtstate_fill(struct sk_buff *skb, unsigned long *pos)
+{
+	struct xt_quota_counter *e;
+	struct nlattr *nest = NULL;
+	unsigned long i = 0;
+	u64 value;
+
+	spin_lock_bh(&counter_list_lock);
+	list_for_each_entry(e, &counter_list, list) {
+		if (i++ < *pos)
+			continue;
+
+		spin_lock(&e->lock);
+		value = percpu_counter_sum_positive(&e->quota);
+		spin_unlock(&e->lock);
+
+		nest = nla_nest_start(skb, NFXTSTATE_QUOTA);
+		if (nest == NULL)
+			goto nla_put_failure;
+		NLA_PUT_STRING(skb, NFXTSTATE_QUOTA_NAME, e->name);
+		NLA_PUT_BE64(skb, NFXTSTATE_QUOTA_VALUE, cpu_to_be64(value));
+		nla_nest_end(skb, nest);
+		(*pos)++;
+	}
+	spin_unlock_bh(&counter_list_lock);
+	return 0;
+
+nla_put_failure:
+	nla_nest_cancel(skb, nest);
+	spin_unlock_bh(&counter_list_lock);
+	return -EMSGSIZE;
+}
+
+static struct nfnl_xtstate_provider quota2_xtstate = {
+	.fill = quota2_xtstate_fill,
+};
+
 static struct xt_match quota_mt2_reg[] __read_mostly = {
 	{
 		.name       = "quota2",
@@ -361,12 +437,15 @@ static int __init quota_mt2_init(void)
 	ret = xt_register_matches(quota_mt2_reg, ARRAY_SIZE(quota_mt2_reg));
 	if (ret < 0)
 		remove_proc_entry("xt_quota", init_net.proc_net);
+	else
+		nfnl_xtstate_register(&quota2_xtstate);
 	pr_debug("xt_quota2: init() %d", ret);
 	return ret;
 }
 
 static void __exit quota_mt2_exit(void)
 {
+	nfnl_xtstate_unregister(&quota2_xtstate);
 	xt_unregister_matches(quota_mt2_reg, ARRAY_SIZE(quota_mt2_reg));
 	remove_proc_entry("xt_quota", init_net.proc_net);
 }
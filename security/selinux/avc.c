@@ -22,6 +22,9 @@
 #include <linux/init.h>
 #include <linux/skbuff.h>
 #include <linux/percpu.h>
+#include <linux/vmalloc.h>
+#include <linux/mutex.h>
+#include <linux/log2.h>
 #include <net/sock.h>
 #include <linux/un.h>
 #include <net/af_unix.h>
@@ -33,8 +36,9 @@
 #include "avc_ss.h"
 #include "classmap.h"
 
-#define AVC_CACHE_SLOTS			512
-#define AVC_DEF_CACHE_THRESHOLD		512
+#define AVC_CACHE_SLOTS \
+	roundup_pow_of_two(CONFIG_SECURITY_SELINUX_AVC_CACHE_SLOTS)
+#define AVC_DEF_CACHE_THRESHOLD		AVC_CACHE_SLOTS
 #define AVC_CACHE_RECLAIM		16
 
 #ifdef CONFIG_SECURITY_SELINUX_AVC_STATS
@@ -56,9 +60,22 @@ struct avc_node {
 	struct rcu_head		rhead;
 };
 
+struct avc_slot {
+	struct hlist_head	head;	/* head for avc_node->list */
+	spinlock_t		lock;	/* lock for writes */
+};
+
+/*
+ * The hash table is replaced as a whole when it is resized, so it is
+ * only ever dereferenced under rcu_read_lock().
+ */
+struct avc_slots {
+	unsigned int		size;	/* power of two */
+	struct avc_slot		slot[0];
+};
+
 struct avc_cache {
-	struct hlist_head	slots[AVC_CACHE_SLOTS]; /* head for avc_node->list */
-	spinlock_t		slots_lock[AVC_CACHE_SLOTS]; /* lock for writes */
+	struct avc_slots __rcu	*slots;
 	atomic_t		lru_hint;	/* LRU hint for reclaim scan */
 	atomic_t		active_nodes;
 	u32			latest_notif;	/* latest revocation notification */
@@ -87,9 +104,41 @@ static struct avc_cache avc_cache;
 static struct avc_callback_node *avc_callbacks;
 static struct kmem_cache *avc_node_cachep;
 
-static inline int avc_hash(u32 ssid, u32 tsid, u16 tclass)
+static inline struct avc_slot *avc_hash(struct avc_slots *slots,
+				       u32 ssid, u32 tsid, u16 tclass)
+{
+	return &slots->slot[(ssid ^ (tsid<<2) ^ (tclass<<4)) &
+			    (slots->size - 1)];
+}
+
+static struct avc_slots *avc_alloc_slots(unsigned int size)
+{
+	struct avc_slots *slots;
+	size_t bytes;
+	int i;
+
+	bytes = sizeof(*slots) + size * sizeof(struct avc_slot);
+	if (bytes > PAGE_SIZE)
+		slots = vzalloc(bytes);
+	else
+		slots = kzalloc(bytes, GFP_KERNEL);
+	if (!slots)
+		return NULL;
+
+	slots->size = size;
+	for (i = 0; i < size; i++) {
+		INIT_HLIST_HEAD(&slots->slot[i].head);
+		spin_lock_init(&slots->slot[i].lock);
+	}
+	return slots;
+}
+
+static void avc_free_slots(struct avc_slots *slots)
 {
-	return (ssid ^ (tsid<<2) ^ (tclass<<4)) & (AVC_CACHE_SLOTS - 1);
+	if (is_vmalloc_addr(slots))
+		vfree(slots);
+	else
+		kfree(slots);
 }
 
 /**
@@ -166,12 +215,12 @@ static void avc_dump_query(struct audit_buffer *ab, u32 ssid, u32 tsid, u16 tcla
  */
 void __init avc_init(void)
 {
-	int i;
+	struct avc_slots *slots;
 
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		INIT_HLIST_HEAD(&avc_cache.slots[i]);
-		spin_lock_init(&avc_cache.slots_lock[i]);
-	}
+	slots = avc_alloc_slots(AVC_CACHE_SLOTS);
+	if (!slots)
+		panic("SELinux: cannot allocate the AVC hash table\n");
+	rcu_assign_pointer(avc_cache.slots, slots);
 	atomic_set(&avc_cache.active_nodes, 0);
 	atomic_set(&avc_cache.lru_hint, 0);
 
@@ -183,16 +232,19 @@ void __init avc_init(void)
 
 int avc_get_hash_stats(char *page)
 {
-	int i, chain_len, max_chain_len, slots_used;
+	int i, chain_len, max_chain_len, slots_used, size;
+	struct avc_slots *slots;
 	struct avc_node *node;
 	struct hlist_head *head;
 
 	rcu_read_lock();
 
+	slots = rcu_dereference(avc_cache.slots);
+	size = slots->size;
 	slots_used = 0;
 	max_chain_len = 0;
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		head = &avc_cache.slots[i];
+	for (i = 0; i < size; i++) {
+		head = &slots->slot[i].head;
 		if (!hlist_empty(head)) {
 			struct hlist_node *next;
 
@@ -210,7 +262,7 @@ int avc_get_hash_stats(char *page)
 	return scnprintf(page, PAGE_SIZE, "entries: %d\nbuckets used: %d/%d\n"
 			 "longest chain: %d\n",
 			 atomic_read(&avc_cache.active_nodes),
-			 slots_used, AVC_CACHE_SLOTS, max_chain_len);
+			 slots_used, size, max_chain_len);
 }
 
 static void avc_node_free(struct rcu_head *rhead)
@@ -246,33 +298,34 @@ static inline int avc_reclaim_node(void)
 	struct avc_node *node;
 	int hvalue, try, ecx;
 	unsigned long flags;
+	struct avc_slots *slots;
 	struct hlist_head *head;
 	struct hlist_node *next;
 	spinlock_t *lock;
 
-	for (try = 0, ecx = 0; try < AVC_CACHE_SLOTS; try++) {
-		hvalue = atomic_inc_return(&avc_cache.lru_hint) & (AVC_CACHE_SLOTS - 1);
-		head = &avc_cache.slots[hvalue];
-		lock = &avc_cache.slots_lock[hvalue];
+	rcu_read_lock();
+	slots = rcu_dereference(avc_cache.slots);
+	for (try = 0, ecx = 0; try < slots->size; try++) {
+		hvalue = atomic_inc_return(&avc_cache.lru_hint) & (slots->size - 1);
+		head = &slots->slot[hvalue].head;
+		lock = &slots->slot[hvalue].lock;
 
 		if (!spin_trylock_irqsave(lock, flags))
 			continue;
 
-		rcu_read_lock();
 		hlist_for_each_entry(node, next, head, list) {
 			avc_node_delete(node);
 			avc_cache_stats_incr(reclaims);
 			ecx++;
 			if (ecx >= AVC_CACHE_RECLAIM) {
-				rcu_read_unlock();
 				spin_unlock_irqrestore(lock, flags);
 				goto out;
 			}
 		}
-		rcu_read_unlock();
 		spin_unlock_irqrestore(lock, flags);
 	}
 out:
+	rcu_read_unlock();
 	return ecx;
 }
 
@@ -305,12 +358,11 @@ static void avc_node_populate(struct avc_node *node, u32 ssid, u32 tsid, u16 tcl
 static inline struct avc_node *avc_search_node(u32 ssid, u32 tsid, u16 tclass)
 {
 	struct avc_node *node, *ret = NULL;
-	int hvalue;
 	struct hlist_head *head;
 	struct hlist_node *next;
 
-	hvalue = avc_hash(ssid, tsid, tclass);
-	head = &avc_cache.slots[hvalue];
+	head = &avc_hash(rcu_dereference(avc_cache.slots),
+			 ssid, tsid, tclass)->head;
 	hlist_for_each_entry_rcu(node, next, head, list) {
 		if (ssid == node->ae.ssid &&
 		    tclass == node->ae.tclass &&
@@ -387,11 +439,12 @@ static int avc_latest_notif_update(int seqno, int is_insert)
  * revocation notification, then the function copies
  * the access vectors into a cache entry, returns
  * avc_node inserted. Otherwise, this function returns NULL.
+ * Must be called under rcu_read_lock().
  */
 static struct avc_node *avc_insert(u32 ssid, u32 tsid, u16 tclass, struct av_decision *avd)
 {
 	struct avc_node *pos, *node = NULL;
-	int hvalue;
+	struct avc_slot *slot;
 	unsigned long flag;
 
 	if (avc_latest_notif_update(avd->seqno, 1))
@@ -403,11 +456,12 @@ static struct avc_node *avc_insert(u32 ssid, u32 tsid, u16 tclass, struct av_dec
 		struct hlist_node *next;
 		spinlock_t *lock;
 
-		hvalue = avc_hash(ssid, tsid, tclass);
 		avc_node_populate(node, ssid, tsid, tclass, avd);
 
-		head = &avc_cache.slots[hvalue];
-		lock = &avc_cache.slots_lock[hvalue];
+		slot = avc_hash(rcu_dereference(avc_cache.slots),
+				ssid, tsid, tclass);
+		head = &slot->head;
+		lock = &slot->lock;
 
 		spin_lock_irqsave(lock, flag);
 		hlist_for_each_entry(pos, next, head, list) {
@@ -599,13 +653,15 @@ static inline int avc_sidcmp(u32 x, u32 y)
  * if kmalloc() called internal returns NULL, this function returns -ENOMEM.
  * otherwise, this function updates the AVC entry. The original AVC-entry object
  * will release later by RCU.
+ * Must be called under rcu_read_lock().
  */
 static int avc_update_node(u32 event, u32 perms, u32 ssid, u32 tsid, u16 tclass,
 			   u32 seqno)
 {
-	int hvalue, rc = 0;
+	int rc = 0;
 	unsigned long flag;
 	struct avc_node *pos, *node, *orig = NULL;
+	struct avc_slot *slot;
 	struct hlist_head *head;
 	struct hlist_node *next;
 	spinlock_t *lock;
@@ -617,10 +673,10 @@ static int avc_update_node(u32 event, u32 perms, u32 ssid, u32 tsid, u16 tclass,
 	}
 
 	/* Lock the target slot */
-	hvalue = avc_hash(ssid, tsid, tclass);
+	slot = avc_hash(rcu_dereference(avc_cache.slots), ssid, tsid, tclass);
 
-	head = &avc_cache.slots[hvalue];
-	lock = &avc_cache.slots_lock[hvalue];
+	head = &slot->head;
+	lock = &slot->lock;
 
 	spin_lock_irqsave(lock, flag);
 
@@ -679,6 +735,7 @@ out:
  */
 static void avc_flush(void)
 {
+	struct avc_slots *slots;
 	struct hlist_head *head;
 	struct hlist_node *next;
 	struct avc_node *node;
@@ -686,21 +743,79 @@ static void avc_flush(void)
 	unsigned long flag;
 	int i;
 
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		head = &avc_cache.slots[i];
-		lock = &avc_cache.slots_lock[i];
+	/*
+	 * With preemptable RCU, the slot spinlocks do not prevent RCU
+	 * grace periods from ending.
+	 */
+	rcu_read_lock();
+	slots = rcu_dereference(avc_cache.slots);
+	for (i = 0; i < slots->size; i++) {
+		head = &slots->slot[i].head;
+		lock = &slots->slot[i].lock;
 
 		spin_lock_irqsave(lock, flag);
-		/*
-		 * With preemptable RCU, the outer spinlock does not
-		 * prevent RCU grace periods from ending.
-		 */
-		rcu_read_lock();
 		hlist_for_each_entry(node, next, head, list)
 			avc_node_delete(node);
-		rcu_read_unlock();
 		spin_unlock_irqrestore(lock, flag);
 	}
+	rcu_read_unlock();
+}
+
+/**
+ * avc_get_cache_slots - Number of AVC hash table slots
+ */
+unsigned int avc_get_cache_slots(void)
+{
+	unsigned int size;
+
+	rcu_read_lock();
+	size = rcu_dereference(avc_cache.slots)->size;
+	rcu_read_unlock();
+	return size;
+}
+
+/**
+ * avc_set_cache_slots - Resize the AVC hash table
+ * @size: new number of slots, a power of two
+ *
+ * The entries of the old table are dropped rather than rehashed; they
+ * are refilled from the security server on the following misses, as
+ * after a policy reload.
+ */
+int avc_set_cache_slots(unsigned int size)
+{
+	static DEFINE_MUTEX(avc_resize_mutex);
+	struct avc_slots *slots, *old;
+	struct hlist_node *pos, *next;
+	struct avc_node *node;
+	int i;
+
+	if (size < AVC_CACHE_SLOTS_MIN || size > AVC_CACHE_SLOTS_MAX ||
+	    !is_power_of_2(size))
+		return -EINVAL;
+
+	slots = avc_alloc_slots(size);
+	if (!slots)
+		return -ENOMEM;
+
+	mutex_lock(&avc_resize_mutex);
+	old = rcu_dereference_protected(avc_cache.slots,
+					lockdep_is_held(&avc_resize_mutex));
+	rcu_assign_pointer(avc_cache.slots, slots);
+	mutex_unlock(&avc_resize_mutex);
+
+	/* every user of the old table is inside an RCU read section */
+	synchronize_rcu();
+
+	for (i = 0; i < old->size; i++) {
+		hlist_for_each_entry_safe(node, pos, next,
+					  &old->slot[i].head, list) {
+			hlist_del(&node->list);
+			avc_node_kill(node);
+		}
+	}
+	avc_free_slots(old);
+	return 0;
 }
 
 /**
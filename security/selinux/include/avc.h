@@ -98,6 +98,11 @@ int avc_add_callback(int (*callback)(u32 event, u32 ssid, u32 tsid,
 int avc_get_hash_stats(char *page);
 extern unsigned int avc_cache_threshold;
 
+#define AVC_CACHE_SLOTS_MIN	16
+#define AVC_CACHE_SLOTS_MAX	32768
+unsigned int avc_get_cache_slots(void);
+int avc_set_cache_slots(unsigned int size);
+
 /* Attempt to free avc node cache */
 void avc_disable(void);
 
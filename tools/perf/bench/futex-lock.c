@@ -0,0 +1,192 @@
+/*
+ * futex-lock.c
+ *
+ * lock: Contended futex-based mutex
+ *
+ * Threads take and release a single lock built directly on FUTEX_WAIT and
+ * FUTEX_WAKE (the three-state mutex from Ulrich Drepper's "Futexes Are
+ * Tricky"), the way bionic's and glibc's mutexes do, for a fixed time.
+ * Under contention nearly every acquisition goes through the kernel, so
+ * the result follows the cost of the futex hash and of the wakeup path.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+static int		nr_threads	= 4;
+static int		runtime		= 5;
+static int		work;
+static bool		shared;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Specify number of threads contending for the lock"),
+	OPT_INTEGER('r', "runtime", &runtime,
+		    "Specify runtime in seconds"),
+	OPT_INTEGER('w', "work", &work,
+		    "Specify loop iterations spent inside the lock"),
+	OPT_BOOLEAN('s', "shared", &shared,
+		    "Use process-shared futex operations instead of private"),
+	OPT_END()
+};
+
+static const char * const bench_futex_lock_usage[] = {
+	"perf bench futex lock <options>",
+	NULL
+};
+
+struct worker {
+	pthread_t		thread;
+	unsigned long long	ops;
+	unsigned long long	waits;
+};
+
+/* 0: unlocked, 1: locked, 2: locked with (possible) waiters */
+static int		futex_word;
+static int		futex_flags;
+static volatile bool	done;
+
+static pthread_mutex_t	start_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	start_cond = PTHREAD_COND_INITIALIZER;
+static bool		go;
+
+static inline int futex(int *uaddr, int op, int val)
+{
+	return syscall(__NR_futex, uaddr, op | futex_flags, val,
+		       NULL, NULL, 0);
+}
+
+static void lock(struct worker *w)
+{
+	int c = __sync_val_compare_and_swap(&futex_word, 0, 1);
+
+	if (!c)
+		return;
+	if (c != 2)
+		c = __sync_lock_test_and_set(&futex_word, 2);
+	while (c) {
+		futex(&futex_word, FUTEX_WAIT, 2);
+		w->waits++;
+		c = __sync_lock_test_and_set(&futex_word, 2);
+	}
+}
+
+static void unlock(void)
+{
+	if (__sync_fetch_and_sub(&futex_word, 1) != 1) {
+		futex_word = 0;
+		futex(&futex_word, FUTEX_WAKE, 1);
+	}
+}
+
+static void *lock_thread(void *arg)
+{
+	struct worker *w = arg;
+	volatile int i;
+
+	pthread_mutex_lock(&start_mutex);
+	while (!go)
+		pthread_cond_wait(&start_cond, &start_mutex);
+	pthread_mutex_unlock(&start_mutex);
+
+	while (!done) {
+		lock(w);
+		for (i = 0; i < work; i++)
+			;
+		unlock();
+		w->ops++;
+	}
+
+	return NULL;
+}
+
+int bench_futex_lock(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long total = 0, waits = 0, result_usec;
+	struct worker *workers;
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_lock_usage, 0);
+
+	if (nr_threads < 1 || runtime < 1) {
+		fprintf(stderr, "Invalid number of threads or runtime\n");
+		return 1;
+	}
+
+	futex_flags = shared ? 0 : FUTEX_PRIVATE_FLAG;
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!workers)
+		die("memory allocation failed\n");
+
+	for (i = 0; i < nr_threads; i++) {
+		if (pthread_create(&workers[i].thread, NULL,
+				   lock_thread, &workers[i]))
+			die("pthread_create failed\n");
+	}
+
+	pthread_mutex_lock(&start_mutex);
+	gettimeofday(&start, NULL);
+	go = true;
+	pthread_cond_broadcast(&start_cond);
+	pthread_mutex_unlock(&start_mutex);
+
+	sleep(runtime);
+	done = true;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		total += workers[i].ops;
+		waits += workers[i].waits;
+	}
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	result_usec = diff.tv_sec * 1000000ULL + diff.tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d thread(s) contending for a %s futex lock "
+		       "for %d sec\n\n", nr_threads,
+		       shared ? "shared" : "private", runtime);
+
+		for (i = 0; i < nr_threads; i++)
+			printf(" thread %3d: %14llu ops/sec\n", i,
+			       workers[i].ops * 1000000ULL / result_usec);
+		printf("\n");
+
+		printf(" %14llu ops/sec (total)\n",
+		       total * 1000000ULL / result_usec);
+		printf(" %14lf FUTEX_WAIT/op\n",
+		       total ? (double)waits / (double)total : 0.0);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%llu\n", total * 1000000ULL / result_usec);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(workers);
+	return 0;
+}
@@ -62,6 +62,14 @@ struct routine routines[] = {
 #include "mem-memcpy-x86-64-asm-def.h"
 #undef MEMCPY_FN
 
+#endif
+
+#ifdef ARCH_ARM
+
+#define MEMCPY_FN(fn, name, desc) { name, desc, fn },
+#include "mem-memcpy-arm-asm-def.h"
+#undef MEMCPY_FN
+
 #endif
 
 	{ NULL,
@@ -0,0 +1,4 @@
+
+MEMSET_FN(arm_memset,
+	"arm",
+	"memset() in arch/arm/lib/memset.S")
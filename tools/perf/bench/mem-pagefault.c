@@ -0,0 +1,218 @@
+/*
+ * mem-pagefault.c
+ *
+ * pagefault: Page fault throughput on anonymous and file mappings
+ *
+ * Every thread maps its own region, touches one byte per page and unmaps
+ * it again, so each touch takes exactly one fault.  File mappings are
+ * backed by a file that is written out (and so sits in the page cache)
+ * before the clock starts: the result is the cost of the fault path,
+ * not of the I/O.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+static const char	*length_str	= "64MB";
+static const char	*type_str	= "anon";
+static const char	*dir		= ".";
+static int		nr_threads	= 1;
+static int		nr_runs		= 10;
+static bool		do_write;
+
+static const struct option options[] = {
+	OPT_STRING('l', "length", &length_str, "64MB",
+		    "Specify length of the mapping of each thread. "
+		    "available unit: B, MB, GB (upper and lower)"),
+	OPT_STRING('t', "type", &type_str, "anon",
+		    "Specify type of the mapping: anon or file"),
+	OPT_STRING('d', "dir", &dir, ".",
+		    "Directory for the backing file of file mappings"),
+	OPT_INTEGER('j', "threads", &nr_threads,
+		    "Specify number of threads faulting concurrently"),
+	OPT_INTEGER('r', "runs", &nr_runs,
+		    "Specify number of map/touch/unmap runs per thread"),
+	OPT_BOOLEAN('w', "write", &do_write,
+		    "Fault pages in with stores instead of loads"),
+	OPT_END()
+};
+
+static const char * const bench_mem_pagefault_usage[] = {
+	"perf bench mem pagefault <options>",
+	NULL
+};
+
+static size_t		len;
+static long		page_size;
+static int		file_fd = -1;
+
+static pthread_mutex_t	start_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	start_cond = PTHREAD_COND_INITIALIZER;
+static int		threads_ready;
+static bool		go;
+
+static void *fault_thread(void *arg __used)
+{
+	int prot = PROT_READ | (do_write ? PROT_WRITE : 0);
+	volatile char sink __used;
+	char *map;
+	size_t off;
+	int run;
+
+	pthread_mutex_lock(&start_mutex);
+	threads_ready++;
+	pthread_cond_broadcast(&start_cond);
+	while (!go)
+		pthread_cond_wait(&start_cond, &start_mutex);
+	pthread_mutex_unlock(&start_mutex);
+
+	for (run = 0; run < nr_runs; run++) {
+		if (file_fd < 0)
+			map = mmap(NULL, len, prot,
+				   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		else
+			map = mmap(NULL, len, prot, MAP_SHARED, file_fd, 0);
+		if (map == MAP_FAILED)
+			die("mmap failed: %s\n", strerror(errno));
+
+		if (do_write) {
+			for (off = 0; off < len; off += page_size)
+				map[off] = 1;
+		} else {
+			for (off = 0; off < len; off += page_size)
+				sink = map[off];
+		}
+
+		munmap(map, len);
+	}
+
+	return NULL;
+}
+
+static void setup_file(void)
+{
+	char path[PATH_MAX];
+	char *page;
+	size_t off;
+
+	snprintf(path, sizeof(path), "%s/perf-pagefault.XXXXXX", dir);
+	file_fd = mkstemp(path);
+	if (file_fd < 0)
+		die("cannot create %s: %s\n", path, strerror(errno));
+	unlink(path);
+
+	page = zalloc(page_size);
+	if (!page)
+		die("memory allocation failed\n");
+	memset(page, 0x5a, page_size);
+	for (off = 0; off < len; off += page_size) {
+		if (write(file_fd, page, page_size) != page_size)
+			die("cannot write backing file: %s\n", strerror(errno));
+	}
+	free(page);
+	fsync(file_fd);
+}
+
+int bench_mem_pagefault(int argc, const char **argv,
+			const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long faults, result_usec;
+	pthread_t *threads;
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_pagefault_usage, 0);
+
+	page_size = sysconf(_SC_PAGESIZE);
+	len = (size_t)perf_atoll((char *)length_str);
+	if ((s64)len <= 0) {
+		fprintf(stderr, "Invalid length:%s\n", length_str);
+		return 1;
+	}
+	len = (len + page_size - 1) & ~(page_size - 1);
+
+	if (nr_threads < 1 || nr_runs < 1) {
+		fprintf(stderr, "Invalid number of threads or runs\n");
+		return 1;
+	}
+
+	if (!strcmp(type_str, "file")) {
+		setup_file();
+	} else if (strcmp(type_str, "anon")) {
+		fprintf(stderr, "Unknown mapping type:%s\n", type_str);
+		return 1;
+	}
+
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!threads)
+		die("memory allocation failed\n");
+
+	for (i = 0; i < nr_threads; i++) {
+		if (pthread_create(&threads[i], NULL, fault_thread, NULL))
+			die("pthread_create failed\n");
+	}
+
+	pthread_mutex_lock(&start_mutex);
+	while (threads_ready < nr_threads)
+		pthread_cond_wait(&start_cond, &start_mutex);
+	gettimeofday(&start, NULL);
+	go = true;
+	pthread_cond_broadcast(&start_cond);
+	pthread_mutex_unlock(&start_mutex);
+
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	free(threads);
+	if (file_fd >= 0)
+		close(file_fd);
+
+	faults = (unsigned long long)nr_threads * nr_runs * (len / page_size);
+	result_usec = diff.tv_sec * 1000000ULL + diff.tv_usec;
+	if (!result_usec)
+		result_usec = 1;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d thread(s) faulting %s %s pages of a %s mapping, "
+		       "%d run(s)\n\n", nr_threads, length_str,
+		       do_write ? "write" : "read", type_str, nr_runs);
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+
+		printf(" %14lf usecs/fault (per thread)\n",
+		       (double)result_usec * nr_threads / (double)faults);
+		printf(" %14llu faults/sec\n",
+		       faults * 1000000ULL / result_usec);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%llu\n", faults * 1000000ULL / result_usec);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
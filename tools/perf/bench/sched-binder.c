@@ -0,0 +1,315 @@
+/*
+ *
+ * sched-binder.c
+ *
+ * binder: Synchronous binder transaction ping-pong between two processes
+ *
+ * The child becomes the binder context manager (handle 0) and replies to
+ * every transaction it receives with a payload of the same size; the
+ * parent sends transactions to handle 0 and waits for each reply.  This
+ * is the round trip every Android IPC call takes, without libbinder on
+ * top of it.
+ *
+ * Only one context manager can exist per boot, so this has to run while
+ * servicemanager is stopped (or on a system without one).
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include "../../../drivers/staging/android/binder.h"
+
+#define LOOPS_DEFAULT	100000
+#define BINDER_VM_SIZE	(128 * 1024)
+#define PING_CODE	1
+#define QUIT_CODE	2
+
+static int loops = LOOPS_DEFAULT;
+static int payload = 64;
+static const char *device = "/dev/binder";
+
+static const struct option options[] = {
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of loops"),
+	OPT_INTEGER('s', "size", &payload,
+		    "Specify bytes of payload in each direction"),
+	OPT_STRING('d', "device", &device, "/dev/binder",
+		    "Specify the binder device node"),
+	OPT_END()
+};
+
+static const char * const bench_sched_binder_usage[] = {
+	"perf bench sched binder <options>",
+	NULL
+};
+
+struct binder_cmd_txn {
+	uint32_t cmd;
+	struct binder_transaction_data txn;
+} __attribute__((packed));
+
+struct binder_cmd_free_reply {
+	uint32_t free_cmd;
+	void *buffer;
+	uint32_t cmd;
+	struct binder_transaction_data txn;
+} __attribute__((packed));
+
+static char *payload_buf;
+
+static int binder_open(void)
+{
+	int fd = open(device, O_RDWR);
+
+	if (fd < 0)
+		return -1;
+
+	if (mmap(NULL, BINDER_VM_SIZE, PROT_READ, MAP_PRIVATE,
+		 fd, 0) == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int binder_write(int fd, void *data, size_t len)
+{
+	struct binder_write_read bwr;
+	int ret;
+
+	memset(&bwr, 0, sizeof(bwr));
+	bwr.write_size = len;
+	bwr.write_buffer = (unsigned long)data;
+	do {
+		ret = ioctl(fd, BINDER_WRITE_READ, &bwr);
+	} while (ret < 0 && errno == EINTR);
+
+	return ret;
+}
+
+/*
+ * Read from the driver until @want shows up, and hand back its
+ * transaction data.  Everything else the driver queues on the way
+ * (BR_NOOP, BR_TRANSACTION_COMPLETE, ...) is skipped by size.
+ */
+static int binder_wait_for(int fd, uint32_t want,
+			   struct binder_transaction_data *txn)
+{
+	struct binder_write_read bwr;
+	uint32_t buf[64];
+	char *ptr, *end;
+	uint32_t cmd;
+
+	for (;;) {
+		memset(&bwr, 0, sizeof(bwr));
+		bwr.read_size = sizeof(buf);
+		bwr.read_buffer = (unsigned long)buf;
+		if (ioctl(fd, BINDER_WRITE_READ, &bwr) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		ptr = (char *)buf;
+		end = ptr + bwr.read_consumed;
+		while (ptr < end) {
+			memcpy(&cmd, ptr, sizeof(cmd));
+			ptr += sizeof(cmd);
+			if (cmd == want) {
+				memcpy(txn, ptr, sizeof(*txn));
+				return 0;
+			}
+			if (cmd == BR_DEAD_REPLY || cmd == BR_FAILED_REPLY) {
+				errno = EPIPE;
+				return -1;
+			}
+			ptr += _IOC_SIZE(cmd);
+		}
+	}
+}
+
+/* returned by value: the command buffers it goes into are packed */
+static struct binder_transaction_data binder_txn(unsigned int code)
+{
+	struct binder_transaction_data txn;
+
+	memset(&txn, 0, sizeof(txn));
+	txn.target.handle = 0;
+	txn.code = code;
+	txn.data_size = payload;
+	txn.data.ptr.buffer = payload_buf;
+	return txn;
+}
+
+static void server(int fd, int ready_fd)
+{
+	struct binder_cmd_free_reply reply;
+	struct binder_transaction_data txn;
+	uint32_t cmd = BC_ENTER_LOOPER;
+	int err = 0, __used ret;
+
+	if (ioctl(fd, BINDER_SET_CONTEXT_MGR, 0) < 0 ||
+	    binder_write(fd, &cmd, sizeof(cmd)) < 0)
+		err = errno;
+	ret = write(ready_fd, &err, sizeof(err));
+	if (err)
+		exit(1);
+
+	for (;;) {
+		if (binder_wait_for(fd, BR_TRANSACTION, &txn) < 0)
+			exit(1);
+
+		reply.free_cmd = BC_FREE_BUFFER;
+		reply.buffer = (void *)txn.data.ptr.buffer;
+		reply.cmd = BC_REPLY;
+		reply.txn = binder_txn(txn.code);
+		if (binder_write(fd, &reply, sizeof(reply)) < 0)
+			exit(1);
+
+		if (txn.code == QUIT_CODE)
+			exit(0);
+	}
+}
+
+static int transact(int fd, unsigned int code)
+{
+	struct binder_cmd_txn req;
+	struct binder_transaction_data reply;
+	struct {
+		uint32_t cmd;
+		void *buffer;
+	} __attribute__((packed)) free_buf;
+
+	req.cmd = BC_TRANSACTION;
+	req.txn = binder_txn(code);
+	if (binder_write(fd, &req, sizeof(req)) < 0 ||
+	    binder_wait_for(fd, BR_REPLY, &reply) < 0)
+		return -1;
+
+	free_buf.cmd = BC_FREE_BUFFER;
+	free_buf.buffer = (void *)reply.data.ptr.buffer;
+	return binder_write(fd, &free_buf, sizeof(free_buf));
+}
+
+int bench_sched_binder(int argc, const char **argv,
+		       const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long result_usec = 0;
+	int ready[2], fd, i, err, wait_stat;
+	int __used ret;
+	pid_t pid;
+
+	argc = parse_options(argc, argv, options,
+			     bench_sched_binder_usage, 0);
+
+	if (payload < 0 || payload > BINDER_VM_SIZE / 4) {
+		fprintf(stderr, "Invalid payload size:%d\n", payload);
+		return 1;
+	}
+	payload_buf = zalloc(payload ? payload : 1);
+	if (!payload_buf)
+		die("memory allocation failed\n");
+
+	if (pipe(ready) < 0)
+		die("pipe failed: %s\n", strerror(errno));
+
+	pid = fork();
+	if (pid < 0)
+		die("fork failed: %s\n", strerror(errno));
+
+	if (!pid) {
+		close(ready[0]);
+		fd = binder_open();
+		if (fd < 0) {
+			err = errno;
+			ret = write(ready[1], &err, sizeof(err));
+			exit(1);
+		}
+		server(fd, ready[1]);
+	}
+
+	close(ready[1]);
+	if (read(ready[0], &err, sizeof(err)) != sizeof(err))
+		err = EIO;
+	close(ready[0]);
+	if (err) {
+		fprintf(stderr, "Cannot set up binder context manager on %s: "
+			"%s\n", device, strerror(err));
+		if (err == EBUSY || err == EPERM)
+			fprintf(stderr, "(is servicemanager running?)\n");
+		waitpid(pid, &wait_stat, 0);
+		return 1;
+	}
+
+	fd = binder_open();
+	if (fd < 0)
+		die("cannot open %s: %s\n", device, strerror(errno));
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < loops; i++) {
+		if (transact(fd, PING_CODE) < 0)
+			die("binder transaction failed: %s\n",
+			    strerror(errno));
+	}
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	transact(fd, QUIT_CODE);
+	waitpid(pid, &wait_stat, 0);
+	close(fd);
+	free(payload_buf);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Executed %d binder transactions of %d bytes "
+		       "between two tasks\n\n", loops, payload);
+
+		result_usec = diff.tv_sec * 1000000;
+		result_usec += diff.tv_usec;
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf usecs/op\n",
+		       (double)result_usec / (double)loops);
+		printf(" %14d ops/sec\n",
+		       (int)((double)loops /
+			     ((double)result_usec / (double)1000000)));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -13,6 +13,7 @@
  * Available subsystem list:
  *  sched ... scheduler and IPC mechanism
  *  mem   ... memory access performance
+ *  futex ... futex based locking
  *
  */
 
@@ -42,6 +43,9 @@ static struct bench_suite sched_suites[] = {
 	{ "pipe",
 	  "Flood of communication over pipe() between two processes",
 	  bench_sched_pipe      },
+	{ "binder",
+	  "Binder transaction ping-pong between two processes",
+	  bench_sched_binder    },
 	suite_all,
 	{ NULL,
 	  NULL,
@@ -52,6 +56,22 @@ static struct bench_suite mem_suites[] = {
 	{ "memcpy",
 	  "Simple memory copy in various ways",
 	  bench_mem_memcpy },
+	{ "memset",
+	  "Simple memory set in various ways",
+	  bench_mem_memset },
+	{ "pagefault",
+	  "Page fault throughput on anonymous and file mappings",
+	  bench_mem_pagefault },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite futex_suites[] = {
+	{ "lock",
+	  "Threads contending for a futex-based mutex",
+	  bench_futex_lock },
 	suite_all,
 	{ NULL,
 	  NULL,
@@ -71,6 +91,9 @@ static struct bench_subsys subsystems[] = {
 	{ "mem",
 	  "memory access performance",
 	  mem_suites },
+	{ "futex",
+	  "futex based locking",
+	  futex_suites },
 	{ "all",		/* sentinel: easy for help */
 	  "test all subsystem (pseudo subsystem)",
 	  NULL },
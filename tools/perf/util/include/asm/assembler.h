@@ -0,0 +1,25 @@
+#ifndef PERF_ASM_ASSEMBLER_H_
+#define PERF_ASM_ASSEMBLER_H_
+
+/* assembler.h ... for including arch/arm/lib/mem{cpy,set}.S */
+
+#ifndef __ARMEB__
+#define pull		lsr
+#define push		lsl
+#else
+#define pull		lsl
+#define push		lsr
+#endif
+
+#if defined(__ARM_ARCH_4__) || defined(__ARM_ARCH_4T__)
+#define PLD(code...)
+#else
+#define PLD(code...)	code
+#endif
+
+#define CALGN(code...)
+
+/* the routines are always built in ARM state, see mem-*-arm-asm.S */
+#define W(instr)	instr
+
+#endif	/* PERF_ASM_ASSEMBLER_H_ */
@@ -2,7 +2,10 @@
 #ifndef PERF_LINUX_LINKAGE_H_
 #define PERF_LINUX_LINKAGE_H_
 
-/* linkage.h ... for including arch/x86/lib/memcpy_64.S */
+/*
+ * linkage.h ... for including arch/x86/lib/memcpy_64.S and
+ * arch/arm/lib/mem{cpy,set}.S
+ */
 
 #define ENTRY(name)				\
 	.globl name;				\
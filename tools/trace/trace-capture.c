@@ -0,0 +1,330 @@
+/*
+ * trace-capture: stream the ftrace ring buffer to disk in binary form
+ *
+ * One thread per CPU splices whole pages out of
+ * per_cpu/cpuN/trace_pipe_raw and writes them to <prefix>.cpuN, through
+ * zlib when -z is given.  The pages are never formatted on the device;
+ * events/header_page, events/header_event and the format files of the
+ * enabled events are all that is needed to decode them offline.
+ *
+ * On SIGINT or SIGTERM the threads drain the partially filled pages
+ * still in the buffer with read() and exit.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Compile by:
+ *
+ * gcc -Wall -O2 -o trace-capture trace-capture.c -lpthread -lz
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <zlib.h>
+
+#define MAX_CPUS	64
+
+struct capture {
+	pthread_t	thread;
+	int		cpu;
+	int		raw_fd;
+	int		out_fd;
+	gzFile		gz;
+	int		pipe_fd[2];
+	unsigned long long bytes;
+};
+
+static const char *tracing_dir = "/sys/kernel/debug/tracing";
+static const char *prefix = "trace";
+static int use_zlib;
+static int pages_per_splice = 16;
+static long page_size;
+
+static volatile sig_atomic_t stop;
+static struct capture captures[MAX_CPUS];
+static int nr_captures;
+
+static void fatal(const char *fmt, ...)
+	__attribute__((format(printf, 1, 2)));
+
+static void fatal(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	if (errno)
+		fprintf(stderr, ": %s", strerror(errno));
+	fputc('\n', stderr);
+	exit(1);
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+	while (len) {
+		ssize_t r = write(fd, buf, len);
+
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += r;
+		len -= r;
+	}
+	return 0;
+}
+
+static int emit(struct capture *c, const char *buf, size_t len)
+{
+	c->bytes += len;
+	if (use_zlib)
+		return gzwrite(c->gz, buf, len) == (int)len ? 0 : -1;
+	return write_all(c->out_fd, buf, len);
+}
+
+/* Move whatever sits in the pipe to the output file. */
+static int flush_pipe(struct capture *c, ssize_t len)
+{
+	char buf[8192];
+	ssize_t r;
+
+	while (len > 0) {
+		if (!use_zlib) {
+			r = splice(c->pipe_fd[0], NULL, c->out_fd, NULL, len,
+				   SPLICE_F_MOVE);
+			if (r > 0)
+				c->bytes += r;
+		} else {
+			r = read(c->pipe_fd[0], buf,
+				 (size_t)len < sizeof(buf) ? (size_t)len :
+							     sizeof(buf));
+			if (r > 0 && emit(c, buf, r) < 0)
+				return -1;
+		}
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			return -1;
+		len -= r;
+	}
+	return 0;
+}
+
+/* Partially filled pages cannot be spliced; read() copies them out. */
+static void drain(struct capture *c)
+{
+	char *page = malloc(page_size);
+	ssize_t r;
+
+	if (!page)
+		return;
+
+	fcntl(c->raw_fd, F_SETFL, O_NONBLOCK);
+	while ((r = read(c->raw_fd, page, page_size)) > 0) {
+		if (r < page_size)
+			memset(page + r, 0, page_size - r);
+		if (emit(c, page, page_size) < 0)
+			break;
+	}
+	free(page);
+}
+
+static void *capture_thread(void *arg)
+{
+	struct capture *c = arg;
+	size_t len = pages_per_splice * page_size;
+	ssize_t r;
+
+	while (!stop) {
+		/* blocks until the writer has finished at least one page */
+		r = splice(c->raw_fd, NULL, c->pipe_fd[1], NULL, len,
+			   SPLICE_F_MOVE);
+		if (r < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			perror("splice");
+			break;
+		}
+		if (flush_pipe(c, r) < 0) {
+			perror("write");
+			break;
+		}
+	}
+	drain(c);
+
+	if (use_zlib)
+		gzclose(c->gz);
+	else
+		close(c->out_fd);
+	close(c->raw_fd);
+	close(c->pipe_fd[0]);
+	close(c->pipe_fd[1]);
+
+	return NULL;
+}
+
+static void copy_file(const char *name)
+{
+	char path[PATH_MAX], out[PATH_MAX], buf[4096];
+	int in_fd, out_fd;
+	ssize_t r;
+
+	snprintf(path, sizeof(path), "%s/events/%s", tracing_dir, name);
+	snprintf(out, sizeof(out), "%s.%s", prefix, name);
+	in_fd = open(path, O_RDONLY);
+	if (in_fd < 0)
+		fatal("open %s", path);
+	out_fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (out_fd < 0)
+		fatal("create %s", out);
+	while ((r = read(in_fd, buf, sizeof(buf))) > 0)
+		if (write_all(out_fd, buf, r) < 0)
+			fatal("write %s", out);
+	close(in_fd);
+	close(out_fd);
+}
+
+static int setup_capture(struct capture *c, int cpu)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/per_cpu/cpu%d/trace_pipe_raw",
+		 tracing_dir, cpu);
+	c->raw_fd = open(path, O_RDONLY);
+	if (c->raw_fd < 0)
+		return -1;
+
+	if (pipe(c->pipe_fd) < 0)
+		fatal("pipe");
+
+	snprintf(path, sizeof(path), "%s.cpu%d%s", prefix, cpu,
+		 use_zlib ? ".gz" : "");
+	c->out_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (c->out_fd < 0)
+		fatal("create %s", path);
+	if (use_zlib) {
+		c->gz = gzdopen(c->out_fd, "wb1");
+		if (!c->gz)
+			fatal("gzdopen %s", path);
+	}
+	c->cpu = cpu;
+
+	return 0;
+}
+
+static void stop_handler(int sig __attribute__((unused)))
+{
+	stop = 1;
+}
+
+static void usage(void)
+{
+	printf("trace-capture [-t tracing dir] [-o prefix] [-p pages] [-z]\n"
+		"\n"
+		"-t <dir>     Tracing directory (default %s)\n"
+		"-o <prefix>  Write <prefix>.cpuN files (default %s)\n"
+		"-p <pages>   Pages moved per splice (default %d)\n"
+		"-z           Compress the output with zlib\n",
+		tracing_dir, prefix, pages_per_splice);
+}
+
+int main(int argc, char *argv[])
+{
+	struct sigaction sa;
+	sigset_t mask;
+	int cpu, c, i;
+
+	while ((c = getopt(argc, argv, "t:o:p:zh")) != -1) {
+		switch (c) {
+		case 't':
+			tracing_dir = optarg;
+			break;
+		case 'o':
+			prefix = optarg;
+			break;
+		case 'p':
+			pages_per_splice = atoi(optarg);
+			if (pages_per_splice < 1)
+				pages_per_splice = 1;
+			break;
+		case 'z':
+			use_zlib = 1;
+			break;
+		default:
+			usage();
+			return c == 'h' ? 0 : 1;
+		}
+	}
+
+	page_size = sysconf(_SC_PAGESIZE);
+
+	copy_file("header_page");
+	copy_file("header_event");
+
+	/* no SA_RESTART: the signal has to break the threads out of splice */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = stop_handler;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGUSR1, &sa, NULL);
+
+	for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+		if (setup_capture(&captures[nr_captures], cpu) < 0)
+			continue;
+		nr_captures++;
+	}
+	if (!nr_captures) {
+		errno = 0;
+		fatal("no trace_pipe_raw files under %s/per_cpu", tracing_dir);
+	}
+
+	/* the capture threads only see SIGUSR1, sent by us below */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &mask, NULL);
+	for (i = 0; i < nr_captures; i++) {
+		errno = pthread_create(&captures[i].thread, NULL,
+				       capture_thread, &captures[i]);
+		if (errno)
+			fatal("pthread_create");
+	}
+	pthread_sigmask(SIG_UNBLOCK, &mask, NULL);
+
+	while (!stop)
+		pause();
+
+	for (i = 0; i < nr_captures; i++) {
+		struct timespec ts;
+
+		/* keep kicking in case it had not gone to sleep yet */
+		do {
+			pthread_kill(captures[i].thread, SIGUSR1);
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_nsec += 100 * 1000 * 1000;
+			if (ts.tv_nsec >= 1000 * 1000 * 1000) {
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000 * 1000 * 1000;
+			}
+		} while (pthread_timedjoin_np(captures[i].thread, NULL, &ts));
+		fprintf(stderr, "cpu%d: %llu bytes\n", captures[i].cpu,
+			captures[i].bytes);
+	}
+
+	return 0;
+}
@@ -32,11 +32,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <linux/aio_abi.h>
+
 #include "../../include/linux/usb/functionfs.h"
 
 
@@ -220,6 +226,14 @@ static const struct {
 #define STR_INTERFACE strings.lang0.str1
 
 
+/******************** Options ***********************************************/
+
+static size_t   data_buf_size;	/* transfer size of ep1 and ep2 */
+static unsigned aio_depth;	/* 0 -- synchronous read(2)/write(2) */
+static int      use_mmap;	/* transfer from/to mmap()ed buffers */
+static int      report;		/* print throughput */
+
+
 /******************** Files and Threads Handling ****************************/
 
 struct thread;
@@ -245,35 +259,59 @@ static struct thread {
 	pthread_t id;
 	void *buf;
 	ssize_t status;
+
+	size_t map_len;
+	unsigned long long bytes, last_bytes;
+	double start, last;
 } threads[] = {
 	{
 		"ep0", 4 * sizeof(struct usb_functionfs_event),
 		read_wrap, NULL,
 		ep0_consume, "<consume>",
-		0, 0, NULL, 0
+		0, 0, NULL, 0, 0, 0, 0, 0, 0
 	},
 	{
 		"ep1", 8 * 1024,
 		fill_in_buf, "<in>",
 		write_wrap, NULL,
-		0, 0, NULL, 0
+		0, 0, NULL, 0, 0, 0, 0, 0, 0
 	},
 	{
 		"ep2", 8 * 1024,
 		read_wrap, NULL,
 		empty_out_buf, "<out>",
-		0, 0, NULL, 0
+		0, 0, NULL, 0, 0, 0, 0, 0, 0
 	},
 };
 
 
 static void init_thread(struct thread *t)
 {
-	t->buf = malloc(t->buf_size);
-	die_on(!t->buf, "malloc");
+	size_t len;
 
 	t->fd = open(t->filename, O_RDWR);
 	die_on(t->fd < 0, "%s", t->filename);
+
+	if (t == threads) {
+		t->buf = malloc(t->buf_size);
+		die_on(!t->buf, "malloc");
+		return;
+	}
+
+	/* one buffer per request in flight */
+	if (data_buf_size)
+		t->buf_size = data_buf_size;
+	len = t->buf_size * (aio_depth ? aio_depth : 1);
+
+	if (use_mmap) {
+		t->buf = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED,
+			      t->fd, 0);
+		die_on(t->buf == MAP_FAILED, "%s: mmap", t->filename);
+		t->map_len = len;
+	} else {
+		t->buf = malloc(len);
+		die_on(!t->buf, "malloc");
+	}
 }
 
 static void cleanup_thread(void *arg)
@@ -300,25 +338,24 @@ static void cleanup_thread(void *arg)
 		}
 	}
 
+	if (t->map_len)
+		munmap(t->buf, t->map_len);
+	else
+		free(t->buf);
+	t->buf = NULL;
+
 	if (close(fd) < 0)
 		err("%s: close", t->filename);
-
-	free(t->buf);
-	t->buf = NULL;
 }
 
-static void *start_thread_helper(void *arg)
+static ssize_t sync_loop(struct thread *t)
 {
 	const char *name, *op, *in_name, *out_name;
-	struct thread *t = arg;
 	ssize_t ret;
 
-	info("%s: starts\n", t->filename);
 	in_name = t->in_name ? t->in_name : t->filename;
 	out_name = t->out_name ? t->out_name : t->filename;
 
-	pthread_cleanup_push(cleanup_thread, arg);
-
 	for (;;) {
 		pthread_testcancel();
 
@@ -345,8 +382,31 @@ static void *start_thread_helper(void *arg)
 		}
 	}
 
+	return ret;
+}
+
+static ssize_t aio_loop(struct thread *t);
+
+static void *start_thread_helper(void *arg)
+{
+	struct thread *t = arg;
+	ssize_t ret;
+
+	info("%s: starts\n", t->filename);
+
+	pthread_cleanup_push(cleanup_thread, arg);
+
+	if (aio_depth && t != threads)
+		ret = aio_loop(t);
+	else
+		ret = sync_loop(t);
+
 	pthread_cleanup_pop(1);
 
+	if (report && t->bytes && t->last > t->start)
+		info("%s: %llu bytes, %.2f MB/s\n", t->filename, t->bytes,
+		     t->bytes / (t->last - t->start) / 1e6);
+
 	t->status = ret;
 	info("%s: ends\n", t->filename);
 	return NULL;
@@ -371,14 +431,179 @@ static void join_thread(struct thread *t)
 }
 
 
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Counts transferred bytes and reports throughput once a second. */
+static void account(struct thread *t, ssize_t nbytes)
+{
+	double time;
+
+	if (nbytes <= 0 || t == threads)
+		return;
+
+	t->bytes += nbytes;
+	if (!report)
+		return;
+
+	time = now();
+	if (!t->start) {
+		t->start = t->last = time;
+	} else if (time - t->last >= 1.0) {
+		info("%s: %.2f MB/s\n", t->filename,
+		     (t->bytes - t->last_bytes) / (time - t->last) / 1e6);
+		t->last_bytes = t->bytes;
+		t->last = time;
+	}
+}
+
 static ssize_t read_wrap(struct thread *t, void *buf, size_t nbytes)
 {
-	return read(t->fd, buf, nbytes);
+	ssize_t ret = read(t->fd, buf, nbytes);
+
+	account(t, ret);
+	return ret;
 }
 
 static ssize_t write_wrap(struct thread *t, const void *buf, size_t nbytes)
 {
-	return write(t->fd, buf, nbytes);
+	ssize_t ret = write(t->fd, buf, nbytes);
+
+	account(t, ret);
+	return ret;
+}
+
+
+/******************** Asynchronous I/O **************************************/
+
+static inline int io_setup(unsigned nr, aio_context_t *ctx)
+{
+	return syscall(__NR_io_setup, nr, ctx);
+}
+
+static inline int io_destroy(aio_context_t ctx)
+{
+	return syscall(__NR_io_destroy, ctx);
+}
+
+static inline int io_submit(aio_context_t ctx, long nr, struct iocb **iocbpp)
+{
+	return syscall(__NR_io_submit, ctx, nr, iocbpp);
+}
+
+static inline int io_getevents(aio_context_t ctx, long min_nr, long nr,
+			       struct io_event *events,
+			       struct timespec *timeout)
+{
+	return syscall(__NR_io_getevents, ctx, min_nr, nr, events, timeout);
+}
+
+/*
+ * Fills (IN endpoint) and submits request @i.  Returns 1 if submitted,
+ * 0 on end of input and -1 on error.
+ */
+static int aio_submit_one(struct thread *t, aio_context_t ctx,
+			  struct iocb *iocb, unsigned i)
+{
+	void *buf = (char *)t->buf + i * t->buf_size;
+	ssize_t ret;
+
+	memset(iocb, 0, sizeof *iocb);
+	iocb->aio_data = i;
+	iocb->aio_fildes = t->fd;
+	iocb->aio_buf = (uintptr_t)buf;
+	iocb->aio_nbytes = t->buf_size;
+
+	if (t->in == fill_in_buf) {
+		ret = t->in(t, buf, t->buf_size);
+		if (ret <= 0)
+			return ret;
+		iocb->aio_lio_opcode = IOCB_CMD_PWRITE;
+		iocb->aio_nbytes = ret;
+	} else {
+		iocb->aio_lio_opcode = IOCB_CMD_PREAD;
+	}
+
+	if (io_submit(ctx, 1, &iocb) < 0) {
+		warn("%s: io_submit", t->filename);
+		return -1;
+	}
+	return 1;
+}
+
+/*
+ * Keeps aio_depth requests queued on the endpoint, resubmitting each
+ * one as soon as it completes.  Whatever is still in flight when the
+ * loop ends is cancelled by io_destroy().
+ */
+static ssize_t aio_loop(struct thread *t)
+{
+	struct io_event *events, *e;
+	struct iocb *iocbs;
+	aio_context_t ctx = 0;
+	unsigned inflight = 0, i;
+	ssize_t ret = 0;
+	int n;
+
+	iocbs = calloc(aio_depth, sizeof *iocbs);
+	events = calloc(aio_depth, sizeof *events);
+	die_on(!iocbs || !events, "calloc");
+	die_on(io_setup(aio_depth, &ctx) < 0, "%s: io_setup", t->filename);
+
+	for (i = 0; i < aio_depth; ++i) {
+		ret = aio_submit_one(t, ctx, iocbs + i, i);
+		if (ret <= 0)
+			break;
+		++inflight;
+	}
+
+	while (inflight && ret > 0) {
+		pthread_testcancel();
+
+		n = io_getevents(ctx, 1, aio_depth, events, NULL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			warn("%s: io_getevents", t->filename);
+			ret = -1;
+			break;
+		}
+
+		for (e = events; n; --n, ++e) {
+			i = e->data;
+			--inflight;
+
+			if ((long long)e->res < 0) {
+				errno = -(long long)e->res;
+				ret = -1;
+				warn("%s: aio", t->filename);
+				break;
+			}
+
+			account(t, e->res);
+			if (t->out != write_wrap &&
+			    t->out(t, (char *)t->buf + i * t->buf_size,
+				   e->res) < 0) {
+				ret = -1;
+				break;
+			}
+
+			ret = aio_submit_one(t, ctx, iocbs + i, i);
+			if (ret <= 0)
+				break;
+			++inflight;
+		}
+	}
+
+	io_destroy(ctx);
+	free(events);
+	free(iocbs);
+	return ret;
 }
 
 
@@ -443,6 +668,7 @@ empty_out_buf(struct thread *ignore, const void *buf, size_t nbytes)
 		ret = fwrite(buf, nbytes, 1, stdout);
 		if (ret > 0)
 			fflush(stdout);
+		len = nbytes;
 		break;
 
 invalid:
@@ -530,11 +756,51 @@ static void ep0_init(struct thread *t)
 
 /******************** Main **************************************************/
 
-int main(void)
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: %s [-s size] [-n depth] [-m] [-p zero|seq|pipe] [-r]\n"
+		"  -s size   transfer size of the data endpoints (default 8192)\n"
+		"  -n depth  keep depth asynchronous requests in flight\n"
+		"  -m        mmap() the endpoint buffers (zero-copy)\n"
+		"  -p pat    data pattern (default zero)\n"
+		"  -r        report throughput every second\n", argv0);
+	exit(1);
+}
+
+int main(int argc, char **argv)
 {
 	unsigned i;
+	int opt;
 
-	/* XXX TODO: Argument parsing missing */
+	while ((opt = getopt(argc, argv, "s:n:mp:r")) != -1)
+		switch (opt) {
+		case 's':
+			data_buf_size = strtoul(optarg, NULL, 0);
+			die_on(!data_buf_size, "invalid size: %s\n", optarg);
+			break;
+		case 'n':
+			aio_depth = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			use_mmap = 1;
+			break;
+		case 'p':
+			if (!strcmp(optarg, "zero"))
+				pattern = PAT_ZERO;
+			else if (!strcmp(optarg, "seq"))
+				pattern = PAT_SEQ;
+			else if (!strcmp(optarg, "pipe"))
+				pattern = PAT_PIPE;
+			else
+				usage();
+			break;
+		case 'r':
+			report = 1;
+			break;
+		default:
+			usage();
+		}
 
 	init_thread(threads);
 	ep0_init(threads);